@@ -184,7 +184,8 @@ save_with_gnuastro_lib(struct converttparams *p)
 
     /* Plain text: only one channel is acceptable. */
     case OUT_FORMAT_TXT:
-      gal_txt_write(p->chll, NULL, p->cp.output, p->cp.dontdelete);
+      gal_txt_write(p->chll, NULL, p->cp.output, p->cp.numthreads,
+                    p->cp.dontdelete);
       break;
 
 
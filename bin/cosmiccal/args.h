@@ -31,6 +31,19 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* Array of acceptable options. */
 struct argp_option program_options[] =
   {
+    {
+      "column",
+      UI_KEY_COLUMN,
+      "STR",
+      0,
+      "Column name or number of redshifts in input table.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->column,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "redshift",
       UI_KEY_REDSHIFT,
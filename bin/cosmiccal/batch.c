@@ -0,0 +1,475 @@
+/*********************************************************************
+CosmicCalculator - Calculate cosmological parameters
+CosmicCalculator is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/list.h>
+#include <gnuastro/fits.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/table.h>
+#include <gnuastro/threads.h>
+
+#include <gnuastro-internal/timing.h>
+
+#include "main.h"
+
+#include "batch.h"
+#include "cosmiccal.h"
+
+
+
+
+
+/* When an input table is given, the calculations are done for the
+   redshift of every row. The integrals (that are the slow part) only
+   depend on the redshift for a given cosmology. So before going over the
+   rows, they are tabulated once as piecewise Chebyshev series over
+   `x=ln(1+z)' (from zero to the largest redshift in the table). Each row
+   then only needs one short polynomial evaluation for each integral.
+
+   The tabulated functions are the proper distance, comoving volume and
+   look-back time, divided by `z', `z^3' and `z' respectively (so they
+   don't go to zero at `z=0' and the relative accuracy is kept at low
+   redshifts). The age at `z' is found from the look-back time. The range
+   is divided into segments of equal width in `x' and in each segment,
+   every function is fitted with `BATCH_CHEB_ORDER' Chebyshev polynomials
+   (using the value of the integral on the Chebyshev nodes of the
+   segment). The number of segments is doubled until the last two
+   coefficients of all the series are smaller than `GSLIEPSREL' (the
+   relative accuracy requested from the integrations) times the
+   function. */
+struct batchparams
+{
+  struct cosmiccalparams *p;    /* Main program parameters.             */
+  double               width;   /* Width of each segment (in `x').      */
+  size_t              numseg;   /* Number of segments.                  */
+  double               *coef;   /* Coefficients of all segments.        */
+  uint8_t               *bad;   /* ==1: segment needs to be narrower.   */
+  double                  *z;   /* Input redshifts.                     */
+  size_t                size;   /* Number of input redshifts.           */
+  double              curage;   /* Age of the Universe now.             */
+  double *out[BATCH_NUM_COLS];  /* Output columns (NULL if not wanted). */
+};
+
+
+
+
+
+/* Information of the output columns (in the same order as `enum
+   batch_columns'). */
+static char *batch_colnames[BATCH_NUM_COLS]=
+  { "REDSHIFT", "PROPDIST", "ANGDIST", "ARCSECTAN", "LUMDIST", "DISTMOD",
+    "ABSMAGCONV", "AGE", "LOOKBACK", "CRITDENS", "VOLUME" };
+
+static char *batch_colunits[BATCH_NUM_COLS]=
+  { "no unit", "Mpc", "Mpc", "Kpc", "Mpc", "no unit", "no unit", "Gyr",
+    "Gyr", "g/cm^3", "Mpc^3" };
+
+static char *batch_colcomments[BATCH_NUM_COLS]=
+  { "Input redshift (z).",
+    "Proper distance to z.",
+    "Angular diameter distance to z.",
+    "Tangential distance covered by 1 arcsec at z.",
+    "Luminosity distance to z.",
+    "Distance modulus at z.",
+    "Conversion to absolute magnitude.",
+    "Age of Universe at z.",
+    "Look-back time to z.",
+    "Critical density at z.",
+    "Comoving volume over 4pi stradian to z." };
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************         Interpolation tables        *************/
+/**************************************************************/
+/* Fit the Chebyshev series of the three functions in segment `s'. */
+static void
+batch_table_segment(struct batchparams *bp, size_t s)
+{
+  struct cosmiccalparams *p=bp->p;
+
+  size_t i, j, k, n=BATCH_CHEB_ORDER;
+  double *c, t, x, z, sum, scale, f[BATCH_NUM_FUNCS][BATCH_CHEB_ORDER];
+
+  /* Find the functions on the Chebyshev nodes of this segment. Note that
+     the nodes are never on the edges of the segment, so `z>0'. */
+  for(k=0;k<n;++k)
+    {
+      t = cos( M_PI*(k+0.5f)/n );
+      x = (s + (t+1)/2) * bp->width;
+      z = expm1(x);
+      f[0][k] = properdistance(p, z) / z;
+      f[1][k] = comovingvolume(p, z) / (z*z*z);
+      f[2][k] = lookbacktime(p, z) / z;
+    }
+
+  /* Find the coefficients of each function and check their accuracy.
+     Note that the first coefficient is kept halved, so the series is a
+     simple sum. */
+  for(i=0;i<BATCH_NUM_FUNCS;++i)
+    {
+      scale=0.0f;
+      c = bp->coef + (s*BATCH_NUM_FUNCS+i)*n;
+      for(j=0;j<n;++j)
+        {
+          sum=0.0f;
+          for(k=0;k<n;++k)
+            sum += f[i][k] * cos( M_PI*j*(k+0.5f)/n );
+          c[j] = 2*sum/n;
+          if( fabs(f[i][j])>scale ) scale=fabs(f[i][j]);
+        }
+      c[0]/=2;
+
+      if( fabs(c[n-1]) + fabs(c[n-2]) > GSLIEPSREL*scale )
+        bp->bad[s]=1;
+    }
+}
+
+
+
+
+
+static void *
+batch_table_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct batchparams *bp=(struct batchparams *)tprm->params;
+
+  size_t i;
+
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    batch_table_segment(bp, tprm->indexs[i]);
+
+  /* Wait for all the other threads to finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Make the interpolation table for redshifts up to `zmax'. */
+static void
+batch_table(struct batchparams *bp, double zmax)
+{
+  size_t s;
+  int anybad;
+  double xmax = zmax>0.0f ? log1p(zmax) : 1.0f;
+
+  /* Start with one segment and make them narrower until the series are
+     accurate enough everywhere. */
+  bp->numseg=1;
+  while(1)
+    {
+      /* Allocate the space for this number of segments. */
+      errno=0;
+      bp->width=xmax/bp->numseg;
+      bp->coef=realloc(bp->coef, ( bp->numseg * BATCH_NUM_FUNCS
+                                   * BATCH_CHEB_ORDER * sizeof *bp->coef ));
+      if(bp->coef==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating the coefficients of %zu "
+              "segments", __func__, bp->numseg);
+      free(bp->bad);
+      bp->bad=gal_data_calloc_array(GAL_TYPE_UINT8, bp->numseg);
+
+      /* Fit the series in all the segments. */
+      gal_threads_spin_off(batch_table_worker, bp, bp->numseg,
+                           bp->p->cp.numthreads);
+
+      /* See if any segment needs to be narrower. */
+      anybad=0;
+      for(s=0;s<bp->numseg;++s) if(bp->bad[s]) { anybad=1; break; }
+      if(anybad==0) break;
+
+      /* We can't continue making the segments narrower. */
+      if(2*bp->numseg>BATCH_MAX_SEGS)
+        {
+          if(!bp->p->cp.quiet)
+            fprintf(stderr, "\n-------\n"
+                    "WARNING: the interpolation table didn't reach the "
+                    "requested accuracy with %zu segments. So the results "
+                    "may be less accurate than those of a single redshift."
+                    "\n-------\n\n", bp->numseg);
+          break;
+        }
+      bp->numseg*=2;
+    }
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************        Evaluate the table rows      *************/
+/**************************************************************/
+/* Evaluate a Chebyshev series with Clenshaw's recurrence (note that the
+   first coefficient is already halved). */
+static double
+batch_cheb(double *c, double t)
+{
+  size_t j;
+  double b0=0.0f, b1=0.0f, b2;
+
+  for(j=BATCH_CHEB_ORDER-1;j>0;--j)
+    {
+      b2=b1;
+      b1=b0;
+      b0=2*t*b1-b2+c[j];
+    }
+  return t*b0 - b1 + c[0];
+}
+
+
+
+
+
+/* Set the output column if it was requested. */
+#define BATCH_SET(COL, VALUE) if(bp->out[COL]) bp->out[COL][i]=(VALUE)
+
+static void *
+batch_eval_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct batchparams *bp=(struct batchparams *)tprm->params;
+
+  size_t i, j, s, first, end;
+  double *c, t, x, z, ad, ld, lb, pd, vz, distmod;
+
+  for(j=0; tprm->indexs[j]!=GAL_BLANK_SIZE_T; ++j)
+    {
+      first = tprm->indexs[j]*BATCH_ROW_BLOCK;
+      end   = ( first+BATCH_ROW_BLOCK<bp->size
+                ? first+BATCH_ROW_BLOCK : bp->size );
+      for(i=first;i<end;++i)
+        {
+          /* Blank rows will be blank in all columns. */
+          z=bp->z[i];
+          if( isnan(z) )
+            {
+              for(s=0;s<BATCH_NUM_COLS;++s)
+                if(bp->out[s]) bp->out[s][i]=NAN;
+              continue;
+            }
+
+          /* Find the segment and position in it. */
+          x = log1p(z) / bp->width;
+          s = x<bp->numseg ? (size_t)x : bp->numseg-1;
+          t = 2*(x-s)-1;
+          c = bp->coef + s*BATCH_NUM_FUNCS*BATCH_CHEB_ORDER;
+
+          /* The integrals. */
+          pd  = z * batch_cheb(c, t);
+          vz  = z*z*z * batch_cheb(c+BATCH_CHEB_ORDER, t);
+          lb  = z * batch_cheb(c+2*BATCH_CHEB_ORDER, t);
+
+          /* Derived quantities (like `cosmiccal'). */
+          ad=pd/(1+z);
+          ld=pd*(1+z);
+          distmod=5*(log10(ld*1000000)-1);
+
+          /* Put them in the requested columns. */
+          BATCH_SET(BATCH_COL_REDSHIFT,   z);
+          BATCH_SET(BATCH_COL_PROPDIST,   pd);
+          BATCH_SET(BATCH_COL_ANGDIST,    ad);
+          BATCH_SET(BATCH_COL_ARCSECTAN,  ad*1000*M_PI/3600/180);
+          BATCH_SET(BATCH_COL_LUMDIST,    ld);
+          BATCH_SET(BATCH_COL_DISTMOD,    distmod);
+          BATCH_SET(BATCH_COL_ABSMAGCONV, distmod-2.5*log10(1+z));
+          BATCH_SET(BATCH_COL_AGE,        bp->curage-lb);
+          BATCH_SET(BATCH_COL_LOOKBACK,   lb);
+          BATCH_SET(BATCH_COL_CRITDENS,   criticaldensity(bp->p, z));
+          BATCH_SET(BATCH_COL_VOLUME,     vz);
+        }
+    }
+
+  /* Wait for all the other threads to finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************            Main function            *************/
+/**************************************************************/
+/* Write the output table. */
+static void
+batch_write(struct cosmiccalparams *p, gal_data_t *cols)
+{
+  char *tmp;
+  gal_list_str_t *comments=NULL;
+
+  /* Write the comments. NOTE: they are added to the top of the list, so
+     they are written in the reverse of the order we want them. */
+  asprintf(&tmp, "Cosmology: H0=%g, olambda=%g, omatter=%g, "
+           "oradiation=%g", p->H0, p->olambda, p->omatter, p->oradiation);
+  gal_list_str_add(&comments, tmp, 0);
+
+  tmp=gal_fits_name_save_as_string(p->inputname, p->cp.hdu);
+  gal_list_str_add(&comments, tmp, 0);
+
+  asprintf(&tmp, "Cosmological calculations on redshifts (column `%s') "
+           "of:", p->column);
+  gal_list_str_add(&comments, tmp, 0);
+
+  if( gal_fits_name_is_fits(p->cp.output)==0 )
+    gal_table_comments_add_intro(&comments, PROGRAM_STRING, &p->rawtime);
+
+  /* Write the table. */
+  gal_table_write(cols, comments, p->cp.tableformat, p->cp.output,
+                  p->cp.numthreads, p->cp.dontdelete);
+
+  /* Let the user know, if we aren't in quiet mode. */
+  if(!p->cp.quiet)
+    printf("%s created.\n", p->cp.output);
+
+  /* Clean up. */
+  gal_list_str_free(comments, 1);
+}
+
+
+
+
+
+/* Do the calculations for all the redshifts in `p->zcol' and write them
+   in a table. */
+void
+batch_calculate(struct cosmiccalparams *p)
+{
+  size_t i;
+  struct batchparams bp;
+  double *z, *zf, zmax=0.0f;
+  char message[GAL_TIMING_VERB_MSG_LENGTH_V];
+  gal_data_t *cols=NULL, *col[BATCH_NUM_COLS]={NULL};
+
+  /* Initialize the parameters. */
+  bp.p=p;
+  bp.bad=NULL;
+  bp.coef=NULL;
+  bp.z=p->zcol->array;
+  bp.size=p->zcol->size;
+  bp.curage=ageofuniverse(p, 0.0f);
+
+  /* Find the largest redshift and make the interpolation table. */
+  zf=(z=bp.z)+bp.size;
+  for(;z<zf;++z) if(*z>zmax) zmax=*z;
+  batch_table(&bp, zmax);
+  if(!p->cp.quiet)
+    {
+      sprintf(message, "Interpolation table up to z=%g: %zu segment(s).",
+              zmax, bp.numseg);
+      gal_timing_report(NULL, message, 1);
+    }
+
+  /* Allocate the requested columns. When an `--only' option is called,
+     only those columns are written. */
+  for(i=0;i<BATCH_NUM_COLS;++i)
+    {
+      if( (p->onlyvolume || p->onlyabsmagconv)
+          && !(p->onlyvolume && i==BATCH_COL_VOLUME)
+          && !(p->onlyabsmagconv && i==BATCH_COL_ABSMAGCONV) )
+        bp.out[i]=NULL;
+      else
+        {
+          col[i]=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 1, &bp.size, NULL,
+                                0, p->cp.minmapsize, batch_colnames[i],
+                                batch_colunits[i], batch_colcomments[i]);
+          bp.out[i]=col[i]->array;
+        }
+    }
+
+  /* Put the columns into a list (in the same order). */
+  for(i=BATCH_NUM_COLS;i>0;--i)
+    if(col[i-1]) { col[i-1]->next=cols; cols=col[i-1]; }
+
+  /* Do the calculations on all the rows and write the output. */
+  gal_threads_spin_off(batch_eval_worker, &bp,
+                       (bp.size+BATCH_ROW_BLOCK-1)/BATCH_ROW_BLOCK,
+                       p->cp.numthreads);
+  batch_write(p, cols);
+
+  /* Clean up. */
+  free(bp.bad);
+  free(bp.coef);
+  gal_list_data_free(cols);
+  gal_data_free(p->zcol);
+  p->zcol=NULL;
+}
@@ -0,0 +1,53 @@
+/*********************************************************************
+CosmicCalculator - Calculate cosmological parameters
+CosmicCalculator is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef BATCH_H
+#define BATCH_H
+
+/* The interpolation tables. */
+#define BATCH_CHEB_ORDER   16     /* Chebyshev coefficients in a segment. */
+#define BATCH_NUM_FUNCS    3      /* Number of tabulated functions.       */
+#define BATCH_MAX_SEGS     4096   /* Maximum number of segments.          */
+#define BATCH_ROW_BLOCK    4096   /* Rows in each job of a thread.        */
+
+/* The output columns. */
+enum batch_columns
+{
+  BATCH_COL_REDSHIFT,
+  BATCH_COL_PROPDIST,
+  BATCH_COL_ANGDIST,
+  BATCH_COL_ARCSECTAN,
+  BATCH_COL_LUMDIST,
+  BATCH_COL_DISTMOD,
+  BATCH_COL_ABSMAGCONV,
+  BATCH_COL_AGE,
+  BATCH_COL_LOOKBACK,
+  BATCH_COL_CRITDENS,
+  BATCH_COL_VOLUME,
+
+  BATCH_NUM_COLS,               /* Keep this the last. */
+};
+
+void
+batch_calculate(struct cosmiccalparams *p);
+
+#endif
@@ -31,6 +31,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include "main.h"
 
+#include "batch.h"
 #include "cosmiccal.h"
 
 
@@ -107,6 +108,31 @@ ageofuniverse(struct cosmiccalparams *p, double z)
 
   gsl_integration_qagiu(&F, z, GSLIEPSABS, GSLIEPSREL, GSLILIMIT, w,
                         &result, &error);
+  gsl_integration_workspace_free(w);
+
+  return result / p->H0s / (365*GSL_CONST_MKSA_DAY) / 1e9;
+}
+
+
+
+
+
+/* Look-back time to z (in units of Giga years). This is the same as the
+   age of the universe now minus its age at z, but it doesn't lose
+   precision (by subtracting two close numbers) at low redshifts. */
+double
+lookbacktime(struct cosmiccalparams *p, double z)
+{
+  size_t neval;
+  gsl_function F;
+  double result, error;
+
+  /* Set the GSL function parameters */
+  F.params=p;
+  F.function=&age;
+
+  gsl_integration_qng(&F, 0.0f, z, GSLIEPSABS, GSLIEPSREL,
+                      &result, &error, &neval);
 
   return result / p->H0s / (365*GSL_CONST_MKSA_DAY) / 1e9;
 }
@@ -240,6 +266,14 @@ cosmiccal(struct cosmiccalparams *p)
   double ad, ld, vz, pd, absmagconv;
   double curage, ccritd, distmod, outage, zcritd;
 
+  /* When an input table is given, do the calculations on all its
+     rows. */
+  if(p->inputname)
+    {
+      batch_calculate(p);
+      return;
+    }
+
   /* In case the user just wants one number, only print that and
      return. */
   if(p->onlyvolume){
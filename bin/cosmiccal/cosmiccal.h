@@ -32,6 +32,21 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 # define FLTFORMAT " - %-55s%f\n"
 # define EXPFORMAT " - %-55s%e\n"
 
+double
+ageofuniverse(struct cosmiccalparams *p, double z);
+
+double
+lookbacktime(struct cosmiccalparams *p, double z);
+
+double
+properdistance(struct cosmiccalparams *p, double z);
+
+double
+comovingvolume(struct cosmiccalparams *p, double z);
+
+double
+criticaldensity(struct cosmiccalparams *p, double z);
+
 void
 cosmiccal(struct cosmiccalparams *p);
 
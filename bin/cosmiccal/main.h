@@ -46,6 +46,8 @@ struct cosmiccalparams
   struct gal_options_common_params cp;  /* Common parameters.           */
 
   /* Input: */
+  char              *inputname; /* Table of redshifts (batch mode).     */
+  char                 *column; /* Column of redshifts in input table.  */
   double              redshift; /* Redshift of interest.                */
   double                    H0; /* Current expansion rate (km/sec/Mpc). */
   double               olambda; /* Current cosmological constant dens.  */
@@ -62,6 +64,7 @@ struct cosmiccalparams
   double                     c; /* Speed of light.                      */
   double                   H0s; /* Current expansion rate (1/sec).      */
   double                 ocurv; /* Curvature density today.             */
+  gal_data_t             *zcol; /* Redshifts of input table.            */
 
   time_t               rawtime; /* Starting time of the program.        */
 };
@@ -36,6 +36,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro-internal/timing.h>
 #include <gnuastro-internal/options.h>
 #include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/tableintern.h>
 #include <gnuastro-internal/fixedstringmacros.h>
 
 #include "main.h"
@@ -60,11 +61,12 @@ const char *
 argp_program_bug_address = PACKAGE_BUGREPORT;
 
 static char
-args_doc[] = "";
+args_doc[] = "[ASTRdata]";
 
 const char
 doc[] = GAL_STRINGS_TOP_HELP_INFO PROGRAM_NAME" will do cosmological "
-  "calculations.\n"
+  "calculations. If a table is given, the calculations will be done on "
+  "all the redshifts in its `--column' column and written in a table.\n"
   GAL_STRINGS_MORE_HELP_INFO
   /* After the list of options: */
   "\v"
@@ -156,8 +158,10 @@ parse_opt(int key, char *arg, struct argp_state *state)
 
     /* Read the non-option tokens (arguments): */
     case ARGP_KEY_ARG:
-      argp_error(state, "currently %s doesn't take any arguments",
-                 PROGRAM_NAME);
+      if(p->inputname)
+        argp_error(state, "only one argument (input table) should be given");
+      else
+        p->inputname=arg;
       break;
 
 
@@ -209,6 +213,134 @@ ui_read_check_only_options(struct cosmiccalparams *p)
 
   /* Convert H0 from km/sec/Mpc to 1/sec: */
   p->H0s=p->H0/1000/GSL_CONST_MKSA_PARSEC;
+
+  /* Check if the format of the output table is valid, given the type of
+     the output. */
+  gal_tableintern_check_fits_format(p->cp.output, p->cp.tableformat);
+}
+
+
+
+
+
+/* The redshift also has a value in the configuration files, so the only
+   way to know if it was given with a table is to check it after reading
+   the command-line (before the configuration files are read). */
+static void
+ui_check_redshift_with_table(struct cosmiccalparams *p)
+{
+  size_t i;
+  struct argp_option *options=p->cp.poptions;
+
+  if(p->inputname)
+    for(i=0; !gal_options_is_last(&options[i]); ++i)
+      if(options[i].key==UI_KEY_REDSHIFT && options[i].set)
+        error(EXIT_FAILURE, 0, "`--redshift' (`-z') cannot be given with "
+              "an input table (%s): the redshifts are read from its "
+              "`--column' column", p->inputname);
+}
+
+
+
+
+
+static void
+ui_check_options_and_arguments(struct cosmiccalparams *p)
+{
+  /* The column is only relevant with an input table. */
+  if(p->inputname==NULL)
+    {
+      if(p->column)
+        error(EXIT_FAILURE, 0, "`--column' is only relevant when an input "
+              "table is given");
+      return;
+    }
+
+  /* When the input is FITS, a HDU is necessary. */
+  if( gal_fits_name_is_fits(p->inputname) && p->cp.hdu==NULL )
+    error(EXIT_FAILURE, 0, "no HDU specified. When the input is a FITS "
+          "file, a HDU must also be specified, you can use the `--hdu' "
+          "(`-h') option and give it the HDU number (starting from "
+          "zero), extension name, or anything acceptable by CFITSIO");
+
+  /* The column of redshifts is necessary. */
+  if(p->column==NULL)
+    error(EXIT_FAILURE, 0, "no column specified for the redshifts in %s. "
+          "Please use the `--column' (`-c') option to give the column name "
+          "or number (counting from 1)", p->inputname);
+
+  /* Set the output name. */
+  if(p->cp.output==NULL)
+    p->cp.output=gal_checkset_automatic_output(&p->cp, p->inputname,
+                                               "_cosmiccal.txt");
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/***************       Preparations         *******************/
+/**************************************************************/
+/* Read the redshifts of the input table. */
+static void
+ui_read_redshifts(struct cosmiccalparams *p)
+{
+  size_t i;
+  double *z;
+  gal_list_str_t *column=NULL;
+
+  /* Read the column. */
+  gal_list_str_add(&column, p->column, 0);
+  p->zcol=gal_table_read(p->inputname, p->cp.hdu, column, p->cp.searchin,
+                         p->cp.ignorecase, p->cp.numthreads,
+                         p->cp.minmapsize, NULL);
+  gal_list_str_free(column, 0);
+
+  /* Only one column should be read. */
+  if(p->zcol->next)
+    gal_tableintern_error_col_selection(p->inputname, p->cp.hdu, "more "
+                                        "than one column was selected by "
+                                        "the value given to `--column'. "
+                                        "Only one is acceptable.");
+  if(p->zcol->size==0)
+    error(EXIT_FAILURE, 0, "%s: the table has no rows", p->inputname);
+
+  /* Make sure it is a usable type and convert it to double. */
+  switch(p->zcol->type)
+    {
+    case GAL_TYPE_BIT:
+    case GAL_TYPE_STRLL:
+    case GAL_TYPE_STRING:
+    case GAL_TYPE_COMPLEX32:
+    case GAL_TYPE_COMPLEX64:
+      error(EXIT_FAILURE, 0, "the redshift column has a %s type, which is "
+            "not currently supported by %s",
+            gal_type_name(p->zcol->type, 1), PROGRAM_NAME);
+    }
+  p->zcol=gal_data_copy_to_new_type_free(p->zcol, GAL_TYPE_FLOAT64);
+
+  /* Redshifts can't be negative (blank values are NaN and pass). */
+  z=p->zcol->array;
+  for(i=0;i<p->zcol->size;++i)
+    if(z[i]<0)
+      error(EXIT_FAILURE, 0, "%s: the redshift in row %zu is negative "
+            "(%g)", p->inputname, i+1, z[i]);
 }
 
 
@@ -261,6 +393,10 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct cosmiccalparams *p)
     error(EXIT_FAILURE, errno, "parsing arguments");
 
 
+  /* In batch mode, the redshift must not be given on the command-line. */
+  ui_check_redshift_with_table(p);
+
+
   /* Read the configuration files and set the common values. */
   gal_options_read_config_set(&p->cp);
 
@@ -274,4 +410,15 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct cosmiccalparams *p)
      after the option checks so un-sane values are not printed in the
      output state. */
   gal_options_print_state(&p->cp);
+
+
+  /* Check that the options and arguments fit well with each other. Note
+     that arguments don't go in a configuration file. So this test should
+     be done after (possibly) printing the option values. */
+  ui_check_options_and_arguments(p);
+
+
+  /* Read the redshifts if an input table is given. */
+  if(p->inputname)
+    ui_read_redshifts(p);
 }
@@ -29,12 +29,13 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Available letters for short options:
 
-   b c d e f g i j k n p s t u w x y
+   b d e f g i j k n p s t u w x y
    A B C E G J L O Q R W X Y
 */
 enum option_keys_enum
 {
   /* With short-option version. */
+  UI_KEY_COLUMN         = 'c',
   UI_KEY_REDSHIFT       = 'z',
   UI_KEY_H0             = 'H',
   UI_KEY_OLAMBDA        = 'l',
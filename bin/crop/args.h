@@ -57,6 +57,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "wcstolerance",
+      UI_KEY_WCSTOLERANCE,
+      "FLT",
+      0,
+      "Max error (pixels) of approximate WCS conversion.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->wcstolerance,
+      GAL_TYPE_FLOAT64,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "zeroisnotblank",
       UI_KEY_ZEROISNOTBLANK,
@@ -101,6 +114,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "shards",
+      UI_KEY_SHARDS,
+      "INT",
+      0,
+      "Write crops as extensions of INT files.",
+      GAL_OPTIONS_GROUP_OUTPUT,
+      &p->shards,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
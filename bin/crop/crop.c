@@ -185,6 +185,70 @@ crop_write_to_log(struct onecropparams *crp)
 
 
 
+/* When the crop is complete, check its center, write the final keywords
+   and close it (if the center isn't filled, remove it). `pos' is the
+   position of this crop in the outputs when they are written as
+   extensions (see `gal_multiext_add'). */
+static void
+crop_finish_output(struct onecropparams *crp, size_t pos)
+{
+  int status=0;
+  char *extname;
+  struct cropparams *p=crp->p;
+
+  /* No input image overlapped with this crop. */
+  if(crp->numimg==0)
+    {
+      crp->centerfilled=0;
+      if(p->multiext) gal_multiext_add(p->multiext, pos, NULL, 0, NULL);
+      return;
+    }
+
+  /* Check if the center of the crop is filled or not (on the crop's
+     pixels that are still in memory), add the final headers and write the
+     pixels (only if the crop is to be kept). */
+  crp->centerfilled=iscenterfilled(crp);
+  gal_fits_key_write_version(crp->outfits, NULL, PROGRAM_STRING);
+  cropwrite(crp);
+
+  /* When crops are written as extensions, give the crop to the writer (if
+     it should be kept). Otherwise, close it and remove it if its center
+     wasn't filled. */
+  if(p->multiext)
+    {
+      if(crp->centerfilled==0)
+        {
+          if( fits_close_file(crp->outfits, &status) )
+            gal_fits_io_error(status, "CFITSIO could not close the "
+                              "opened file");
+          gal_multiext_add(p->multiext, pos, NULL, 0, NULL);
+        }
+      else
+        {
+          gal_checkset_allocate_copy(crp->name, &extname);
+          gal_multiext_add(p->multiext, pos, crp->outfits, crp->out_ind+1,
+                           extname);
+        }
+    }
+  else
+    {
+      if( fits_close_file(crp->outfits, &status) )
+        gal_fits_io_error(status, "CFITSIO could not close the "
+                          "opened file");
+      if(crp->centerfilled==0)
+        {
+          errno=0;
+          if(unlink(crp->name))
+            error(EXIT_FAILURE, errno, "can't delete %s (center "
+                  "was blank)", crp->name);
+        }
+    }
+}
+
+
+
+
+
 void *
 imgmodecrop(void *inparam)
 {
@@ -197,6 +261,8 @@ imgmodecrop(void *inparam)
 
   /* In image mode, we always only have one image. */
   crp->in_ind=0;
+  crp->outbuf=crp->inbuf=NULL;
+  crp->outbufsize=crp->inbufsize=0;
 
   /* The whole catalog is from one image, so you can get the
      information here:*/
@@ -212,43 +278,20 @@ imgmodecrop(void *inparam)
       crp->numimg=0;
       cropname(crp);
 
-      /* Crop the image. */
+      /* Crop the image and finish the output. */
       onecrop(crp);
-
-      /* Check the final output: */
-      if(crp->numimg)
-        {
-          /* Check if the center of the crop is filled or not. */
-          crp->centerfilled=iscenterfilled(crp);
-
-          /* Add the final headers and close output FITS image: */
-          gal_fits_key_write_version(crp->outfits, NULL, PROGRAM_STRING);
-          status=0;
-          if( fits_close_file(crp->outfits, &status) )
-            gal_fits_io_error(status, "CFITSIO could not close "
-                                   "the opened file");
-
-          /* Remove the output image if its center was not filled. */
-          if(crp->centerfilled==0)
-            {
-              errno=0;
-              if(unlink(crp->name))
-                error(EXIT_FAILURE, errno, "can't delete %s (center"
-                      "was blank)", crp->name);
-            }
-
-        }
-      else crp->centerfilled=0;
+      crop_finish_output(crp, crp->out_ind);
 
       /* Report the status on stdout if verbose mode is requested. */
       if(!p->cp.quiet) crop_verbose_info(crp);
       if(p->cp.log)    crop_write_to_log(crp);
     }
 
-  /* Close the input image. */
+  /* Close the input image and free the buffers. */
   status=0;
   if( fits_close_file(crp->infits, &status) )
     gal_fits_io_error(status, "could not close FITS file");
+  crop_buffers_free(crp);
 
   /* Wait until all other threads finish. */
   if(p->cp.numthreads>1)
@@ -261,90 +304,170 @@ imgmodecrop(void *inparam)
 
 
 
+/* In WCS mode, each thread keeps the last CROP_MAX_OPEN_INPUTS input
+   images that it has used open, so when consecutive crops use the same
+   image(s), they don't have to be opened (and their headers parsed)
+   again. When an image that isn't open is needed and the maximum is
+   reached, the least recently used image is closed. */
+static void
+crop_open_input(struct onecropparams *crp)
+{
+  int status=0;
+  size_t i, oldest=0;
+  struct cropparams *p=crp->p;
+  struct cropopeninput *open=crp->open;
+
+  /* See if the image is already open. */
+  for(i=0;i<crp->numopen;++i)
+    if(open[i].ind==crp->in_ind)
+      {
+        open[i].used=++crp->counter;
+        crp->infits=open[i].fptr;
+        return;
+      }
+
+  /* Find a place for it: if the maximum number of images are already
+     open, close the least recently used one. */
+  if(crp->numopen<CROP_MAX_OPEN_INPUTS)
+    i=crp->numopen++;
+  else
+    {
+      for(i=1;i<crp->numopen;++i)
+        if(open[i].used<open[oldest].used) oldest=i;
+      i=oldest;
+      if( fits_close_file(open[i].fptr, &status) )
+        gal_fits_io_error(status, "could not close FITS file");
+    }
+
+  /* Open the image. */
+  open[i].ind=crp->in_ind;
+  open[i].used=++crp->counter;
+  open[i].fptr=gal_fits_hdu_open_format(p->imgs[crp->in_ind].name,
+                                        p->cp.hdu, 0);
+  crp->infits=open[i].fptr;
+}
+
+
+
+
+
+/* Take the next group of targets (positions `*start' to `*end' in the
+   ordered list of targets, see `wcs_index_order_targets'). Targets with
+   the same first image are taken together, but to keep all the threads
+   busy, each group has at most a quarter of the targets in each thread.
+   When the crops are written as extensions, the writer can only keep a
+   few crops after the one it is waiting for, so the targets are taken
+   one by one. When there are no more targets, 0 is returned. */
+static int
+crop_next_targets(struct onecropparams *crp, size_t *start, size_t *end)
+{
+  size_t e;
+  struct cropparams *p=crp->p;
+  size_t max = ( p->multiext
+                 ? 1
+                 : p->numout/(4*p->cp.numthreads)+1 );
+
+  pthread_mutex_lock(&p->targetmutex);
+  *start=e=p->nexttarget;
+  if(e<p->numout)
+    {
+      do ++e;
+      while( e<p->numout && e-*start<max
+             && ( p->orderimg==NULL || p->orderimg[e]==p->orderimg[*start] ) );
+      p->nexttarget=e;
+    }
+  pthread_mutex_unlock(&p->targetmutex);
+
+  *end=e;
+  return *end > *start;
+}
+
+
+
+
+
 void *
 wcsmodecrop(void *inparam)
 {
   struct onecropparams *crp=(struct onecropparams *)inparam;
   struct cropparams *p=crp->p;
 
-  size_t i;
   int status;
+  size_t i, j, start, end;
 
 
-  /* Go over all the output objects for this thread. */
-  for(i=0; crp->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
-    {
-      /* Set all the output parameters: */
-      crp->out_ind=crp->indexs[i];
-      crp->outfits=NULL;
-      crp->name=NULL;
-      crp->numimg=0;
+  /* Allocate the space to keep the images that may overlap with each
+     target and initialize the open inputs. */
+  crp->cand=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numin);
+  crp->candmark=gal_data_calloc_array(GAL_TYPE_UINT8, p->numin);
+  crp->numopen=crp->counter=0;
+  crp->outbuf=crp->inbuf=NULL;
+  crp->outbufsize=crp->inbufsize=0;
 
 
-      /* Set the sides of the crop in RA and Dec */
-      setcsides(crp);
+  /* Go over the targets: unlike the Image mode, the targets aren't
+     distributed between the threads before hand (so `crp->indexs' isn't
+     used here). Each thread takes the next group of targets when it has
+     finished its previous group. */
+  while( crop_next_targets(crp, &start, &end) )
+    for(i=start;i<end;++i)
+      {
+        /* Set all the output parameters: */
+        crp->out_ind = p->order ? p->order[i] : i;
+        crp->outfits=NULL;
+        crp->name=NULL;
+        crp->numimg=0;
 
 
-      /* Go over all the images to see if this target is within their
-         range or not. */
-      crp->in_ind=0;
-      do
-        if(radecoverlap(crp))
-          {
-            /* Open the input FITS file. */
-            crp->infits=gal_fits_hdu_open_format(p->imgs[crp->in_ind].name,
-                                                 p->cp.hdu, 0);
+        /* Set the sides of the crop in RA and Dec */
+        setcsides(crp);
+
 
-            /* If a name isn't set yet, set it. */
-            if(crp->name==NULL) cropname(crp);
+        /* Go over the images that may overlap with this target (found
+           from the index of input footprints) to see if this target is
+           within their range or not. */
+        wcs_index_candidates(crp);
+        for(j=0;j<crp->numcand;++j)
+          {
+            crp->in_ind=crp->cand[j];
+            if(radecoverlap(crp))
+              {
+                /* Open the input FITS file (if it isn't already open). */
+                crop_open_input(crp);
 
-            /* Do the crop. */
-            onecrop(crp);
+                /* If a name isn't set yet, set it. */
+                if(crp->name==NULL) cropname(crp);
 
-            /* Close the file. */
-            status=0;
-            if( fits_close_file(crp->infits, &status) )
-              gal_fits_io_error(status, "could not close FITS file");
+                /* Do the crop. */
+                onecrop(crp);
+              }
           }
-      while ( ++(crp->in_ind) < p->numin );
 
-      /* Correct in_ind. The loop above went until `in_ind' is one more
-         than the index for the last input image (that is how it exited the
-         loop). But `crp->in_ind' is needed later, so correct it here. */
-      --crp->in_ind;
+        /* `crp->in_ind' is needed later (for the output name when no image
+           overlapped), so like checking all the images, it is set to the
+           last input image. */
+        crp->in_ind=p->numin-1;
 
-      /* Check the final output: */
-      if(crp->numimg)
-        {
-          crp->centerfilled=iscenterfilled(crp);
+        /* Finish the output (set the name if there was no overlap). */
+        if(crp->numimg==0) cropname(crp);
+        crop_finish_output(crp, crp->out_ind);
 
-          gal_fits_key_write_version(crp->outfits, NULL, PROGRAM_STRING);
-          status=0;
-          if( fits_close_file(crp->outfits, &status) )
-            gal_fits_io_error(status, "CFITSIO could not close the "
-                                     "opened file");
-
-          if(crp->centerfilled==0)
-            {
-              errno=0;
-              if(unlink(crp->name))
-                error(EXIT_FAILURE, errno, "%s", crp->name);
-            }
-        }
-      else
-        {
-          cropname(crp);
-          crp->centerfilled=0;
-        }
 
+        /* Report the status on stdout if verbose mode is requested. */
+        if(!p->cp.quiet) crop_verbose_info(crp);
+        if(p->cp.log)    crop_write_to_log(crp);
+      }
 
-
-      /* Report the status on stdout if verbose mode is requested. */
-      if(!p->cp.quiet) crop_verbose_info(crp);
-      if(p->cp.log)    crop_write_to_log(crp);
+  /* Clean up, wait until all other threads finish, then return. */
+  for(i=0;i<crp->numopen;++i)
+    {
+      status=0;
+      if( fits_close_file(crp->open[i].fptr, &status) )
+        gal_fits_io_error(status, "could not close FITS file");
     }
-
-  /* Wait until all other threads finish, then return. */
+  free(crp->cand);
+  free(crp->candmark);
+  crop_buffers_free(crp);
   if(p->cp.numthreads>1)
     pthread_barrier_wait(crp->b);
   return NULL;
@@ -385,6 +508,7 @@ crop(struct cropparams *p)
   pthread_attr_t attr;
   pthread_barrier_t b;
   struct onecropparams *crp;
+  char **shardnames;
   size_t i, *indexs, thrdcols;
   gal_list_str_t *comments=NULL;
   size_t nt=p->cp.numthreads, nb;
@@ -410,6 +534,41 @@ crop(struct cropparams *p)
                               &indexs, &thrdcols);
 
 
+  /* In WCS mode, the threads take the targets as they go. With a catalog
+     (and more than one input), the targets are ordered by the input
+     images they use, so the crops that use the same image(s) are made one
+     after the other (mostly on the same thread). When the crops are
+     written as extensions, the writer needs them in the order of the
+     catalog rows, so they aren't re-ordered. */
+  if(p->mode==IMGCROP_MODE_WCS)
+    {
+      p->nexttarget=0;
+      pthread_mutex_init(&p->targetmutex, NULL);
+      if(p->catname && p->numin>1 && p->shards==0)
+        wcs_index_order_targets(p);
+    }
+
+
+  /* If the crops should be written as extensions, start the writer. */
+  if(p->shards)
+    {
+      errno=0;
+      shardnames=malloc(p->shards*sizeof *shardnames);
+      if(shardnames==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+              "`shardnames'", __func__, p->shards*sizeof *shardnames);
+      for(i=0;i<p->shards;++i)
+        if(p->shards==1)
+          asprintf(&shardnames[i], "%sall%s", p->cp.output, p->suffix);
+        else
+          asprintf(&shardnames[i], "%sall%zu%s", p->cp.output, i+1,
+                   p->suffix);
+      p->multiext=gal_multiext_start(shardnames, p->shards, p->numout,
+                                     CROP_SHARD_WINDOW*nt,
+                                     p->cp.dontdelete);
+    }
+
+
   /* Run the job, if there is only one thread, don't go through the
      trouble of spinning off a thread! */
   if(nt==1)
@@ -448,6 +607,14 @@ crop(struct cropparams *p)
     }
 
 
+  /* Write the remaining crops and the index of the extensions. */
+  if(p->multiext)
+    {
+      gal_multiext_finish(p->multiext);
+      p->multiext=NULL;
+    }
+
+
   /* Print the log file. */
   if(p->cp.log)
     {
@@ -464,6 +631,12 @@ crop(struct cropparams *p)
 
   /* Print the final verbose info, save log, and clean up: */
   crop_verbose_final(p);
+  if(p->mode==IMGCROP_MODE_WCS)
+    {
+      pthread_mutex_destroy(&p->targetmutex);
+      free(p->orderimg);
+      free(p->order);
+    }
   free(indexs);
   free(crp);
 }
@@ -24,9 +24,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define MAIN_H
 
 /* Include necessary headers */
+#include <gnuastro/wcs.h>
 #include <gnuastro/data.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/options.h>
+#include <gnuastro-internal/multiext.h>
 
 /* Progarm names.  */
 #define PROGRAM_NAME   "Crop"     /* Program full name.       */
@@ -40,6 +43,9 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* Macros */
 #define LOGFILENAME             PROGRAM_EXEC".log"
 #define FILENAME_BUFFER_IN_VERB 30
+#define CROP_MAX_OPEN_INPUTS    8     /* Open inputs in each thread. */
+#define CROP_SHARD_WINDOW       4     /* Waiting crops per thread.   */
+#define CROP_BUFFER_KEEP  67108864    /* Max. bytes of kept buffers. */
 
 
 
@@ -70,6 +76,24 @@ struct inputimgs
   double      corners[8];  /* RA and Dec of this image corners (within).  */
   double        sized[2];  /* Width and height of image in degrees.       */
   double  equatorcorr[2];  /* If image crosses the equator, see wcsmode.c.*/
+  gal_wcs_fast_t *fastwcs; /* Approximate world to image conversion.     */
+  double          box[4];  /* Range of RA and Dec of footprint.           */
+};
+
+
+
+
+
+/* Grid over the RA and Dec of the input images' footprints to find the
+   images that may overlap with each crop (see wcsmode.c). */
+struct cropindex
+{
+  double          min[2];  /* Minimum RA and Dec of the grid.             */
+  double          max[2];  /* Maximum RA and Dec of the grid.             */
+  double        width[2];  /* Width of each cell in RA and Dec.           */
+  size_t       ncells[2];  /* Number of cells along RA and Dec.           */
+  size_t          *start;  /* Position of each cell's images in `imgs'.   */
+  size_t           *imgs;  /* Indexs of the images in each cell.          */
 };
 
 
@@ -84,9 +108,11 @@ struct cropparams
   struct gal_list_str_t       *inputs;  /* All input FITS files.          */
   size_t             hstartwcs;  /* Header keyword No. to start read WCS. */
   size_t               hendwcs;  /* Header keyword No. to end read WCS.   */
+  double          wcstolerance;  /* Max error (pixels) of fast WCS.       */
   uint8_t       zeroisnotblank;  /* ==1: In float or double, keep 0.0.    */
   uint8_t              noblank;  /* ==1: no blank (out of image) pixels.  */
   char                 *suffix;  /* Ending of output file name.           */
+  size_t                shards;  /* Number of files to keep all crops.    */
   size_t           checkcenter;  /* width of a box to check for zeros     */
   size_t              iwidthin;  /* Image mode width (in pixels).         */
   double                wwidth;  /* WCS mode width (in arcseconds).       */
@@ -123,6 +149,12 @@ struct cropparams
   int                     type;  /* Type of output(s).                    */
   void                 *bitnul;  /* Null value for this data-type.        */
   struct inputimgs       *imgs;  /* WCS and size information for inputs.  */
+  struct cropindex       index;  /* Index over the input footprints.      */
+  size_t                *order;  /* Order of targets (WCS mode).          */
+  size_t             *orderimg;  /* First image of each ordered target.   */
+  size_t            nexttarget;  /* Next target to crop (WCS mode).       */
+  pthread_mutex_t  targetmutex;  /* Mutex to take the next targets.       */
+  gal_multiext_t     *multiext;  /* Writer when crops are extensions.     */
   gal_data_t              *log;  /* Log file contents.                    */
 };
 
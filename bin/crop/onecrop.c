@@ -311,11 +311,7 @@ imgpolygonflpixel(double *ipolygon, size_t nvertices, long *fpixel,
 #define POLYGON_MASK(CTYPE) {                                           \
     CTYPE *ba=array, *bb=gal_blank_alloc_write(type);                   \
     for(i=0;i<size;++i)                                                 \
-      {                                                                 \
-        point[0]=i%s1+1; point[1]=i/s1+1;                               \
-        if(gal_polygon_pin(ipolygon, point, nvertices)==outpolygon)     \
-          ba[i]=*bb;                                                    \
-      }                                                                 \
+      if(mask[i]==outpolygon) ba[i]=*bb;                                \
     free(bb);                                                           \
   }
 
@@ -324,10 +320,12 @@ void
 polygonmask(struct onecropparams *crp, void *array, long *fpixel_i,
             size_t s0, size_t s1)
 {
+  uint8_t *mask;
+  double *ipolygon;
   int type=crp->p->type;
-  double *ipolygon, point[2];
   int outpolygon=crp->p->outpolygon;
-  size_t i, *ordinds, size=s0*s1, nvertices=crp->p->nvertices;
+  size_t i, *ordinds, dsize[2]={s0, s1}, size=s0*s1;
+  size_t nvertices=crp->p->nvertices;
 
 
   /* First of all, allocate enough space to put a copy of the input
@@ -341,19 +339,46 @@ polygonmask(struct onecropparams *crp, void *array, long *fpixel_i,
   if(ordinds==NULL)
     error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for ordinds",
           __func__, nvertices*sizeof *ordinds);
-
-
-  /* Find the order of the polygons and put the elements in the proper
-     order. Also subtract the fpixel_i coordinates from all the
-     vertices to bring them into the crop image coordinates.*/
-  gal_polygon_ordered_corners(crp->ipolygon, crp->p->nvertices, ordinds);
-  for(i=0;i<crp->p->nvertices;++i)
+  errno=0; mask=malloc(size*sizeof *mask);
+  if(mask==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for mask",
+          __func__, size*sizeof *mask);
+
+
+  /* Subtract the fpixel_i coordinates from all the vertices to bring
+     them into the crop image coordinates. If the vertices (in the given
+     order) don't make a convex polygon, but they do when sorted
+     anti-clockwise (the vertices of a convex polygon were given in
+     another order), use the sorted order. Otherwise, the given order is
+     used (so non-convex polygons can also be used). */
+  for(i=0;i<nvertices;++i)
+    {
+      ipolygon[i*2  ] = crp->ipolygon[i*2]   - fpixel_i[0];
+      ipolygon[i*2+1] = crp->ipolygon[i*2+1] - fpixel_i[1];
+    }
+  if( gal_polygon_is_convex(ipolygon, nvertices)==0
+      && nvertices<=GAL_POLYGON_MAX_CORNERS )
     {
-      ipolygon[i*2  ] = crp->ipolygon[ordinds[i]*2]   - fpixel_i[0];
-      ipolygon[i*2+1] = crp->ipolygon[ordinds[i]*2+1] - fpixel_i[1];
+      gal_polygon_ordered_corners(crp->ipolygon, nvertices, ordinds);
+      for(i=0;i<nvertices;++i)
+        {
+          ipolygon[i*2  ] = crp->ipolygon[ordinds[i]*2]   - fpixel_i[0];
+          ipolygon[i*2+1] = crp->ipolygon[ordinds[i]*2+1] - fpixel_i[1];
+        }
+      if( gal_polygon_is_convex(ipolygon, nvertices)==0 )
+        for(i=0;i<nvertices;++i)
+          {
+            ipolygon[i*2  ] = crp->ipolygon[i*2]   - fpixel_i[0];
+            ipolygon[i*2+1] = crp->ipolygon[i*2+1] - fpixel_i[1];
+          }
     }
 
 
+  /* Find the pixels that are inside the polygon (with a scan-line
+     rasterization, not checking every pixel against every edge). */
+  gal_polygon_fill(ipolygon, nvertices, dsize, mask);
+
+
   /* Go over all the pixels in the image and if they are within the
      polygon keep them if the user has asked for it.*/
   switch(type)
@@ -374,6 +399,7 @@ polygonmask(struct onecropparams *crp, void *array, long *fpixel_i,
     }
 
   /* Clean up: */
+  free(mask);
   free(ordinds);
   free(ipolygon);
 }
@@ -436,7 +462,7 @@ changezerotonan(void *array, size_t size, int type)
 void
 cropname(struct onecropparams *crp)
 {
-  char **strarr;
+  char **strarr, *outdir;
   struct cropparams *p=crp->p;
   struct gal_options_common_params *cp=&p->cp;
 
@@ -444,19 +470,22 @@ cropname(struct onecropparams *crp)
   if(p->catname)
     {
       /* If a name column was set, use it, otherwise, use the ID of the
-         profile. */
+         profile. When the crops are written as extensions, the name
+         (without the directory) is the extension name. */
+      outdir = p->multiext ? "" : cp->output;
       if(p->name)
         {
           strarr=p->name;
-          asprintf(&crp->name, "%s%s%s", cp->output, strarr[crp->out_ind],
+          asprintf(&crp->name, "%s%s%s", outdir, strarr[crp->out_ind],
                    p->suffix);
         }
       else
-        asprintf(&crp->name, "%s%zu%s", cp->output, crp->out_ind+1,
+        asprintf(&crp->name, "%s%zu%s", outdir, crp->out_ind+1,
                  p->suffix);
 
       /* Make sure the file doesn't exist. */
-      gal_checkset_check_remove_file(crp->name, 0, cp->dontdelete);
+      if(p->multiext==NULL)
+        gal_checkset_check_remove_file(crp->name, 0, cp->dontdelete);
     }
   else
     {
@@ -485,7 +514,7 @@ cropflpixel(struct onecropparams *crp)
   struct cropparams *p=crp->p;
   int ncoord=1, nelem=2, status[2]={0,0};
   size_t *dsize=p->imgs[crp->in_ind].dsize;
-  double pixcrd[2], imgcrd[2], phi[1], theta[1];
+  double pixcrd[2], imgcrd[2], phi[1], theta[1], *x, *y;
   long *fpixel=crp->fpixel, *lpixel=crp->lpixel;
 
   switch(p->mode)
@@ -521,6 +550,15 @@ cropflpixel(struct onecropparams *crp)
           if(p->outpolygon==0)
             imgpolygonflpixel(crp->ipolygon, p->nvertices, fpixel, lpixel);
         }
+      else if(p->imgs[crp->in_ind].fastwcs)
+        {
+          x=&pixcrd[0];
+          y=&pixcrd[1];
+          gal_wcs_fast_convert(p->imgs[crp->in_ind].fastwcs, &crp->world[0],
+                               &crp->world[1], &x, &y, 1, 1);
+          gal_box_border_from_center(pixcrd[0], pixcrd[1], p->iwidth, fpixel,
+                                     lpixel);
+        }
       else
         {
           if(wcss2p(p->imgs[crp->in_ind].wcs, ncoord, nelem, crp->world,
@@ -558,10 +596,69 @@ cropflpixel(struct onecropparams *crp)
 
 
 
+/* Each thread keeps its buffers (for the pixels of the crop and the
+   section read from each input) between crops, so they aren't allocated
+   for every crop. A buffer is only re-allocated when a larger one is
+   needed. To keep the memory used by each thread bounded, buffers larger
+   than `CROP_BUFFER_KEEP' bytes are freed after the crop is written (see
+   `cropwrite'). */
+static void *
+crop_buffer(void **buf, size_t *bufsize, uint8_t type, size_t size)
+{
+  size_t bytes=size*gal_type_sizeof(type);
+
+  if(bytes>*bufsize)
+    {
+      free(*buf);
+      *buf=gal_data_malloc_array(type, size);
+      *bufsize=bytes;
+    }
+  return *buf;
+}
+
+
+
+
+
+/* Free the buffers of this thread. When `all==0', only buffers larger
+   than `CROP_BUFFER_KEEP' are freed. */
+static void
+crop_buffers_trim(struct onecropparams *crp, int all)
+{
+  if(all || crp->outbufsize>CROP_BUFFER_KEEP)
+    {
+      free(crp->outbuf);
+      crp->outbuf=NULL;
+      crp->outbufsize=0;
+    }
+  if(all || crp->inbufsize>CROP_BUFFER_KEEP)
+    {
+      free(crp->inbuf);
+      crp->inbuf=NULL;
+      crp->inbufsize=0;
+    }
+}
+
+
+
+
+
+void
+crop_buffers_free(struct onecropparams *crp)
+{
+  crop_buffers_trim(crp, 1);
+}
+
+
+
+
+
 
 /* Find the size of the final FITS image (irrespective of how many
    crops will be needed for it) and make the image to keep the
-   data.
+   data. The pixels of the crop are kept in memory (in `crp->out') until
+   all the overlapping inputs have been used, then they are written once
+   (see `cropwrite').
 
    NOTE: The fpixel and lpixel in crp keep the first and last pixel of
    the total image for this crop, irrespective of the final keeping
@@ -575,6 +672,7 @@ firstcropmakearray(struct onecropparams *crp, long *fpixel_i,
   size_t i;
   fitsfile *ofp;
   long naxes[2];
+  size_t dsize[2];
   int type=crp->p->type;
   double crpix0, crpix1;
   int naxis=2, status=0;
@@ -605,18 +703,25 @@ firstcropmakearray(struct onecropparams *crp, long *fpixel_i,
     }
 
 
-  /* Create the FITS file with a blank first extension, then close it, so
-     with the next `fits_open_file', we build the image in the second
-     extension. This way, atleast for Gnuastro's outputs, we can
-     consistently use `-h1' (something like how you count columns, or
-     generally everything from 1). */
-  if(fits_create_file(&ofp, outname, &status))
-    gal_fits_io_error(status, "creating file");
-  fits_create_img(ofp, SHORT_IMG, 0, naxes, &status);
-  fits_close_file(ofp, &status);
+  /* Allocate the crop's pixels (in this thread's buffer) and initialize
+     them to blank. */
+  dsize[0]=naxes[1];
+  dsize[1]=naxes[0];
+  crp->out=gal_data_alloc(crop_buffer(&crp->outbuf, &crp->outbufsize, type,
+                                      dsize[0]*dsize[1]),
+                          type, 2, dsize, NULL, 0, crp->p->cp.minmapsize,
+                          NULL, NULL, NULL);
+  gal_blank_initialize(crp->out);
+
+
+  /* Create the FITS file with a blank first extension, so we build the
+     image in the second extension. This way, atleast for Gnuastro's
+     outputs, we can consistently use `-h1' (something like how you count
+     columns, or generally everything from 1). When the crops are written
+     as extensions of one file, each crop is first built in memory. */
+  crp->outfits=gal_fits_open_to_write(crp->p->multiext ? "mem://" : outname);
 
   /* Create the output crop image. */
-  fits_open_file(&crp->outfits, outname, READWRITE, &status);
   fits_create_img(crp->outfits, gal_fits_type_to_bitpix(type),
                   naxis, naxes, &status);
   gal_fits_io_error(status, "creating image");
@@ -638,8 +743,6 @@ firstcropmakearray(struct onecropparams *crp, long *fpixel_i,
     if(fits_write_key(ofp, gal_fits_type_to_datatype(crp->p->type), "BLANK",
                       crp->p->bitnul, "pixels with no data", &status) )
       gal_fits_io_error(status, "adding Blank");
-  if(fits_write_null_img(ofp, 1, naxes[0]*naxes[1], &status))
-    gal_fits_io_error(status, "writing null array");
 
 
   /* Write the WCS header keywords in the output FITS image, then
@@ -690,10 +793,11 @@ onecrop(struct onecropparams *crp)
   struct inputimgs *img=&p->imgs[crp->in_ind];
 
   void *array;
-  size_t cropsize;
+  long j, width;
+  size_t cropsize, sizeoftype=gal_type_sizeof(p->type);
   int status=0, anynul=0;
   char basename[FLEN_KEYWORD];
-  fitsfile *ifp=crp->infits, *ofp;
+  fitsfile *ifp=crp->infits;
   gal_fits_list_key_t *headers=NULL;
   long fpixel_o[2], lpixel_o[2], inc[2]={1,1};
   char region[FLEN_VALUE], regionkey[FLEN_KEYWORD];
@@ -711,19 +815,17 @@ onecrop(struct onecropparams *crp)
   /* Find the overlap and apply it if there is any overlap. */
   if( gal_box_overlap(naxes, fpixel_i, lpixel_i, fpixel_o, lpixel_o) )
     {
-      /* Make the output FITS image and initialize it with an array of
-         NaN or BLANK values. Note that for FLOAT_IMG and DOUBLE_IMG,
-         it will automatically fill them with the NaN value.*/
+      /* Make the output FITS image and the crop's array (initialized
+         with blank values), if this is the first input for this crop. */
       if(crp->outfits==NULL)
         firstcropmakearray(crp, fpixel_i, lpixel_i, fpixel_o, lpixel_o);
-      ofp=crp->outfits;
 
 
       /* Read the desired part of the image, then write it into this
          array. */
       status=0;
       cropsize=(lpixel_i[0]-fpixel_i[0]+1)*(lpixel_i[1]-fpixel_i[1]+1);
-      array=gal_data_malloc_array(p->type, cropsize);
+      array=crop_buffer(&crp->inbuf, &crp->inbufsize, p->type, cropsize);
       if(fits_read_subset(ifp, gal_fits_type_to_datatype(p->type),
                           fpixel_i, lpixel_i, inc, p->bitnul, array,
                           &anynul, &status))
@@ -751,11 +853,14 @@ onecrop(struct onecropparams *crp)
         }
 
 
-      /* Write the array into the image. */
-      status=0;
-      if( fits_write_subset(ofp, gal_fits_type_to_datatype(p->type),
-                            fpixel_o, lpixel_o, array, &status) )
-        gal_fits_io_error(status, NULL);
+      /* Copy the section into the crop's pixels (row by row). */
+      width=lpixel_o[0]-fpixel_o[0]+1;
+      for(j=fpixel_o[1]-1;j<lpixel_o[1];++j)
+        memcpy(gal_data_ptr_increment(crp->out->array,
+                                      j*crp->out->dsize[1]+fpixel_o[0]-1,
+                                      p->type),
+               (char *)array + (j-fpixel_o[1]+1)*width*sizeoftype,
+               width*sizeoftype);
 
 
       /* A section has been added to the cropped image from this input
@@ -769,10 +874,7 @@ onecrop(struct onecropparams *crp)
       gal_fits_key_list_add_end(&headers, GAL_TYPE_STRING, regionkey,
                                 0, region, 0, "Range of pixels used for "
                                 "this output.", 0, NULL);
-      gal_fits_key_write(ofp, &headers);
-
-      /* Free the allocated array. */
-      free(array);
+      gal_fits_key_write(crp->outfits, &headers);
     }
   else
     if(p->polygon && p->outpolygon==0 && p->mode==IMGCROP_MODE_WCS)
@@ -809,48 +911,76 @@ iscenterfilled(struct onecropparams *crp)
 {
   struct cropparams *p=crp->p;
 
-  void *array;
-  size_t size, ndim, *dsize;
-  fitsfile *ofp=crp->outfits;
-  int status=0, anynul=0, type;
+  int filled;
+  gal_data_t *tile;
+  size_t tsize[2];
   long checkcenter=p->checkcenter;
-  long naxes[2], fpixel[2], lpixel[2], inc[2]={1,1};
+  long naxes[2], fpixel[2], lpixel[2];
 
   /* If checkcenter is zero, then don't check. */
   if(checkcenter==0) return GAL_BLANK_UINT8;
 
   /* Get the final size of the output image. */
-  gal_fits_img_info(ofp, &type, &ndim, &dsize);
-  naxes[0]=dsize[1];
-  naxes[1]=dsize[0];
-
-  /* Get the size and range of the central region to check. The +1 is
-     because in FITS, counting begins from 1, not zero. It might happen
-     that the image is actually smaller than the width to check the center
-     (for example 1 or 2 pixels wide). In that case, we'll just use the
-     full image to check. */
-  size = ( (naxes[0]>checkcenter ? checkcenter : naxes[0])
-           * (naxes[1]>checkcenter ? checkcenter : naxes[1]) );
+  naxes[0]=crp->out->dsize[1];
+  naxes[1]=crp->out->dsize[0];
+
+  /* Get the range of the central region to check. The +1 is because in
+     FITS, counting begins from 1, not zero. It might happen that the image
+     is actually smaller than the width to check the center (for example 1
+     or 2 pixels wide). In that case, we'll just use the full image to
+     check. */
   fpixel[0] = naxes[0]>checkcenter ? (naxes[0]/2+1)-checkcenter/2 : 1;
   fpixel[1] = naxes[1]>checkcenter ? (naxes[1]/2+1)-checkcenter/2 : 1;
   lpixel[0] = naxes[0]>checkcenter ? (naxes[0]/2+1)+checkcenter/2 : naxes[0];
   lpixel[1] = naxes[1]>checkcenter ? (naxes[1]/2+1)+checkcenter/2 : naxes[1];
 
   /* For a check:
-  printf("naxes: %ld, %ld\nfpixel: (%ld, %ld)\nlpixel: (%ld, %ld)\n"
-         "size: %zu\n", naxes[0], naxes[1], fpixel[0], fpixel[1],
-         lpixel[0], lpixel[1], size);
+  printf("naxes: %ld, %ld\nfpixel: (%ld, %ld)\nlpixel: (%ld, %ld)\n",
+         naxes[0], naxes[1], fpixel[0], fpixel[1], lpixel[0], lpixel[1]);
   */
 
-  /* Allocate the array and read in the pixels. */
-  array=gal_data_malloc_array(type, size);
-  if( fits_read_subset(ofp, gal_fits_type_to_datatype(type), fpixel, lpixel,
-                       inc, p->bitnul, array, &anynul, &status) )
-    gal_fits_io_error(status, NULL);
-  free(array);
+  /* The crop's pixels are still in memory, so define the central region
+     as a tile over them and check it for blank values. */
+  tsize[0]=lpixel[1]-fpixel[1]+1;
+  tsize[1]=lpixel[0]-fpixel[0]+1;
+  tile=gal_data_alloc(gal_data_ptr_increment(crp->out->array,
+                                             (fpixel[1]-1)*naxes[0]
+                                             + fpixel[0]-1,
+                                             crp->out->type),
+                      crp->out->type, 2, tsize, NULL, 0, p->cp.minmapsize,
+                      NULL, NULL, NULL);
+  tile->block=crp->out;
+  filled = !gal_blank_present(tile, 0);
+
+  /* Clean up (the tile's array belongs to the crop) and return. */
+  tile->array=NULL;
+  gal_data_free(tile);
+  return filled;
+}
+
+
+
+
+
+/* Write the crop's pixels into the output (only if the crop is to be
+   kept, see `iscenterfilled'), then free the crop's dataset. The crop's
+   array is this thread's buffer, so it isn't freed here (unless it is
+   larger than `CROP_BUFFER_KEEP'). */
+void
+cropwrite(struct onecropparams *crp)
+{
+  int status=0;
+
+  /* Write the pixels. */
+  if(crp->centerfilled)
+    if( fits_write_img(crp->outfits,
+                       gal_fits_type_to_datatype(crp->out->type), 1,
+                       crp->out->size, crp->out->array, &status) )
+      gal_fits_io_error(status, NULL);
 
-  /* CFITSIO already checks if there are any blank pixels. If there are,
-     then `anynul' will be 1, if there aren't it will be 0. So the output
-     of this function is just the inverse of that number. */
-  return !anynul;
+  /* Clean up. */
+  crp->out->array=NULL;
+  gal_data_free(crp->out);
+  crop_buffers_trim(crp, 0);
+  crp->out=NULL;
 }
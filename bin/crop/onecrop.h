@@ -25,8 +25,17 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <fitsio.h>
 
+#include <gnuastro/data.h>
 #include <gnuastro/threads.h>
 
+/* An open input image (see `crop_open_input'). */
+struct cropopeninput
+{
+  size_t             ind;  /* Index of this image in the inputs.       */
+  size_t            used;  /* When this image was last used.           */
+  fitsfile         *fptr;  /* Pointer to the open input.               */
+};
+
 struct onecropparams
 {
   void *array;
@@ -40,6 +49,12 @@ struct onecropparams
   long         fpixel[2];  /* Position of first pixel in input image.  */
   long         lpixel[2];  /* Position of last pixel in input image.   */
   double       *ipolygon;  /* Input image based polygon vertices.      */
+  size_t           *cand;  /* Images that may overlap (WCS mode).      */
+  size_t         numcand;  /* Number of elements in `cand'.            */
+  uint8_t      *candmark;  /* ==1: Image is already in `cand'.         */
+  size_t         numopen;  /* Number of open inputs in `open'.         */
+  size_t         counter;  /* Counter to find the least recently used. */
+  struct cropopeninput open[CROP_MAX_OPEN_INPUTS]; /* Open inputs.      */
 
   /* Output (cropped) image. */
   size_t         out_ind;  /* Index of this crop in the output list.   */
@@ -48,6 +63,13 @@ struct onecropparams
   double      corners[8];  /* RA and Dec of this crop's four sides.    */
   double  equatorcorr[2];  /* Crop crosses the equator, see wcsmode.c. */
   fitsfile      *outfits;  /* Pointer to the output FITS image.        */
+  gal_data_t         *out;  /* Crop's pixels (until it is complete).    */
+
+  /* Buffers kept between crops (see `crop_buffer'). */
+  void           *outbuf;  /* Buffer for the crop's pixels.            */
+  size_t      outbufsize;  /* Size of `outbuf' in bytes.               */
+  void            *inbuf;  /* Buffer for the section of one input.     */
+  size_t       inbufsize;  /* Size of `inbuf' in bytes.                */
 
   /* For log */
   char             *name;  /* Filename of crop.                        */
@@ -74,6 +96,12 @@ onecrop(struct onecropparams *crp);
 int
 iscenterfilled(struct onecropparams *crp);
 
+void
+cropwrite(struct onecropparams *crp);
+
+void
+crop_buffers_free(struct onecropparams *crp);
+
 void
 crop_print_log(struct onecropparams *p);
 
@@ -448,6 +448,11 @@ ui_check_options_and_arguments(struct cropparams *p)
     }
   else
     {
+      /* Writing crops as extensions is only for catalogs. */
+      if(p->shards)
+        error(EXIT_FAILURE, 0, "`--shards' is only relevant when a "
+              "catalog is given (many crops are to be made)");
+
       p->cp.numthreads=1;
       p->outnameisfile=gal_checkset_dir_0_file_1(p->cp.output,
                                                  p->cp.dontdelete);
@@ -495,7 +500,8 @@ ui_read_cols(struct cropparams *p)
 
   /* Read the desired columns from the file. */
   cols=gal_table_read(p->catname, p->cathdu, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads, p->cp.minmapsize,
+                      NULL);
 
   /* Set the number of objects. */
   p->numout=cols->size;
@@ -678,6 +684,7 @@ ui_preparations(struct cropparams *p)
       img->name=gal_list_str_pop(&p->inputs);
       tmpfits=gal_fits_hdu_open_format(img->name, p->cp.hdu, 0);
       gal_fits_img_info(tmpfits, &p->type, &img->ndim, &img->dsize);
+      img->fastwcs=NULL;
       img->wcs=gal_wcs_read_fitsptr(tmpfits, p->hstartwcs, p->hendwcs,
                                     &img->nwcs);
       if(img->wcs)
@@ -725,6 +732,10 @@ ui_preparations(struct cropparams *p)
     }
 
 
+  /* In WCS mode, build the index over the footprints of the inputs. */
+  if(p->mode==IMGCROP_MODE_WCS) wcs_index_make(p);
+
+
   /* Report timing: */
   if(!p->cp.quiet)
     {
@@ -860,6 +871,13 @@ ui_free_report(struct cropparams *p, struct timeval *t1)
   /* Free the log information. */
   if(p->cp.log) gal_list_data_free(p->log);
 
+  /* Free the fast WCS conversion structures and the index. */
+  if(p->imgs)
+    for(i=0;i<p->numin;++i)
+      gal_wcs_fast_free(p->imgs[i].fastwcs);
+  free(p->index.start);
+  free(p->index.imgs);
+
   /* Print the final message. */
   if(!p->cp.quiet)
     gal_timing_report(t1, PROGRAM_NAME" finished in: ", 0);
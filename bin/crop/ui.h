@@ -61,6 +61,8 @@ enum option_keys_enum
   UI_KEY_HSTARTWCS,
   UI_KEY_HENDWCS,
   UI_KEY_OUTPOLYGON,
+  UI_KEY_WCSTOLERANCE,
+  UI_KEY_SHARDS,
 };
 
 
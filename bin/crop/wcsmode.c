@@ -50,10 +50,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 void
 wcs_check_prepare(struct cropparams *p, struct inputimgs *img)
 {
-  double twidth, *pixscale;
+  size_t i;
   struct wcsprm *wcs=img->wcs;
-  int i, status[4]={0,0,0,0}, ncoord=4, nelem=2;
-  double imgcrd[8], phi[4], theta[4], pixcrd[8];
+  double r, maxdec, range[4], twidth, *pixscale;
+  double x[4], y[4], ra[4], dec[4], *rap=ra, *decp=dec;
 
 
   /* Check if the image is aligned with the WCS coordinates. Note that
@@ -130,18 +130,23 @@ wcs_check_prepare(struct cropparams *p, struct inputimgs *img)
 
   /* Get the coordinates of the first pixel in the image. Note that `dsize'
      is in C axises, while pixcrd is in FITS axises. */
-  pixcrd[0]=1;               pixcrd[1]=1;
-  pixcrd[2]=img->dsize[1];   pixcrd[3]=1;
-  pixcrd[4]=1;               pixcrd[5]=img->dsize[0];
-  pixcrd[6]=img->dsize[1];   pixcrd[7]=img->dsize[0];
-  wcsp2s(wcs, ncoord, nelem, pixcrd, imgcrd, phi, theta,
-         img->corners, status);
-
-  /* Check if there was no error in the conversion. */
+  x[0]=1;                y[0]=1;
+  x[1]=img->dsize[1];    y[1]=1;
+  x[2]=1;                y[2]=img->dsize[0];
+  x[3]=img->dsize[1];    y[3]=img->dsize[0];
+  gal_wcs_img_to_world(wcs, x, y, &rap, &decp, 4, 1);
+
+  /* Check if there was no error in the conversion (the coordinates that
+     couldn't be converted are NaN) and put them in the corners array. */
   for(i=0;i<4;++i)
-    if(status[i])
-      error(EXIT_FAILURE, 0, "wcsp2s ERROR %d in row %d of pixcrd: %s",
-            i, status[i], wcs_errmsg[status[i]]);
+    {
+      if( isnan(ra[i]) || isnan(dec[i]) )
+        error(EXIT_FAILURE, 0, "%s: HDU %s: WCSLIB could not convert the "
+              "pixel (%g, %g) into world coordinates", img->name,
+              p->cp.hdu, x[i], y[i]);
+      img->corners[i*2]   = ra[i];
+      img->corners[i*2+1] = dec[i];
+    }
 
 
   /* Fill in the size of the image in celestial degrees from the first
@@ -165,6 +170,41 @@ wcs_check_prepare(struct cropparams *p, struct inputimgs *img)
     }
 
 
+  /* If requested, prepare the fast (approximate) conversion from world
+     to image coordinates. Crops can be centered outside the image, so the
+     region covers the image with a margin of one crop width. */
+  if(p->wcstolerance>0.0)
+    {
+      /* Range of the corners, keeping RA continuous. */
+      range[0]=range[1]=img->corners[0];
+      range[2]=range[3]=img->corners[1];
+      for(i=1;i<4;++i)
+        {
+          r=img->corners[i*2];
+          if(r-img->corners[0] >  180.0) r-=360.0;
+          if(r-img->corners[0] < -180.0) r+=360.0;
+          if(r<range[0]) range[0]=r;
+          if(r>range[1]) range[1]=r;
+          if(img->corners[i*2+1]<range[2]) range[2]=img->corners[i*2+1];
+          if(img->corners[i*2+1]>range[3]) range[3]=img->corners[i*2+1];
+        }
+
+      /* Add the margin (the RA width changes with declination). Close to
+         the poles, the exact conversion will be used. */
+      range[2]-=p->wwidth;
+      range[3]+=p->wwidth;
+      if(range[2]>-90.0 && range[3]<90.0)
+        {
+          maxdec=fabs(range[2])>fabs(range[3])?fabs(range[2]):fabs(range[3]);
+          r=p->wwidth/cos(maxdec*M_PI/180);
+          range[0]-=r;
+          range[1]+=r;
+          img->fastwcs=gal_wcs_fast_make(wcs, range, 0, p->wcstolerance,
+                                         p->cp.numthreads);
+        }
+    }
+
+
   /* Just to check:
   printf("\n\n%s:\n(%.10f, %.10f)\n(%.10f, %.10f)"
          "\n(%.10f, %.10f)\n(%.10f, %.10f)\n\n", img->name,
@@ -317,8 +357,12 @@ fillcrpipolygon(struct onecropparams *crp)
     }
 
   /* Convert them to image coordinates. */
-  gal_wcs_world_to_img(p->imgs[crp->in_ind].wcs, ra, dec, &x, &y,
-                       p->nvertices);
+  if(p->imgs[crp->in_ind].fastwcs)
+    gal_wcs_fast_convert(p->imgs[crp->in_ind].fastwcs, ra, dec, &x, &y,
+                         p->nvertices, 1);
+  else
+    gal_wcs_world_to_img(p->imgs[crp->in_ind].wcs, ra, dec, &x, &y,
+                         p->nvertices, 1);
 
   /* Put them in the image polygon vertice array. */
   for(i=0;i<p->nvertices;++i)
@@ -523,3 +567,354 @@ radecoverlap(struct onecropparams *crp)
 
   return 0;
 }
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/*******************************************************************/
+/************      Index of the input footprints      **************/
+/*******************************************************************/
+/* With many input images and many targets, checking every target against
+   every image with `radecoverlap' can be very slow. So a grid is defined
+   over the RA and Dec of the input footprints once (when reading the
+   inputs): each cell keeps the images whose footprint box (see
+   `wcs_footprint_box') touches it. For each target, only the images in
+   the cells that its own footprint box touches need to be checked with
+   `radecoverlap'. */
+
+/* Find the range of RA and Dec that contains the four corners of a region
+   and all the points that `radecinimg' accepts for it (`i', `s' and `c'
+   are the same as `radecinimg'). Therefore when two regions overlap (as
+   defined by `radecoverlap'), their boxes also overlap. The box is
+   written into `box' as: minimum RA, maximum RA, minimum Dec, maximum
+   Dec. */
+static void
+wcs_footprint_box(double *i, double *s, double *c, double *box)
+{
+  size_t k;
+  double n, cs, lo, hi, top=i[1]+s[1];
+
+  /* Range of the corners. */
+  box[0]=box[2]=DBL_MAX;
+  box[1]=box[3]=-DBL_MAX;
+  for(k=0;k<4;++k)
+    {
+      if(i[k*2]   < box[0]) box[0]=i[k*2];
+      if(i[k*2]   > box[1]) box[1]=i[k*2];
+      if(i[k*2+1] < box[2]) box[2]=i[k*2+1];
+      if(i[k*2+1] > box[3]) box[3]=i[k*2+1];
+    }
+
+  /* The accepted declinations. */
+  if(i[1] < box[2]) box[2]=i[1];
+  if(top  > box[3]) box[3]=top;
+
+  /* In the southern hemisphere the accepted RA range becomes narrower,
+     so it is within the range of the bottom edge. */
+  if(i[0]-s[0] < box[0]) box[0]=i[0]-s[0];
+  if(i[0]      > box[1]) box[1]=i[0];
+
+  /* In the northern hemisphere, the accepted RA range becomes wider with
+     distance from the bottom edge (or the equator when the region crosses
+     it), so it is widest at the top. */
+  if(top>0)
+    {
+      if( i[1]*top > 0 )
+        {
+          cs = cos(s[1]*M_PI/180);
+          n  = cs>0 ? 0.5f*s[0]*(1/cs-1) : INFINITY;
+          lo = i[0]-s[0]-n;
+          hi = i[0]+n;
+        }
+      else
+        {
+          cs = cos(top*M_PI/180);
+          n  = cs>0 ? 0.5f*c[1]*(1/cs-1) : INFINITY;
+          lo = c[0]-c[1]-n;
+          hi = c[0]+n;
+        }
+      if(lo<box[0]) box[0]=lo;
+      if(hi>box[1]) box[1]=hi;
+    }
+
+  /* Add a small margin for floating point errors. If anything couldn't be
+     calculated, the box is the full sky. */
+  for(k=0;k<4;++k)
+    {
+      if( isnan(box[k]) )
+        {
+          box[0]=box[2]=-INFINITY;
+          box[1]=box[3]=INFINITY;
+          break;
+        }
+      box[k] += k%2 ? 1e-8 : -1e-8;
+    }
+}
+
+
+
+
+
+/* Convert a coordinate to a cell along one axis of the index. */
+static size_t
+wcs_index_cell(struct cropindex *index, double v, size_t dim)
+{
+  double c=(v-index->min[dim])/index->width[dim];
+
+  if( c<=0.0f || isnan(c) ) return 0;
+  if( c>=index->ncells[dim] ) return index->ncells[dim]-1;
+  return c;
+}
+
+
+
+
+
+/* Find the range of cells that a box covers. If it is completely outside
+   the index, 0 is returned. */
+static int
+wcs_index_cell_range(struct cropindex *index, double *box, size_t *start,
+                     size_t *end)
+{
+  /* Check if the box overlaps with the index. */
+  if( box[1] < index->min[0] || box[0] > index->max[0]
+      || box[3] < index->min[1] || box[2] > index->max[1] )
+    return 0;
+
+  /* Find the range (`end' is exclusive). */
+  start[0] = wcs_index_cell(index, box[0], 0);
+  start[1] = wcs_index_cell(index, box[2], 1);
+  end[0]   = wcs_index_cell(index, box[1], 0) + 1;
+  end[1]   = wcs_index_cell(index, box[3], 1) + 1;
+  return 1;
+}
+
+
+
+
+
+/* Build the index over the input images. */
+void
+wcs_index_make(struct cropparams *p)
+{
+  double *box;
+  struct inputimgs *img;
+  struct cropindex *index=&p->index;
+  size_t i, x, y, n, cell, start[2], end[2], *counts;
+
+  /* Find the box of each image and the range of the finite box edges. */
+  index->min[0]=index->min[1]=DBL_MAX;
+  index->max[0]=index->max[1]=-DBL_MAX;
+  for(i=0;i<p->numin;++i)
+    {
+      img=&p->imgs[i];
+      box=img->box;
+      wcs_footprint_box(img->corners, img->sized, img->equatorcorr, box);
+      if( isfinite(box[0]) && box[0]<index->min[0] ) index->min[0]=box[0];
+      if( isfinite(box[1]) && box[1]>index->max[0] ) index->max[0]=box[1];
+      if( isfinite(box[2]) && box[2]<index->min[1] ) index->min[1]=box[2];
+      if( isfinite(box[3]) && box[3]>index->max[1] ) index->max[1]=box[3];
+    }
+
+  /* Set the cells: roughly one image per cell when the images are
+     distributed uniformly. */
+  n=ceil(sqrt(p->numin));
+  for(i=0;i<2;++i)
+    {
+      if(index->max[i]<=index->min[i])
+        {
+          index->min[i]=-INFINITY;
+          index->max[i]=INFINITY;
+          index->ncells[i]=1;
+          index->width[i]=INFINITY;
+        }
+      else
+        {
+          index->ncells[i]=n;
+          index->width[i]=(index->max[i]-index->min[i])/n;
+        }
+    }
+
+  /* Count the number of images in each cell (images with an infinite box
+     are put in all the cells). */
+  n=index->ncells[0]*index->ncells[1];
+  counts=gal_data_calloc_array(GAL_TYPE_SIZE_T, n);
+  for(i=0;i<p->numin;++i)
+    if( wcs_index_cell_range(index, p->imgs[i].box, start, end) )
+      for(y=start[1];y<end[1];++y)
+        for(x=start[0];x<end[0];++x)
+          ++counts[ y*index->ncells[0]+x ];
+
+  /* Set the starting position of each cell in the array of images. */
+  index->start=gal_data_malloc_array(GAL_TYPE_SIZE_T, n+1);
+  index->start[0]=0;
+  for(cell=0;cell<n;++cell)
+    index->start[cell+1]=index->start[cell]+counts[cell];
+
+  /* Put the images in the cells (in increasing order within each
+     cell). */
+  index->imgs=gal_data_malloc_array(GAL_TYPE_SIZE_T, index->start[n]+1);
+  for(cell=0;cell<n;++cell) counts[cell]=0;
+  for(i=0;i<p->numin;++i)
+    if( wcs_index_cell_range(index, p->imgs[i].box, start, end) )
+      for(y=start[1];y<end[1];++y)
+        for(x=start[0];x<end[0];++x)
+          {
+            cell=y*index->ncells[0]+x;
+            index->imgs[ index->start[cell] + counts[cell]++ ] = i;
+          }
+
+  /* Clean up. */
+  free(counts);
+}
+
+
+
+
+
+static int
+wcs_index_sizet_increasing(const void *a, const void *b)
+{
+  size_t ta=*(size_t *)a, tb=*(size_t *)b;
+  return ta<tb ? -1 : (ta>tb ? 1 : 0);
+}
+
+
+
+
+
+/* Find the input images that may overlap with the crop (its corners must
+   already be set with `setcsides'). They are put in `crp->cand' in
+   increasing order, so the crop is made with the same order of images as
+   when checking all of them. */
+void
+wcs_index_candidates(struct onecropparams *crp)
+{
+  double box[4], *ibox;
+  struct cropparams *p=crp->p;
+  struct cropindex *index=&p->index;
+  size_t i, j, x, y, cell, start[2], end[2];
+
+  /* Find the range of cells that this crop covers. */
+  crp->numcand=0;
+  wcs_footprint_box(crp->corners, crp->sized, crp->equatorcorr, box);
+  if( wcs_index_cell_range(index, box, start, end)==0 ) return;
+
+  /* Add the images whose box overlaps with the crop's box (an image may
+     be in many cells, so they are marked). */
+  for(y=start[1];y<end[1];++y)
+    for(x=start[0];x<end[0];++x)
+      {
+        cell=y*index->ncells[0]+x;
+        for(j=index->start[cell]; j<index->start[cell+1]; ++j)
+          {
+            i=index->imgs[j];
+            ibox=p->imgs[i].box;
+            if( crp->candmark[i]==0
+                && ibox[1]>=box[0] && ibox[0]<=box[1]
+                && ibox[3]>=box[2] && ibox[2]<=box[3] )
+              {
+                crp->candmark[i]=1;
+                crp->cand[crp->numcand++]=i;
+              }
+          }
+      }
+
+  /* Sort the candidates and remove the marks. */
+  qsort(crp->cand, crp->numcand, sizeof *crp->cand,
+        wcs_index_sizet_increasing);
+  for(i=0;i<crp->numcand;++i) crp->candmark[crp->cand[i]]=0;
+}
+
+
+
+
+
+/* For sorting the targets by the first image they overlap with. */
+struct wcsorder
+{
+  size_t key;
+  size_t ind;
+};
+
+static int
+wcs_order_increasing(const void *a, const void *b)
+{
+  struct wcsorder *ta=(struct wcsorder *)a, *tb=(struct wcsorder *)b;
+  if(ta->key!=tb->key) return ta->key<tb->key ? -1 : 1;
+  return ta->ind<tb->ind ? -1 : (ta->ind>tb->ind ? 1 : 0);
+}
+
+
+
+
+
+/* Order the targets (rows of the catalog) by the first input image that
+   they overlap with (targets that don't overlap with any image are put
+   at the end, with an image index of `p->numin'). So the crops that use
+   the same image(s) are made one after the other. `p->order' will keep
+   the index of the target in each position and `p->orderimg' its first
+   image. */
+void
+wcs_index_order_targets(struct cropparams *p)
+{
+  size_t i, j;
+  struct wcsorder *keys;
+  struct onecropparams crp;
+
+  /* Allocate the necessary arrays. */
+  errno=0;
+  keys=malloc(p->numout*sizeof *keys);
+  if(keys==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `keys'",
+          __func__, p->numout*sizeof *keys);
+  crp.p=p;
+  crp.cand=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numin);
+  crp.candmark=gal_data_calloc_array(GAL_TYPE_UINT8, p->numin);
+
+  /* Find the first image of each target. */
+  for(i=0;i<p->numout;++i)
+    {
+      crp.out_ind=i;
+      setcsides(&crp);
+      wcs_index_candidates(&crp);
+      keys[i].ind=i;
+      keys[i].key=p->numin;
+      for(j=0;j<crp.numcand;++j)
+        {
+          crp.in_ind=crp.cand[j];
+          if( radecoverlap(&crp) ) { keys[i].key=crp.in_ind; break; }
+        }
+    }
+
+  /* Sort the targets and keep their order. */
+  qsort(keys, p->numout, sizeof *keys, wcs_order_increasing);
+  p->order=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numout);
+  p->orderimg=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->numout);
+  for(i=0;i<p->numout;++i)
+    {
+      p->order[i]=keys[i].ind;
+      p->orderimg[i]=keys[i].key;
+    }
+
+  /* Clean up. */
+  free(keys);
+  free(crp.cand);
+  free(crp.candmark);
+}
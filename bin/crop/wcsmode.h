@@ -35,4 +35,13 @@ fillcrpipolygon(struct onecropparams *crp);
 int
 radecoverlap(struct onecropparams *crp);
 
+void
+wcs_index_make(struct cropparams *p);
+
+void
+wcs_index_candidates(struct onecropparams *crp);
+
+void
+wcs_index_order_targets(struct cropparams *p);
+
 #endif
@@ -558,36 +558,37 @@ mkcatalog_wcs_conversion(struct mkcatalogparams *p)
 {
   double *c, *d, *df;
   gal_data_t *column;
+  size_t nt=p->cp.numthreads;
 
   /* Flux weighted center positions for clumps and objects. */
   if(p->rd_vo)
     {
       gal_wcs_img_to_world(p->input->wcs, p->rd_vo[0], p->rd_vo[1],
-                           &p->rd_vo[0], &p->rd_vo[1], p->numobjects);
+                           &p->rd_vo[0], &p->rd_vo[1], p->numobjects, nt);
       if(p->rd_vc)
         gal_wcs_img_to_world(p->input->wcs, p->rd_vc[0], p->rd_vc[1],
-                             &p->rd_vc[0], &p->rd_vc[1], p->numclumps);
+                             &p->rd_vc[0], &p->rd_vc[1], p->numclumps, nt);
     }
 
   /* Geometric center positions for clumps and objects. */
   if(p->rd_go)
     {
       gal_wcs_img_to_world(p->input->wcs, p->rd_go[0], p->rd_go[1],
-                           &p->rd_go[0], &p->rd_go[1], p->numobjects);
+                           &p->rd_go[0], &p->rd_go[1], p->numobjects, nt);
       if(p->rd_gc)
         gal_wcs_img_to_world(p->input->wcs, p->rd_gc[0], p->rd_gc[1],
-                             &p->rd_gc[0], &p->rd_gc[1], p->numclumps);
+                             &p->rd_gc[0], &p->rd_gc[1], p->numclumps, nt);
     }
 
   /* All clumps flux weighted center. */
   if(p->rd_vcc)
     gal_wcs_img_to_world(p->input->wcs, p->rd_vcc[0], p->rd_vcc[1],
-                         &p->rd_vcc[0], &p->rd_vcc[1], p->numobjects);
+                         &p->rd_vcc[0], &p->rd_vcc[1], p->numobjects, nt);
 
   /* All clumps geometric center. */
   if(p->rd_gcc)
     gal_wcs_img_to_world(p->input->wcs, p->rd_gcc[0], p->rd_gcc[1],
-                         &p->rd_gcc[0], &p->rd_gcc[1], p->numobjects);
+                         &p->rd_gcc[0], &p->rd_gcc[1], p->numobjects, nt);
 
 
   /* Go over all the object columns and fill in the values. */
@@ -829,7 +830,7 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
      write the objects catalog and free the comments. */
   gal_list_str_reverse(&comments);
   gal_table_write(p->objectcols, comments, p->cp.tableformat, p->objectsout,
-                  p->cp.dontdelete);
+                  p->cp.numthreads, p->cp.dontdelete);
   gal_list_str_free(comments, 1);
 
 
@@ -849,7 +850,7 @@ mkcatalog_write_outputs(struct mkcatalogparams *p)
          write the objects catalog and free the comments. */
       gal_list_str_reverse(&comments);
       gal_table_write(p->clumpcols, comments, p->cp.tableformat,
-                      p->clumpsout, p->cp.dontdelete);
+                      p->clumpsout, p->cp.numthreads, p->cp.dontdelete);
       gal_list_str_free(comments, 1);
     }
 }
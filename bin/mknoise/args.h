@@ -87,6 +87,32 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "counterrng",
+      UI_KEY_COUNTERRNG,
+      0,
+      0,
+      "Counter-based RNG: same output with any threads.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->counterrng,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "streamrows",
+      UI_KEY_STREAMROWS,
+      "INT",
+      0,
+      "Read/noise/write blocks of this many rows.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->streamrows,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GT_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {0}
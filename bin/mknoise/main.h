@@ -36,6 +36,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/* Counter-based random number generator (see `mknoise_philox'). */
+#define COUNTER_RNG_NAME   "philox4x32-10"
+#define COUNTER_RNG_BLOCK  4096       /* Pixels in each job of a thread. */
+
+
+
 
 
 /* Main program parameters structure */
@@ -48,11 +54,16 @@ struct mknoiseparams
   double       zeropoint;    /* Zeropoint magnitude of image.            */
   double  background_mag;    /* Background in magnitudes.                */
   uint8_t        envseed;    /* ==1, generate a random seed.             */
+  uint8_t     counterrng;    /* ==1, use the counter-based generator.    */
+  size_t      streamrows;    /* Rows in each block when streaming.       */
 
   /* Internal */
   gal_data_t      *input;    /* Input image data in double precision.    */
+  size_t          *dsize;    /* Size of full input (when streaming).     */
+  size_t        firstpix;    /* Index of first pixel of `input' in image.*/
   double      background;    /* Background in units of brightness.       */
   gsl_rng           *rng;    /* Main instance of random number generator.*/
+  uint32_t    rng_key[2];    /* Key of the counter-based generator.      */
   char         *rng_type;    /* The type of the Random number gen.       */
   int64_t       rng_seed;    /* Seed of Random number generator.         */
   time_t         rawtime;    /* Starting time of the program.            */
@@ -31,7 +31,10 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <sys/time.h>            /* Generate random seed. */
 
 #include <gsl/gsl_rng.h>         /* Used in setrandoms.   */
+#include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/blank.h>
+#include <gnuastro/threads.h>
 #include <gsl/gsl_randist.h>     /* To make noise.        */
 
 #include <gnuastro-internal/timing.h>
@@ -42,17 +45,190 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/**************************************************************/
+/************     Counter-based random numbers    *************/
+/**************************************************************/
+/* With `--counterrng', the random numbers of each pixel are found from
+   the seed and the index of the pixel, not from the random numbers of the
+   previous pixels (like GSL's generators). So the pixels can be done in
+   any order, by any number of threads, and the output will be the same.
 
+   The generator is Philox4x32-10 (Salmon et al. 2011, "Parallel random
+   numbers: as easy as 1, 2, 3"). It maps a 128-bit counter and a 64-bit
+   key (the seed) into 128 random bits. These are used as two 53-bit
+   uniform random numbers in (0,1) which are converted to two Gaussian
+   random numbers with the Box-Muller transform. So the counter of pixel
+   `i' is `i/2' and it uses the first or second Gaussian number when `i'
+   is even or odd. */
+#define PHILOX_M0  0xD2511F53
+#define PHILOX_M1  0xCD9E8D57
+#define PHILOX_W0  0x9E3779B9
+#define PHILOX_W1  0xBB67AE85
+#define PHILOX_BATCH 64
 
+/* Uniform random number in (0,1) from the top 53 bits of two 32-bit
+   random numbers (2^53=9007199254740992). */
+#define PHILOX_UNIFORM(H,L)                                             \
+  ( ( ( ((uint64_t)(H)<<32 | (L)) >> 11 ) + 0.5f ) / 9007199254740992.0 )
 
 
 
 
 
+/* Run the ten rounds of Philox4x32 on `num' (at most `PHILOX_BATCH')
+   counters. The counters are in four separate arrays (the four 32-bit
+   parts) and the same operations are done on all of them, so the
+   compiler can use SIMD instructions on each round. */
+static void
+mknoise_philox(uint32_t *c0, uint32_t *c1, uint32_t *c2, uint32_t *c3,
+               size_t num, uint32_t *key)
+{
+  size_t i, r;
+  uint64_t p0, p1;
+  uint32_t k0=key[0], k1=key[1];
+
+  for(r=0;r<10;++r)
+    {
+      for(i=0;i<num;++i)
+        {
+          p0 = (uint64_t)PHILOX_M0 * c0[i];
+          p1 = (uint64_t)PHILOX_M1 * c2[i];
+          c0[i] = (uint32_t)(p1>>32) ^ c1[i] ^ k0;
+          c2[i] = (uint32_t)(p0>>32) ^ c3[i] ^ k1;
+          c1[i] = (uint32_t)p1;
+          c3[i] = (uint32_t)p0;
+        }
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+}
 
 
-void
-convertsaveoutput(struct mknoiseparams *p)
+
+
+
+/* Put the Gaussian random numbers (with a mean of zero and standard
+   deviation of one) of the `num' pixels starting from pixel `first' in
+   `out'. */
+static void
+mknoise_gaussian(size_t first, size_t num, uint32_t *key, double *out)
+{
+  double r, t, u1, u2;
+  size_t i, j, n, pair, firstpair=first/2, lastpair=(first+num-1)/2;
+  uint32_t c0[PHILOX_BATCH], c1[PHILOX_BATCH];
+  uint32_t c2[PHILOX_BATCH], c3[PHILOX_BATCH];
+
+  for(pair=firstpair; pair<=lastpair; pair+=PHILOX_BATCH)
+    {
+      /* Set the counters and randomize them. */
+      n = lastpair-pair<PHILOX_BATCH ? lastpair-pair+1 : PHILOX_BATCH;
+      for(j=0;j<n;++j)
+        {
+          c0[j] = (uint64_t)(pair+j) & 0xffffffff;
+          c1[j] = (uint64_t)(pair+j) >> 32;
+          c2[j] = c3[j] = 0;
+        }
+      mknoise_philox(c0, c1, c2, c3, n, key);
+
+      /* Convert them to Gaussian random numbers. Note that the first
+         and last pairs may only have one pixel in this range. */
+      for(j=0;j<n;++j)
+        {
+          u1 = PHILOX_UNIFORM(c0[j], c1[j]);
+          u2 = PHILOX_UNIFORM(c2[j], c3[j]);
+          r  = sqrt( -2.0f * log(u1) );
+          t  = 2.0f * M_PI * u2;
+          i  = 2*(pair+j);
+          if(i>=first)      out[i-first]   = r*cos(t);
+          if(i+1<first+num) out[i+1-first] = r*sin(t);
+        }
+    }
+}
+
+
+
+
+
+/* Add noise to the pixels of the blocks (of `COUNTER_RNG_BLOCK' pixels)
+   given to this thread. */
+static void *
+mknoise_counter_worker(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct mknoiseparams *p=(struct mknoiseparams *)tprm->params;
+
+  double *d, gauss[COUNTER_RNG_BLOCK];
+  double background=p->background, stdadd=p->stdadd;
+  size_t i, j, first, num, size=p->input->size;
+
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Pixels of this block. */
+      first = tprm->indexs[i]*COUNTER_RNG_BLOCK;
+      num   = size-first<COUNTER_RNG_BLOCK ? size-first : COUNTER_RNG_BLOCK;
+      d     = (double *)(p->input->array) + first;
+
+      /* Add the noise. */
+      mknoise_gaussian(p->firstpix+first, num, p->rng_key, gauss);
+      for(j=0;j<num;++j)
+        d[j] += background + sqrt(stdadd+background+d[j]) * gauss[j];
+    }
+
+  /* Wait for all the other threads to finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************            Adding noise             *************/
+/**************************************************************/
+/* Add noise to all the pixels in `p->input'. */
+static void
+mknoise_add(struct mknoiseparams *p)
+{
+  double *d, *df, background=p->background, stdadd=p->stdadd;
+
+  /* With the counter-based generator, the blocks of pixels are given to
+     the threads. */
+  if(p->counterrng)
+    gal_threads_spin_off(mknoise_counter_worker, p,
+                         (p->input->size+COUNTER_RNG_BLOCK-1)/COUNTER_RNG_BLOCK,
+                         p->cp.numthreads);
+  else
+    {
+      df=(d=p->input->array)+p->input->size;
+      do
+        *d += background+gsl_ran_gaussian(p->rng, sqrt(stdadd+background+*d));
+      while(++d<df);
+    }
+}
+
+
+
+
+
+/* Keywords to write in the output's header. */
+static gal_fits_list_key_t *
+mknoise_headers(struct mknoiseparams *p)
 {
   char keyname1[FLEN_KEYWORD];
   gal_fits_list_key_t *headers=NULL;
@@ -77,34 +253,209 @@ convertsaveoutput(struct mknoiseparams *p)
                             "flux.", 0, NULL);
   strcpy(keyname4, "RNGTYPE");
   gal_fits_key_list_add_end(&headers, GAL_TYPE_STRING, keyname4, 0,
-                            p->rng_type, 0, "Random number generator (by "
-                            "GSL) type.",  0, NULL);
+                            p->rng_type, 0, ( p->counterrng
+                                              ? "Random number generator "
+                                              "(counter-based) type."
+                                              : "Random number generator (by "
+                                              "GSL) type." ),  0, NULL);
   strcpy(keyname5, "RNGSEED");
   gal_fits_key_list_add_end(&headers, GAL_TYPE_INT64, keyname5, 0, &p->rng_seed,
-                             0, "Random number generator (by GSL) seed.",
+                             0, ( p->counterrng
+                                  ? "Random number generator (counter-based) "
+                                  "seed."
+                                  : "Random number generator (by GSL) seed." ),
                              0, NULL);
+  return headers;
+}
+
+
+
 
-  /* Save the output: */
-  p->input=gal_data_copy_to_new_type_free(p->input, p->cp.type);
-  gal_fits_img_write(p->input, p->cp.output, headers, PROGRAM_STRING);
 
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************             Streaming               *************/
+/**************************************************************/
+/* With `--streamrows', the input is read, noised and written in blocks of
+   rows (along the slowest dimension), so the used memory doesn't depend
+   on the size of the image. The pixels are visited in the same order as
+   when the whole image is read, so the output is identical. */
+static fitsfile *
+mknoise_stream_open(struct mknoiseparams *p)
+{
+  char *wcsstr;
+  fitsfile *fptr;
+  int nkeyrec, status=0;
+  long naxes[GAL_FITS_MAX_NDIM];
+  size_t i, ndim=p->input->ndim;
+
+  /* Make the image HDU (the size is in opposite order). */
+  for(i=0;i<ndim;++i) naxes[ndim-1-i]=p->dsize[i];
+  fptr=gal_fits_open_to_write(p->cp.output);
+  fits_create_img(fptr, gal_fits_type_to_bitpix(p->cp.type), ndim, naxes,
+                  &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Remove the two comment lines put by CFITSIO (they might not exist,
+     so the status is ignored). */
+  fits_delete_key(fptr, "COMMENT", &status);
+  fits_delete_key(fptr, "COMMENT", &status);
+  status=0;
+
+  /* Write the name and units. */
+  if(p->input->name)
+    fits_write_key(fptr, TSTRING, "EXTNAME", p->input->name, "", &status);
+  if(p->input->unit)
+    fits_write_key(fptr, TSTRING, "BUNIT", p->input->unit, "", &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Write the WCS. */
+  if(p->input->wcs)
+    {
+      gal_wcs_decompose_pc_cdelt(p->input->wcs);
+      status=wcshdo(WCSHDO_safe, p->input->wcs, &nkeyrec, &wcsstr);
+      if(status)
+        error(EXIT_FAILURE, 0, "%s: wcshdo ERROR %d: %s", __func__,
+              status, wcs_errmsg[status]);
+      gal_fits_key_write_wcsstr(fptr, wcsstr, nkeyrec);
+      free(wcsstr);
+    }
+
+  return fptr;
+}
+
+
+
+
+
+static void
+mknoise_stream(struct mknoiseparams *p)
+{
+  void *blank;
+  int anyblank, status=0;
+  double nan=GAL_BLANK_FLOAT64;
+  fitsfile *infptr, *outfptr;
+  int hasblank=0, outdatatype=gal_fits_type_to_datatype(p->cp.type);
+  size_t i, start, end, rowsize=1, nrows=p->dsize[0], ndim=p->input->ndim;
+  gal_data_t *towrite;
+
+  /* Open the input and output. */
+  infptr=gal_fits_hdu_open_format(p->inputname, p->cp.hdu, 0);
+  outfptr=mknoise_stream_open(p);
+
+  /* Number of pixels in one row. */
+  for(i=1;i<ndim;++i) rowsize*=p->dsize[i];
+
+  /* Go over the blocks. */
+  for(start=0; start<nrows; start=end)
+    {
+      /* Set the size of this block. */
+      end = start+p->streamrows<nrows ? start+p->streamrows : nrows;
+      p->firstpix=start*rowsize;
+      p->input->dsize[0]=end-start;
+      p->input->size=(end-start)*rowsize;
+
+      /* Read the block, blank pixels will be NaN (like the non-streaming
+         mode). */
+      fits_read_img(infptr, TDOUBLE, p->firstpix+1, p->input->size, &nan,
+                    p->input->array, &anyblank, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Add the noise and write the block with the output type. */
+      mknoise_add(p);
+      towrite = ( p->cp.type==GAL_TYPE_FLOAT64
+                  ? p->input
+                  : gal_data_copy_to_new_type(p->input, p->cp.type) );
+      fits_write_img(outfptr, outdatatype, p->firstpix+1, towrite->size,
+                     towrite->array, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Integer types need a BLANK keyword if they have blank pixels. */
+      if(towrite->type!=GAL_TYPE_FLOAT32 && towrite->type!=GAL_TYPE_FLOAT64
+         && gal_blank_present(towrite, 0))
+        hasblank=1;
+      if(towrite!=p->input) gal_data_free(towrite);
+    }
+
+  /* Write the BLANK keyword if necessary. */
+  if(hasblank)
+    {
+      blank=gal_blank_alloc_write(p->cp.type);
+      if(fits_write_key(outfptr, outdatatype, "BLANK", blank,
+                        "Pixels with no data.", &status) )
+        gal_fits_io_error(status, "adding the BLANK keyword");
+      free(blank);
+    }
+
+  /* Write the keywords, and close the files. */
+  gal_fits_key_write_version(outfptr, mknoise_headers(p), PROGRAM_STRING);
+  if( fits_close_file(infptr, &status) )
+    gal_fits_io_error(status, NULL);
+  if( fits_close_file(outfptr, &status) )
+    gal_fits_io_error(status, NULL);
 }
 
 
 
 
 
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************           Outside functions         *************/
+/**************************************************************/
 void
-mknoise(struct mknoiseparams *p)
+convertsaveoutput(struct mknoiseparams *p)
 {
-  double *d, *df, background=p->background, stdadd=p->stdadd;
+  /* Save the output: */
+  p->input=gal_data_copy_to_new_type_free(p->input, p->cp.type);
+  gal_fits_img_write(p->input, p->cp.output, mknoise_headers(p),
+                     PROGRAM_STRING);
+}
 
-  /* Add the noise: */
-  df=(d=p->input->array)+p->input->size;
-  do
-    *d += background+gsl_ran_gaussian(p->rng, sqrt(stdadd+background+*d));
-  while(++d<df);
 
-  /* Convert and save the output in the proper format: */
-  convertsaveoutput(p);
+
+
+
+void
+mknoise(struct mknoiseparams *p)
+{
+  /* When streaming, everything is done block by block. */
+  if(p->streamrows)
+    mknoise_stream(p);
+  else
+    {
+      /* Add the noise: */
+      mknoise_add(p);
+
+      /* Convert and save the output in the proper format: */
+      convertsaveoutput(p);
+    }
 }
@@ -26,6 +26,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <error.h>
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include <gnuastro/wcs.h>
@@ -260,12 +261,62 @@ ui_check_options_and_arguments(struct mknoiseparams *p)
 /**************************************************************/
 /***************       Preparations         *******************/
 /**************************************************************/
+/* When streaming, only the size, name and units of the input are read
+   here. `p->input' will only keep one block of rows (along the slowest
+   dimension) at any moment. */
+static void
+ui_prepare_stream(struct mknoiseparams *p)
+{
+  char **str;
+  fitsfile *fptr;
+  int status=0, type;
+  gal_data_t *keysll=NULL;
+  char *name=NULL, *unit=NULL;
+  size_t ndim, dsize_key=1, bdsize[GAL_FITS_MAX_NDIM];
+
+  /* Read the size of the input. */
+  fptr=gal_fits_hdu_open_format(p->inputname, p->cp.hdu, 0);
+  gal_fits_img_info(fptr, &type, &ndim, &p->dsize);
+  if(ndim<2)
+    error(EXIT_FAILURE, 0, "%s (hdu: %s): has %zu dimension(s). "
+          "`--streamrows' needs an image with two or more dimensions",
+          p->inputname, p->cp.hdu, ndim);
+
+  /* Read the name and units of the input. */
+  gal_list_data_add_alloc(&keysll, NULL, GAL_TYPE_STRING, 1, &dsize_key,
+                          NULL, 0, -1, "EXTNAME", NULL, NULL);
+  gal_list_data_add_alloc(&keysll, NULL, GAL_TYPE_STRING, 1, &dsize_key,
+                          NULL, 0, -1, "BUNIT", NULL, NULL);
+  gal_fits_key_read_from_ptr(fptr, keysll, 0, 0);
+  if(keysll->status==0)       {str=keysll->array;       unit=*str; }
+  if(keysll->next->status==0) {str=keysll->next->array; name=*str; }
+
+  /* Allocate the block. */
+  memcpy(bdsize, p->dsize, ndim*sizeof *bdsize);
+  if(bdsize[0]>p->streamrows) bdsize[0]=p->streamrows;
+  p->input=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, ndim, bdsize, NULL, 0,
+                          p->cp.minmapsize, name, unit, NULL);
+
+  /* Clean up. */
+  gal_list_data_free(keysll);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
 void
 ui_preparations(struct mknoiseparams *p)
 {
-  /* Read the input image as a double type */
-  p->input=gal_fits_img_read_to_type(p->inputname, p->cp.hdu,
-                                     GAL_TYPE_FLOAT64, p->cp.minmapsize);
+  /* Read the input image as a double type (or prepare for streaming
+     it). */
+  if(p->streamrows)
+    ui_prepare_stream(p);
+  else
+    p->input=gal_fits_img_read_to_type(p->inputname, p->cp.hdu,
+                                       GAL_TYPE_FLOAT64, p->cp.minmapsize);
 
 
   /* Read the WSC structure. */
@@ -295,14 +346,24 @@ ui_preparations(struct mknoiseparams *p)
   p->background=pow(10, (p->zeropoint-p->background_mag)/2.5f);
 
 
-  /* Allocate the random number generator: */
+  /* Allocate the random number generator. The counter-based generator
+     has no state, it only needs the seed (as its key). */
   gsl_rng_env_setup();
-  p->rng=gsl_rng_alloc(gsl_rng_default);
   p->rng_seed = ( p->envseed
                   ? gsl_rng_default_seed
                   : gal_timing_time_based_rng_seed() );
-  gsl_rng_set(p->rng, p->rng_seed);
-  gal_checkset_allocate_copy(gsl_rng_name(p->rng), &p->rng_type);
+  if(p->counterrng)
+    {
+      p->rng_key[0] = (uint64_t)p->rng_seed & 0xffffffff;
+      p->rng_key[1] = (uint64_t)p->rng_seed >> 32;
+      gal_checkset_allocate_copy(COUNTER_RNG_NAME, &p->rng_type);
+    }
+  else
+    {
+      p->rng=gsl_rng_alloc(gsl_rng_default);
+      gsl_rng_set(p->rng, p->rng_seed);
+      gal_checkset_allocate_copy(gsl_rng_name(p->rng), &p->rng_type);
+    }
 }
 
 
@@ -384,8 +445,7 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct mknoiseparams *p)
   if(!p->cp.quiet)
     {
       printf(PROGRAM_NAME" started on %s", ctime(&p->rawtime));
-      sprintf(message, "Random number generator type: %s",
-              gsl_rng_name(p->rng));
+      sprintf(message, "Random number generator type: %s", p->rng_type);
       gal_timing_report(NULL, message, 1);
       sprintf(message, "Random number generator seed: %"PRId64, p->rng_seed);
       gal_timing_report(NULL, message, 1);
@@ -422,6 +482,8 @@ ui_free_report(struct mknoiseparams *p, struct timeval *t1)
   free(p->rng_type);
   free(p->cp.output);
   gal_data_free(p->input);
+  if(p->dsize) free(p->dsize);
+  if(p->rng) gsl_rng_free(p->rng);
 
   /* Print the final message. */
   if(!p->cp.quiet)
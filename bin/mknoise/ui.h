@@ -42,6 +42,8 @@ enum option_keys_enum
 
   /* Only with long version (start with a value 1000, the rest will be set
      automatically). */
+  UI_KEY_COUNTERRNG  = 1000,
+  UI_KEY_STREAMROWS,
 };
 
 
@@ -152,6 +152,32 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "shards",
+      UI_KEY_SHARDS,
+      "INT",
+      0,
+      "Write individual images as extensions of INT files.",
+      GAL_OPTIONS_GROUP_OUTPUT,
+      &p->shards,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "bandheight",
+      UI_KEY_BANDHEIGHT,
+      "INT",
+      0,
+      "Keep only INT rows of merged image in memory.",
+      GAL_OPTIONS_GROUP_OUTPUT,
+      &p->bandheight,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
@@ -175,6 +201,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "quasirandom",
+      UI_KEY_QUASIRANDOM,
+      0,
+      0,
+      "Use quasi-random (Sobol) points, not random.",
+      ARGS_GROUP_PROFILES,
+      &p->quasirandom,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "tolerance",
       UI_KEY_TOLERANCE,
@@ -188,6 +227,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "centerbins",
+      UI_KEY_CENTERBINS,
+      "INT",
+      0,
+      "No. of bins for profile center in a pixel.",
+      ARGS_GROUP_PROFILES,
+      &p->centerbins,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GT_0,
+      GAL_OPTIONS_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
     {
       "tunitinp",
       UI_KEY_TUNITINP,
@@ -29,6 +29,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/fits.h>
 
 #include <gnuastro-internal/options.h>
+#include <gnuastro-internal/multiext.h>
 
 
 /* Progarm name macros: */
@@ -39,8 +40,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 /* Some constants */
-#define EPSREL_FOR_INTEG   2
 #define DEGREESTORADIANS   M_PI/180.0f
+#define SHARD_WINDOW       4    /* Waiting individual images per thread. */
+#define COMPOSITE_WINDOW   4    /* Built profiles waiting, per thread.   */
+#define COMPOSITE_STRIPS   4    /* Strips of the merged image, per thread.*/
+#define CACHE_NUM_LISTS    4096 /* Number of lists in the profile cache. */
+#define CACHE_MAX_BYTES    268435456  /* Maximum size of cached profiles.*/
 
 
 
@@ -89,10 +94,52 @@ struct builtqueue
   int                func;    /* Profile's radial function.          */
 
   int        indivcreated;    /* ==1: an individual file is created. */
+  int           fromcache;    /* ==1: copied from the profile cache. */
   size_t          numaccu;    /* Number of accurate pixels.          */
   double         accufrac;    /* Difference of accurate values.      */
 
-  struct builtqueue *next;    /* Pointer to next element.            */
+  size_t              pos;    /* Position in the order of building.  */
+  size_t          waiting;    /* Strips it hasn't been added to yet. */
+  double        *stripsum;    /* Sum of pixels added to each strip.  */
+};
+
+
+
+
+
+/* The merged image is divided into strips (groups of rows) that are
+   filled in parallel, see `mkprof_strip_work'. */
+struct compositestrip
+{
+  size_t            start;    /* First row (in C) of this strip.     */
+  size_t              end;    /* Row after the last row of strip.    */
+  size_t             next;    /* ID of next profile to add.          */
+  pthread_mutex_t    lock;    /* Only one thread works on a strip.   */
+};
+
+
+
+
+
+/* A built profile (before its brightness is set) that can be used for all
+   the profiles with the same parameters, see `oneprofile_make'. */
+struct proftemplate
+{
+  int                func;    /* Radial function of the profile.     */
+  float                 r;    /* Radius of profile.                  */
+  float                 n;    /* Index of profile.                   */
+  float                 p;    /* Position angle of profile.          */
+  float                 q;    /* Axis ratio of profile.              */
+  float                 t;    /* Truncation distance.                */
+  double               xc;    /* Center (after binning).             */
+  double               yc;    /* Center (after binning).             */
+  float              *img;    /* The built profile.                  */
+  size_t             size;    /* Number of pixels in `img'.          */
+  float          peakflux;    /* Flux at profile peak.               */
+  size_t          numaccu;    /* Number of accurate pixels.          */
+  double         accufrac;    /* Sum of accurate values.             */
+
+  struct proftemplate *next;  /* Next profile in this list.          */
 };
 
 
@@ -112,9 +159,13 @@ struct mkprofparams
   uint8_t          psfinimg;  /* ==1: Build PSF profiles in image.        */
   uint8_t        individual;  /* ==1: Build all catalog separately.       */
   uint8_t          nomerged;  /* ==1: Don't make a merged image of all.   */
+  size_t             shards;  /* Files to keep individual profiles.       */
+  size_t         bandheight;  /* Rows of merged image kept in memory.     */
   char             *typestr;  /* Type of finally merged output image.     */
   size_t          numrandom;  /* Number of radom points for integration.  */
+  uint8_t       quasirandom;  /* ==1: Use quasi-random (Sobol) points.    */
   float           tolerance;  /* Accuracy to stop integration.            */
+  size_t         centerbins;  /* Bins for profile center in a pixel.      */
   uint8_t          tunitinp;  /* ==1: Truncation is in pixels, not radial.*/
   long             shift[2];  /* Shift along axeses position of profiles. */
   uint8_t       prepforconv;  /* Shift and expand by size of first psf.   */
@@ -158,16 +209,31 @@ struct mkprofparams
   float                  *m;  /* Magnitude of profile.                    */
   float                  *t;  /* Truncation distance.                     */
   gsl_rng              *rng;  /* Main instance of random number generator.*/
+  double          *qrpoints;  /* Quasi-random points (x and y) in [0,1).  */
   time_t            rawtime;  /* Starting time of the program.            */
   double               *cat;  /* Input catalog.                           */
   gal_data_t           *log;  /* Log data to be printed.                  */
-  struct builtqueue     *bq;  /* Top (last) elem of build queue.          */
-  pthread_cond_t     qready;  /* bq is ready to be written.               */
-  pthread_mutex_t     qlock;  /* Mutex lock to change builtq.             */
+  struct builtqueue **window; /* Built profiles not added to all strips.  */
+  size_t         windowsize;  /* Number of elements in `window'.          */
+  size_t        numcomplete;  /* Profiles added to all strips.            */
+  struct compositestrip *strips; /* Strips of the merged image.           */
+  size_t          numstrips;  /* Number of strips.                        */
+  gal_data_t          *band;  /* Rows of merged image in memory (banded). */
+  size_t          bandstart;  /* First row (in C) of `band'.              */
+  size_t          *bandorder; /* Profile IDs in order of building (band). */
+  size_t          bandfirst;  /* Position of first profile in this band.  */
+  struct builtqueue **bandbuilt; /* Built profiles over this band.        */
+  size_t       numbandbuilt;  /* Number of elements in `bandbuilt'.       */
+  pthread_cond_t     qready;  /* A place in `window' is free.             */
+  pthread_mutex_t     qlock;  /* Mutex to change `window' and strips.     */
   double          halfpixel;  /* Half pixel in oversampled image.         */
   char           *wcsheader;  /* The WCS header information for main img. */
   int            wcsnkeyrec;  /* The number of keywords in the WCS header.*/
   char       *mergedimgname;  /* Name of merged image.                    */
+  gal_multiext_t  *multiext;  /* Writer when individuals are extensions.  */
+  struct proftemplate **cache; /* Lists of already built profiles.        */
+  size_t         cachebytes;  /* Total size of the cached profiles.       */
+  pthread_mutex_t cachelock;  /* Mutex to change the cache.               */
 };
 
 #endif
@@ -31,7 +31,9 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro/box.h>
 #include <gnuastro/git.h>
+#include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/blank.h>
 #include <gnuastro/threads.h>
 #include <gnuastro/statistics.h>
 
@@ -63,11 +65,11 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 /**************************************************************/
-/************        builtqueue linked list       *************/
+/************            Built profiles           *************/
 /**************************************************************/
-/* Add an empty element to the existing builtqueue. */
-void
-builtqueue_addempty(struct builtqueue **bq)
+/* Allocate and initialize the structure to keep a built profile. */
+static struct builtqueue *
+builtqueue_alloc(struct mkprofparams *p, size_t id)
 {
   struct builtqueue *tbq;
 
@@ -79,14 +81,368 @@ builtqueue_addempty(struct builtqueue **bq)
           __func__, sizeof *tbq);
 
   /* Initialize some of the values. */
+  tbq->id=id;
   tbq->img=NULL;
   tbq->numaccu=0;
   tbq->accufrac=0.0f;
   tbq->indivcreated=0;
+  tbq->fromcache=0;
+  tbq->waiting=p->numstrips;
+  tbq->stripsum=gal_data_calloc_array(GAL_TYPE_FLOAT64, p->numstrips);
+  return tbq;
+}
+
+
+
+
+
+/* A profile has been added to all the strips, so fill its log, report it
+   and free it. */
+static void
+builtqueue_complete(struct mkprofparams *p, struct builtqueue *ibq,
+                    size_t left)
+{
+  size_t s, clog;
+  char *jobname;
+  gal_data_t *log;
+  double sum=0.0f;
+
+  /* Sum of the pixels that were added to the merged image. */
+  for(s=0;s<p->numstrips;++s) sum+=ibq->stripsum[s];
+
+  /* Fill the log array. */
+  if(p->cp.log)
+    {
+      clog=0;
+      for(log=p->log; log!=NULL; log=log->next)
+        switch(++clog)
+          {
+          case 5:
+            ((unsigned char *)(log->array))[ibq->id] = ibq->indivcreated;
+            break;
+          case 4:
+            ((float *)(log->array))[ibq->id] = ibq->accufrac;
+            break;
+          case 3:
+            ((unsigned long *)(log->array))[ibq->id]=ibq->numaccu;
+            break;
+          case 2:
+            ((float *)(log->array))[ibq->id] =
+              sum>0.0f ? -2.5f*log10(sum)+p->zeropoint : NAN;
+            break;
+          case 1:
+            ((unsigned long *)(log->array))[ibq->id]=ibq->id+1;
+            break;
+          }
+    }
+
+  /* Report if in verbose mode. */
+  if(!p->cp.quiet)
+    {
+      asprintf(&jobname, "row %zu complete%s, %zu left to go", ibq->id,
+               ibq->fromcache ? " (from the profile cache)" : "", left);
+      gal_timing_report(NULL, jobname, 2);
+      free(jobname);
+    }
+
+  /* Free the array and the structure. Note that there is no problem to
+     free a NULL pointer (when the built array didn't overlap). */
+  free(ibq->stripsum);
+  free(ibq->img);
+  free(ibq);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************             Compositing             *************/
+/**************************************************************/
+/* The built profiles are added into the merged image by the builder
+   threads themselves. The merged image is divided into `p->numstrips'
+   strips (groups of rows) and each strip has its own lock. So different
+   threads can add different profiles (or different parts of one large
+   profile) at the same time. To have a reproducible result (independent
+   of the number of threads and how long each profile took to build), the
+   profiles are added to each strip in the order of their IDs.
+
+   The built profiles are kept in a window (`p->window') until they are
+   added to all the strips: profile `id' is in element `id%p->windowsize'
+   of the window. Profiles are completed (added to all strips) in the
+   order of their IDs, so a builder has to wait until profile
+   `id-p->windowsize' is complete before putting its profile in the
+   window. After putting its profile in the window, a builder goes over
+   all the strips and (if no other thread is working on that strip), adds
+   all the profiles that are ready for it. */
+
+
+
+
+
+/* Return the profile that must be added next to this strip, or NULL if it
+   hasn't been built yet. `p->qlock' must be held. */
+static struct builtqueue *
+mkprof_strip_next(struct mkprofparams *p, struct compositestrip *strip)
+{
+  struct builtqueue *ibq;
+
+  if(strip->next>=p->num) return NULL;
+  ibq=p->window[ strip->next % p->windowsize ];
+  return ibq && ibq->id==strip->next ? ibq : NULL;
+}
+
+
+
+
+
+/* Add the part of the profile that is within this strip to the merged
+   image and return the sum of the added pixels. Note that the FITS and C
+   arrays have opposite axis orders and FITS counting starts from 1, not
+   zero. Also fpixel is the first (inclusive) pixel and so is lpixel (it
+   is inclusive). */
+static double
+mkprof_strip_add(struct mkprofparams *p, struct compositestrip *strip,
+                 struct builtqueue *ibq)
+{
+  double sum=0.0f;
+  long os=p->oversample;
+  int replace=p->replace;
+  float *to, *from, *colend, *rowend;
+  size_t i, j, iw, jw, ii, jj, w=p->naxes[0], ow, start, end;
+  float *array = p->band ? p->band->array : p->out->array;
+
+  /* If the profile doesn't overlap with the image, there is nothing to
+     do. */
+  if(ibq->overlaps==0 || array==NULL) return 0.0f;
+
+  /* Set the starting points in the complete image. */
+  i  = os * (ibq->fpixel_i[1]-1);
+  j  = os * (ibq->fpixel_i[0]-1);
+
+  /* Set the starting and ending points in the overlapping image. Note
+     that oversampling has already been taken into account in
+     ibq->width. */
+  ow = ibq->imgwidth;
+  ii = os * (ibq->fpixel_o[1]-1);
+  jj = os * (ibq->fpixel_o[0]-1);
+
+  /* Find the width of the overlapping region: */
+  iw = os*(ibq->lpixel_i[1]-ibq->fpixel_i[1]+1);
+  jw = os*(ibq->lpixel_i[0]-ibq->fpixel_i[0]+1);
+
+  /* Only the rows within this strip should be added. */
+  start = i>strip->start ? i : strip->start;
+  end   = i+iw<strip->end ? i+iw : strip->end;
+  if(start>=end) return 0.0f;
+
+  /* Write the overlap to the actual image. Instead of writing two for
+     loops and summing all the row and column indexs for every pixel and
+     each image, we use pointer arithmetic which is much more
+     efficient. Just think of one pointer that is advancing over the final
+     image (*to) and one that is advancing over the overlap image
+     (*from). Since we know the images overlap, iw and jw are both smaller
+     than the two image number of columns and number of rows, so w-jw and
+     ow-jw will always be positive. In banded mode, only the rows from
+     `p->bandstart' are in memory. */
+  to     = array + (start-p->bandstart)*w+j;
+  from   = ibq->img + (ii+start-i)*ow + jj;
+  rowend = to + (end-start)*w;
+  do
+    {
+      /* Go over all the pixels in this row and write this profile into
+         the final output array. Just note that when replacing, we don't
+         want to replace those pixels that have a zero value, since no
+         profile existed there. */
+      colend=to+jw;
+      do
+        {
+          *to  = ( replace
+                   ? ( *from==0.0f ? *to : *from )
+                   :  *to + *from );
+          sum += *from;
+          ++from;
+        }
+      while(++to<colend);
+
+      /* Go to the next row. */
+      to   += w-jw;
+      from += ow-jw;
+    }
+  while(to<rowend);
+
+  return sum;
+}
+
+
+
+
+
+/* Add all the profiles that are ready for this strip (if no other thread
+   is working on it). */
+static void
+mkprof_strip_work(struct mkprofparams *p, size_t s)
+{
+  size_t left;
+  struct builtqueue *ibq;
+  struct compositestrip *strip=&p->strips[s];
+
+  while( pthread_mutex_trylock(&strip->lock)==0 )
+    {
+      /* Add the profiles that are ready for this strip (in order). */
+      pthread_mutex_lock(&p->qlock);
+      while( (ibq=mkprof_strip_next(p, strip)) )
+        {
+          pthread_mutex_unlock(&p->qlock);
+          ibq->stripsum[s]=mkprof_strip_add(p, strip, ibq);
+          pthread_mutex_lock(&p->qlock);
+
+          /* If this was the last strip for this profile, free its place
+             in the window and complete it. */
+          ++strip->next;
+          if(--ibq->waiting==0)
+            {
+              p->window[ ibq->id % p->windowsize ]=NULL;
+              left = p->num - ++p->numcomplete;
+              pthread_cond_broadcast(&p->qready);
+              pthread_mutex_unlock(&p->qlock);
+              builtqueue_complete(p, ibq, left);
+              pthread_mutex_lock(&p->qlock);
+            }
+        }
+      pthread_mutex_unlock(&p->qlock);
+      pthread_mutex_unlock(&strip->lock);
+
+      /* While this thread was working on the strip, another thread may
+         have put a profile for this strip in the window, but couldn't
+         lock the strip. So check again. */
+      pthread_mutex_lock(&p->qlock);
+      ibq=mkprof_strip_next(p, strip);
+      pthread_mutex_unlock(&p->qlock);
+      if(ibq==NULL) break;
+    }
+}
+
+
+
+
+
+/* Divide the rows from `start' to `end' (the whole merged image, or one
+   band of it) between the strips. */
+static void
+mkprof_composite_strips(struct mkprofparams *p, size_t start, size_t end)
+{
+  size_t s, height=(end-start+p->numstrips-1)/p->numstrips;
+
+  for(s=0;s<p->numstrips;++s)
+    {
+      p->strips[s].next=0;
+      p->strips[s].start = start+s*height<end ? start+s*height : end;
+      p->strips[s].end = start+(s+1)*height<end ? start+(s+1)*height : end;
+    }
+}
+
+
+
+
+
+/* Prepare the window and strips for compositing. */
+static void
+mkprof_composite_init(struct mkprofparams *p)
+{
+  int err;
+  size_t s, nt=p->cp.numthreads;
+  size_t rows = p->band ? p->band->dsize[0] : p->naxes[1];
+
+  /* Allocate the window. */
+  errno=0;
+  p->numcomplete=0;
+  p->windowsize=COMPOSITE_WINDOW*nt;
+  p->window=calloc(p->windowsize, sizeof *p->window);
+  if(p->window==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `p->window'",
+          __func__, p->windowsize*sizeof *p->window);
+
+  /* Set the strips. When there is no merged image, one strip (that
+     doesn't contain any row) is enough to keep the order. In banded mode,
+     the strips are set again for each band (see `mkprof_bands'). */
+  p->numstrips = p->out->array || p->band ? COMPOSITE_STRIPS*nt : 1;
+  if(p->numstrips>rows) p->numstrips=rows;
+  errno=0;
+  p->strips=malloc(p->numstrips*sizeof *p->strips);
+  if(p->strips==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `p->strips'",
+          __func__, p->numstrips*sizeof *p->strips);
+  for(s=0;s<p->numstrips;++s)
+    {
+      err=pthread_mutex_init(&p->strips[s].lock, NULL);
+      if(err) error(EXIT_FAILURE, 0, "%s: mutex not initialized", __func__);
+    }
+  mkprof_composite_strips(p, 0, p->out->array || p->band ? rows : 0);
+
+  /* Initialize the condition variable and mutex. */
+  err=pthread_mutex_init(&p->qlock, NULL);
+  if(err) error(EXIT_FAILURE, 0, "%s: mutex not initialized", __func__);
+  err=pthread_cond_init(&p->qready, NULL);
+  if(err) error(EXIT_FAILURE, 0, "%s: condition variable not initialized",
+                __func__);
+}
+
+
+
+
+
+static void
+mkprof_composite_free(struct mkprofparams *p)
+{
+  size_t s;
+
+  for(s=0;s<p->numstrips;++s)
+    pthread_mutex_destroy(&p->strips[s].lock);
+  pthread_cond_destroy(&p->qready);
+  pthread_mutex_destroy(&p->qlock);
+  free(p->strips);
+  free(p->window);
+}
+
+
 
-  /* Set its next element to the input bq and re-set the input bq. */
-  tbq->next=*bq;
-  *bq=tbq;
+
+
+/* Put a built profile in the window (waiting for its place to be free),
+   then add the profiles that are ready to the strips. */
+static void
+mkprof_composite(struct mkprofparams *p, struct builtqueue *ibq)
+{
+  size_t s, first=ibq->id % p->numstrips;
+
+  /* Put the profile in the window. Note that after this, `ibq' may be
+     freed by another thread at any moment. */
+  pthread_mutex_lock(&p->qlock);
+  while( ibq->id >= p->numcomplete + p->windowsize )
+    pthread_cond_wait(&p->qready, &p->qlock);
+  p->window[ ibq->id % p->windowsize ]=ibq;
+  pthread_mutex_unlock(&p->qlock);
+
+  /* Go over the strips. To avoid all threads competing over the same
+     strip, each profile starts from a different strip. */
+  for(s=0;s<p->numstrips;++s)
+    mkprof_strip_work(p, (first+s) % p->numstrips);
 }
 
 
@@ -117,6 +473,8 @@ saveindividual(struct mkonthread *mkp)
 {
   struct mkprofparams *p=mkp->p;
 
+  int status=0;
+  fitsfile *fptr;
   double crpix[2];
   gal_data_t *data;
   long os=p->oversample;
@@ -126,35 +484,58 @@ saveindividual(struct mkonthread *mkp)
   /* Note that `width' is in FITS format, not C. */
   size_t dsize[2]={mkp->width[1], mkp->width[0]};
 
-  /* Write the name and remove a similarly named file. */
-  asprintf(&filename, "%s%zu_%s", outdir, ibq->id, p->basename);
-  gal_checkset_check_remove_file(filename, 0, p->cp.dontdelete);
+  /* Write the name and remove a similarly named file. When the individual
+     images are written as extensions, this name (without the directory)
+     is the extension name. */
+  if(p->multiext)
+    asprintf(&filename, "%zu_%s", ibq->id, p->basename);
+  else
+    {
+      asprintf(&filename, "%s%zu_%s", outdir, ibq->id, p->basename);
+      gal_checkset_check_remove_file(filename, 0, p->cp.dontdelete);
+    }
 
   /* Put the array into a data structure */
   data=gal_data_alloc(ibq->img, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0,
                       p->cp.minmapsize, "MockImage", "Brightness", NULL);
 
+  /* Save the correct CRPIX values: */
+  crpix[0] = p->crpix[0] - os*(mkp->fpixel_i[0]-1);
+  crpix[1] = p->crpix[1] - os*(mkp->fpixel_i[1]-1);
+
   /* Write the array to file (a separately built PSF doesn't need WCS
-     coordinates). */
-  if(ibq->ispsf && p->psfinimg==0)
-    gal_fits_img_write(data, filename, NULL, PROGRAM_STRING);
-  else
+     coordinates). When the individual images are written as extensions,
+     the image is written in memory and given to the writer. */
+  if(p->multiext)
     {
-      /* Save the correct CRPIX values: */
-      crpix[0] = p->crpix[0] - os*(mkp->fpixel_i[0]-1);
-      crpix[1] = p->crpix[1] - os*(mkp->fpixel_i[1]-1);
-
-      /* Write the image. */
-      gal_fits_img_write_corr_wcs_str(data, filename, p->wcsheader,
-                                      p->wcsnkeyrec, crpix, NULL,
-                                      PROGRAM_STRING);
+      fptr=gal_fits_img_write_to_ptr(data, "mem://");
+      if(ibq->ispsf==0 || p->psfinimg)
+        {
+          gal_fits_key_write_wcsstr(fptr, p->wcsheader, p->wcsnkeyrec);
+          fits_update_key(fptr, TDOUBLE, "CRPIX1", &crpix[0], NULL, &status);
+          fits_update_key(fptr, TDOUBLE, "CRPIX2", &crpix[1], NULL, &status);
+          gal_fits_io_error(status, NULL);
+        }
+      gal_fits_key_write_version(fptr, NULL, PROGRAM_STRING);
+      gal_checkset_allocate_copy(filename, &jobname);
+      gal_multiext_add(p->multiext, ibq->pos, fptr, ibq->id+1, jobname);
     }
+  else if(ibq->ispsf && p->psfinimg==0)
+    gal_fits_img_write(data, filename, NULL, PROGRAM_STRING);
+  else
+    gal_fits_img_write_corr_wcs_str(data, filename, p->wcsheader,
+                                    p->wcsnkeyrec, crpix, NULL,
+                                    PROGRAM_STRING);
   ibq->indivcreated=1;
 
   /* Report if in verbose mode. */
   if(!p->cp.quiet)
     {
-      asprintf(&jobname, "%s created.", filename);
+      if(p->multiext)
+        asprintf(&jobname, "%s created (in %s).", filename,
+                 gal_multiext_file(p->multiext, ibq->pos));
+      else
+        asprintf(&jobname, "%s created.", filename);
       gal_timing_report(NULL, jobname, 2);
       free(jobname);
     }
@@ -182,6 +563,41 @@ saveindividual(struct mkonthread *mkp)
 /**************************************************************/
 /************            The builders             *************/
 /**************************************************************/
+/* Set the parameters of the profile in `mkp->ibq' and find its bounding
+   box and its overlap with the merged image (non-oversampled). */
+static void
+mkprof_set_box(struct mkonthread *mkp)
+{
+  long lpixel_o[2];
+  struct mkprofparams *p=mkp->p;
+  struct builtqueue *ibq=mkp->ibq;
+  size_t id=ibq->id;
+
+  /* Write the necessary parameters for this profile into mkp.*/
+  oneprof_set_prof_params(mkp);
+
+  /* Find the bounding box size (NOT oversampled). */
+  if( p->f[id] == PROFILE_POINT )
+    mkp->width[0]=mkp->width[1]=1;
+  else
+    gal_box_ellipse_in_box(mkp->truncr, mkp->q*mkp->truncr,
+                           p->p[id]*DEGREESTORADIANS, mkp->width);
+
+  /* Get the overlapping pixels using the starting points (NOT
+     oversampled). */
+  gal_box_border_from_center(p->x[id], p->y[id], mkp->width,
+                             ibq->fpixel_i, ibq->lpixel_i);
+  mkp->fpixel_i[0]=ibq->fpixel_i[0];
+  mkp->fpixel_i[1]=ibq->fpixel_i[1];
+  ibq->overlaps = gal_box_overlap(mkp->onaxes, ibq->fpixel_i,
+                                  ibq->lpixel_i, ibq->fpixel_o,
+                                  lpixel_o);
+}
+
+
+
+
+
 /* Build the profiles that are indexed in the indexs array of the
    mkonthread structure that was assigned to it.
 
@@ -216,49 +632,23 @@ mkprof_build(void *inparam)
   struct mkonthread *mkp=(struct mkonthread *)inparam;
   struct mkprofparams *p=mkp->p;
 
-  size_t i, id;
-  int lockresult;
-  long lpixel_o[2];
-  pthread_mutex_t *qlock=&p->qlock;
-  struct builtqueue *ibq, *fbq=NULL;
-  pthread_cond_t *qready=&p->qready;
+  size_t i, id, pos;
+  struct builtqueue *ibq;
 
-  /* Make each profile that was specified for this thread. */
+  /* Make each profile that was specified for this thread. In banded mode,
+     the profiles aren't built in the order of their IDs: the indexs are
+     positions in `p->bandorder' (from `p->bandfirst'). */
   for(i=0; mkp->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
     {
-      /* Create a new builtqueue element with all the information. fbq
-         will be used when we want to add ibq to p->bq. It is defined
-         so we don't have to waste time traversing the ibq. Its
-         characteristic compared to the other elements of ibq is that
-         fbq->next==NULL. So to add ibq to p->bq, we just have to set
-         fbq->next=p->bq and then set p->bq to ibq.*/
-      builtqueue_addempty(&mkp->ibq);
-      ibq=mkp->ibq;
-      id=ibq->id=mkp->indexs[i];
-      if(fbq==NULL) fbq=ibq;
+      /* Allocate the structure to keep this profile's information. */
+      pos=p->bandfirst+mkp->indexs[i];
+      id=p->bandorder ? p->bandorder[pos] : pos;
+      ibq=mkp->ibq=builtqueue_alloc(p, id);
+      ibq->pos=pos;
 
 
-      /* Write the necessary parameters for this profile into mkp.*/
-      oneprof_set_prof_params(mkp);
-
-
-      /* Find the bounding box size (NOT oversampled). */
-      if( p->f[id] == PROFILE_POINT )
-        mkp->width[0]=mkp->width[1]=1;
-      else
-        gal_box_ellipse_in_box(mkp->truncr, mkp->q*mkp->truncr,
-                               p->p[id]*DEGREESTORADIANS, mkp->width);
-
-
-      /* Get the overlapping pixels using the starting points (NOT
-         oversampled). */
-      gal_box_border_from_center(p->x[id], p->y[id], mkp->width,
-                                 ibq->fpixel_i, ibq->lpixel_i);
-      mkp->fpixel_i[0]=ibq->fpixel_i[0];
-      mkp->fpixel_i[1]=ibq->fpixel_i[1];
-      ibq->overlaps = gal_box_overlap(mkp->onaxes, ibq->fpixel_i,
-                                      ibq->lpixel_i, ibq->fpixel_o,
-                                      lpixel_o);
+      /* Set the parameters and find the overlap with the image. */
+      mkprof_set_box(mkp);
 
 
       /* Build the profile if necessary, After this, the width is
@@ -284,60 +674,24 @@ mkprof_build(void *inparam)
             }
         }
 
-      /* Add ibq to bq if you can lock the mutex. */
-      if(p->cp.numthreads>1)
-        {
-          /* Try locking the mutex so no thread can change the value
-             of p->bq. If you can lock it, then put the internal
-             builtqueue on top of the general builtqueue. If you
-             can't, continue adding to the internal builtqueue (make
-             the next profiles) until you find a chance to lock the
-             mutex. */
-          lockresult=pthread_mutex_trylock(qlock);
-          if(lockresult==0)     /* Mutex was successfully locked. */
-            {
-              /* Add this internal queue to system queue. */
-              fbq->next=p->bq;
-              p->bq=ibq;
-
-              /* If the list was empty when you locked the mutex, then
-                 either `mkprof_write` is waiting behind a condition
-                 variable for you to fill it up or not (either it hasn't
-                 got to setting the condition variable yet (this function
-                 locked the mutex before `mkprof_write`) or it just got the
-                 list to be made and is busy writing the arrays in the
-                 output). In either case, pthread_cond_signal will work. */
-              if(fbq->next==NULL)
-                pthread_cond_signal(qready);
-              pthread_mutex_unlock(qlock);
-
-              /* Finally set both the internal queue and the first
-                 internal queue element to NULL.*/
-              fbq=NULL;
-              mkp->ibq=NULL;
-            }
-          /* The mutex couldn't be locked and there are no more
-             objects for this thread to build (giving a chance for
-             this thread to add up its built profiles). So we have to
-             lock the mutex to pass on this built structure to the
-             builtqueue. */
-          else if (mkp->indexs[i+1]==GAL_BLANK_SIZE_T)
-            {
-              pthread_mutex_lock(qlock);
-              fbq->next=p->bq;
-              p->bq=ibq;
-              pthread_cond_signal(qready);
-              pthread_mutex_unlock(qlock);
-            }
-        }
+      /* When individual images are written as extensions, the writer
+         needs to know about every profile (even if it wasn't saved). */
+      if(p->multiext && ibq->indivcreated==0)
+        gal_multiext_add(p->multiext, pos, NULL, 0, NULL);
+
+      /* Add the profile to the merged image. In banded mode, the profiles
+         of each band are added after they are all built. */
+      if(p->bandorder)
+        p->bandbuilt[ p->numbandbuilt + mkp->indexs[i] ]=ibq;
+      else
+        mkprof_composite(p, ibq);
+      mkp->ibq=NULL;
     }
 
   /* Free the allocated space for this thread and wait until all other
      threads finish. */
   gsl_rng_free(mkp->rng);
-  if(p->cp.numthreads==1)
-    p->bq=mkp->ibq;
-  else
+  if(p->cp.numthreads>1)
     pthread_barrier_wait(mkp->b);
 
   return NULL;
@@ -347,6 +701,84 @@ mkprof_build(void *inparam)
 
 
 
+/* Distribute `num' profiles between the threads and build them (see
+   `mkprof_build'). */
+static void
+mkprof_build_in_threads(struct mkprofparams *p, long *onaxes, size_t num)
+{
+  int err;
+  pthread_t t;            /* Thread id not used, all are saved here. */
+  pthread_attr_t attr;
+  pthread_barrier_t b;
+  struct mkonthread *mkp;
+  size_t i, *indexs, thrdcols;
+  size_t nt=p->cp.numthreads, nb;
+
+  /* If there is nothing to build, then just return. */
+  if(num==0) return;
+
+  /* Allocate the arrays to keep the thread and parameters for each
+     thread. */
+  errno=0;
+  mkp=malloc(nt*sizeof *mkp);
+  if(mkp==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `mkp'",
+          __func__, (nt-1)*sizeof *mkp);
+
+  /* Distribute the different profiles for different threads (each thread
+     will also add the profiles it builds into the merged image). */
+  gal_threads_dist_in_threads(num, nt, &indexs, &thrdcols);
+
+  /* Build the profiles: */
+  if(nt==1)
+    {
+      mkp[0].p=p;
+      mkp[0].onaxes=onaxes;
+      mkp[0].indexs=indexs;
+      mkp[0].rng=gsl_rng_clone(p->rng);
+      mkprof_build(&mkp[0]);
+    }
+  else
+    {
+      /* Initialize the attributes. Note that this main thread will
+         also have to be kept behind the barrier, so we need nt+1
+         barrier stops. */
+      if(num<nt) nb=num+1;
+      else nb=nt+1;
+      gal_threads_attr_barrier_init(&attr, &b, nb);
+
+      /* Spin off the threads: */
+      for(i=0;i<nt;++i)
+        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
+          {
+            mkp[i].p=p;
+            mkp[i].b=&b;
+            mkp[i].ibq=NULL;
+            mkp[i].onaxes=onaxes;
+            mkp[i].rng=gsl_rng_clone(p->rng);
+            mkp[i].indexs=&indexs[i*thrdcols];
+            err=pthread_create(&t, &attr, mkprof_build, &mkp[i]);
+            if(err)
+              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
+                    __func__, i);
+          }
+
+      /* Wait for all the profiles to be built and added, then destroy
+         the attribute and barrier. */
+      pthread_barrier_wait(&b);
+      pthread_attr_destroy(&attr);
+      pthread_barrier_destroy(&b);
+    }
+
+  /* Clean up. */
+  free(indexs);
+  free(mkp);
+}
+
+
+
+
+
 
 
 
@@ -363,146 +795,372 @@ mkprof_build(void *inparam)
 
 
 /**************************************************************/
-/************              The writer             *************/
+/************          Banded merged image        *************/
 /**************************************************************/
-void
-mkprof_write(struct mkprofparams *p)
+/* With `--bandheight', the merged image is never fully in memory: it is
+   built and written in bands of `p->bandheight' rows (`p->band'). Each
+   band is filled with the profiles that overlap with it (in the order of
+   their IDs, like the full image, so the pixel values are the same) and
+   written into the output before going to the next band.
+
+   The profiles are built in the order of their first row in the image
+   (`p->bandorder'), so when a band is to be filled, all the profiles over
+   it have already been built. A built profile is kept (in
+   `p->bandbuilt') until the band containing its last row is written. So
+   at any moment, only one band and the profiles over it are in
+   memory. */
+
+
+
+
+
+/* The first row of each profile, to sort the profiles. */
+static size_t *mkprof_band_firstrow;
+
+static int
+mkprof_band_sort_row(const void *a, const void *b)
 {
-  double sum;
-  char *jobname;
-  struct timeval t1;
+  size_t ia=*(size_t *)a, ib=*(size_t *)b;
+  size_t ra=mkprof_band_firstrow[ia], rb=mkprof_band_firstrow[ib];
+
+  return ra<rb ? -1 : ( ra>rb ? 1 : ( ia<ib ? -1 : ia>ib ) );
+}
+
+
+
+
+
+static int
+mkprof_band_sort_id(const void *a, const void *b)
+{
+  size_t ia=(*(struct builtqueue **)a)->id;
+  size_t ib=(*(struct builtqueue **)b)->id;
+
+  return ia<ib ? -1 : ia>ib;
+}
+
+
+
+
+
+/* Set the order of building the profiles (`p->bandorder') and return
+   the first row (in C, oversampled) of each profile in that order. The
+   profiles that don't overlap with the image are built with the first
+   band. */
+static size_t *
+mkprof_band_order(struct mkprofparams *p, long *onaxes)
+{
+  size_t i, *firstrow, *sorted;
   long os=p->oversample;
-  int replace=p->replace;
-  gal_data_t *out=p->out, *log;
-  struct builtqueue *ibq=NULL, *tbq;
-  float *to, *from, *colend, *rowend;
-  size_t complete=0, num=p->num, clog;
-  size_t i, j, iw, jw, ii, jj, w=p->naxes[0], ow;
+  struct mkonthread mkp;
+  struct builtqueue bq;
+
+  /* Find the first row of each profile. */
+  mkp.p=p;
+  mkp.ibq=&bq;
+  mkp.onaxes=onaxes;
+  firstrow=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->num);
+  p->bandorder=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->num);
+  for(i=0;i<p->num;++i)
+    {
+      bq.id=p->bandorder[i]=i;
+      mkprof_set_box(&mkp);
+      firstrow[i] = bq.overlaps ? os*(bq.fpixel_i[1]-1) : 0;
+    }
+
+  /* Sort the profiles by their first row (profiles with the same first
+     row stay in the order of their IDs). */
+  mkprof_band_firstrow=firstrow;
+  qsort(p->bandorder, p->num, sizeof *p->bandorder, mkprof_band_sort_row);
 
+  /* Put the first rows in the same order. */
+  sorted=gal_data_malloc_array(GAL_TYPE_SIZE_T, p->num);
+  for(i=0;i<p->num;++i) sorted[i]=firstrow[ p->bandorder[i] ];
+  free(firstrow);
+  return sorted;
+}
+
+
+
+
+
+/* Make the merged image in the output file with all its keywords (like
+   `gal_fits_img_write_to_ptr'), its pixels will be written band by
+   band. */
+static fitsfile *
+mkprof_band_open(struct mkprofparams *p)
+{
+  char *wcsstr;
+  fitsfile *fptr;
+  int nkeyrec, status=0;
+  long naxes[2]={p->naxes[0], p->naxes[1]};
+
+  /* Make the image HDU. */
+  fptr=gal_fits_open_to_write(p->mergedimgname);
+  fits_create_img(fptr, gal_fits_type_to_bitpix(p->cp.type), 2, naxes,
+                  &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Remove the two comment lines put by CFITSIO (they might not exist,
+     so the status is ignored). */
+  fits_delete_key(fptr, "COMMENT", &status);
+  fits_delete_key(fptr, "COMMENT", &status);
+  status=0;
+
+  /* Write the name and units. */
+  fits_write_key(fptr, TSTRING, "EXTNAME", p->out->name, "", &status);
+  fits_write_key(fptr, TSTRING, "BUNIT", p->out->unit, "", &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Write the WCS. */
+  gal_wcs_decompose_pc_cdelt(p->out->wcs);
+  status=wcshdo(WCSHDO_safe, p->out->wcs, &nkeyrec, &wcsstr);
+  if(status)
+    error(EXIT_FAILURE, 0, "%s: wcshdo ERROR %d: %s", __func__,
+          status, wcs_errmsg[status]);
+  gal_fits_key_write_wcsstr(fptr, wcsstr, nkeyrec);
+  free(wcsstr);
+
+  /* Write the version information. */
+  gal_fits_key_write_version(fptr, NULL, PROGRAM_STRING);
+  return fptr;
+}
+
+
+
+
+
+/* Fill the band with the same rows of the background image (when
+   `bptr!=NULL'), or zero. */
+static void
+mkprof_band_read(struct mkprofparams *p, fitsfile *bptr)
+{
+  int anyblank, status=0;
+  float blank=GAL_BLANK_FLOAT32;
+  long fpixel[2]={1, p->bandstart+1};
+
+  if(bptr)
+    {
+      fits_read_pix(bptr, TFLOAT, fpixel, p->band->size, &blank,
+                    p->band->array, &anyblank, &status);
+      gal_fits_io_error(status, NULL);
+    }
+  else
+    memset(p->band->array, 0, p->band->size*sizeof(float));
+}
+
+
+
+
+
+/* Add the built profiles (that are sorted by ID) to the strips of this
+   band that are given to this thread. */
+static void *
+mkprof_band_composite(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct mkprofparams *p=(struct mkprofparams *)tprm->params;
+
+  size_t i, k, s;
+  struct builtqueue *ibq;
 
-  /* Write each image into the output array. */
-  while(complete<p->num)
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
     {
-      /* Set ibq. */
-      if(ibq==NULL)
+      s=tprm->indexs[i];
+      for(k=0;k<p->numbandbuilt;++k)
         {
-          if(p->cp.numthreads==1)
-            ibq=p->bq;
-          else
-            {
-              pthread_mutex_lock(&p->qlock);
-              while(p->bq==NULL)
-                pthread_cond_wait(&p->qready, &p->qlock);
-              ibq=p->bq;
-              p->bq=NULL;
-              pthread_mutex_unlock(&p->qlock);
-            }
+          ibq=p->bandbuilt[k];
+          ibq->stripsum[s] += mkprof_strip_add(p, &p->strips[s], ibq);
         }
-      sum=0.0f;
+    }
+
+  /* Wait for all threads to finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
 
-      /* Write the array pointed to by ibq into the output image. Note
-         that the FITS and C arrays have opposite axis orders and FITS
-         counting starts from 1, not zero. Also fpixel is the first
-         (inclusive) pixel and so is lpixel (it is inclusive). */
-      if(ibq->overlaps && out->array)
-        {
 
-          /* Set the starting and ending points in the complete image. */
-          i  = os * (ibq->fpixel_i[1]-1);
-          j  = os * (ibq->fpixel_i[0]-1);
-
-          /* Set the starting and ending points in the overlapping
-             image. Note that oversampling has already been taken
-             into account in ibq->width. */
-          ow = ibq->imgwidth;
-          ii = os * (ibq->fpixel_o[1]-1);
-          jj = os * (ibq->fpixel_o[0]-1);
-
-          /* Find the width of the overlapping region: */
-          iw = os*(ibq->lpixel_i[1]-ibq->fpixel_i[1]+1);
-          jw = os*(ibq->lpixel_i[0]-ibq->fpixel_i[0]+1);
-
-          /* Write the overlap to the actual image. Instead of writing
-             two for loops and summing all the row and column indexs
-             for every pixel and each image, we use pointer arithmetic
-             which is much more efficient. Just think of one pointer
-             that is advancing over the final image (*to) and one that
-             is advancing over the overlap image (*from). Since we
-             know the images overlap, iw and jw are both smaller than
-             the two image number of columns and number of rows, so
-             w-jw and ow-jw will always be positive. */
-          to = (float *)(out->array) + i*w+j;
-          from=ibq->img+ii*ow+jj;
-          rowend=to+iw*w;
-          do
+/* Write the band into the output with the requested type. */
+static void
+mkprof_band_write(struct mkprofparams *p, fitsfile *fptr, int *anyblank)
+{
+  int status=0;
+  gal_data_t *towrite = ( p->band->type==p->cp.type
+                          ? p->band
+                          : gal_data_copy_to_new_type(p->band,
+                                                      p->cp.type) );
+
+  /* Write the pixels. */
+  fits_write_img(fptr, gal_fits_type_to_datatype(towrite->type),
+                 p->bandstart*p->naxes[0]+1, towrite->size, towrite->array,
+                 &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Integer types need a BLANK keyword if they have blank pixels. */
+  if(towrite->type!=GAL_TYPE_FLOAT32 && towrite->type!=GAL_TYPE_FLOAT64
+     && gal_blank_present(towrite, 0))
+    *anyblank=1;
+
+  /* Clean up. */
+  if(towrite!=p->band) gal_data_free(towrite);
+}
+
+
+
+
+
+/* Build the profiles and write the merged image band by band. */
+static void
+mkprof_bands(struct mkprofparams *p, long *onaxes)
+{
+  void *blank;
+  char *jobname;
+  struct timeval t1;
+  struct builtqueue *ibq;
+  int anyblank=0, status=0;
+  fitsfile *fptr, *bptr=NULL;
+  size_t i, k, nb, end, left, *firstrow;
+  size_t os=p->oversample, rows=p->naxes[1], nbands=0;
+
+  /* Get the current time for verbose output. */
+  if(!p->cp.quiet) gettimeofday(&t1, NULL);
+
+  /* Set the order of the profiles and open the output (and background)
+     images. */
+  firstrow=mkprof_band_order(p, onaxes);
+  fptr=mkprof_band_open(p);
+  if(p->backname && p->clearcanvas==0)
+    bptr=gal_fits_hdu_open_format(p->backname, p->backhdu, 0);
+
+  /* Allocate space to keep the built profiles. */
+  errno=0;
+  p->numbandbuilt=0;
+  p->bandbuilt=malloc(p->num*sizeof *p->bandbuilt);
+  if(p->bandbuilt==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+          "`p->bandbuilt'", __func__, p->num*sizeof *p->bandbuilt);
+
+  /* Go over the bands. */
+  for(p->bandstart=0; p->bandstart<rows; p->bandstart=end)
+    {
+      ++nbands;
+      end = ( p->bandstart+p->bandheight<rows
+              ? p->bandstart+p->bandheight : rows );
+
+      /* Build the profiles that start in this band and sort all the
+         profiles that are over it by their ID. With shifts, the first row
+         of a profile (in the oversampled image without shifts) may be
+         after the last row, so all the remaining profiles are built with
+         the last band. */
+      for(nb=0; p->bandfirst+nb<p->num
+            && (firstrow[p->bandfirst+nb]<end || end==rows); )
+        ++nb;
+      mkprof_build_in_threads(p, onaxes, nb);
+      p->bandfirst+=nb;
+      p->numbandbuilt+=nb;
+      qsort(p->bandbuilt, p->numbandbuilt, sizeof *p->bandbuilt,
+            mkprof_band_sort_id);
+
+      /* Fill the band and write it. */
+      p->band->dsize[0]=end-p->bandstart;
+      p->band->size=p->band->dsize[0]*p->band->dsize[1];
+      mkprof_band_read(p, bptr);
+      mkprof_composite_strips(p, p->bandstart, end);
+      gal_threads_spin_off(mkprof_band_composite, p, p->numstrips,
+                           p->cp.numthreads);
+      mkprof_band_write(p, fptr, &anyblank);
+
+      /* Complete the profiles that don't reach the next band. */
+      for(i=k=0; i<p->numbandbuilt; ++i)
+        {
+          ibq=p->bandbuilt[i];
+          if(ibq->overlaps && os*ibq->lpixel_i[1]>end)
+            p->bandbuilt[k++]=ibq;
+          else
             {
-              /* Go over all the pixels in this row and write this profile
-                 into the final output array. Just note that when
-                 replacing, we don't want to replace those pixels that have
-                 a zero value, since no profile existed there. */
-              colend=to+jw;
-              do
-                {
-                  *to  = ( replace
-                           ? ( *from==0.0f ? *to : *from )
-                           :  *to + *from );
-                  sum += *from;
-                  ++from;
-                }
-              while(++to<colend);
-
-              /* Go to the next row. */
-              to   += w-jw;
-              from += ow-jw;
+              left = p->num - ++p->numcomplete;
+              builtqueue_complete(p, ibq, left);
             }
-          while(to<rowend);
         }
+      p->numbandbuilt=k;
+    }
 
-      /* Fill the log array. */
-      if(p->cp.log)
-        {
-          clog=0;
-          for(log=p->log; log!=NULL; log=log->next)
-            switch(++clog)
-              {
-              case 5:
-                ((unsigned char *)(log->array))[ibq->id] = ibq->indivcreated;
-                break;
-              case 4:
-                ((float *)(log->array))[ibq->id] = ibq->accufrac;
-                break;
-              case 3:
-                ((unsigned long *)(log->array))[ibq->id]=ibq->numaccu;
-                break;
-              case 2:
-                ((float *)(log->array))[ibq->id] =
-                  sum>0.0f ? -2.5f*log10(sum)+p->zeropoint : NAN;
-                break;
-              case 1:
-                ((unsigned long *)(log->array))[ibq->id]=ibq->id+1;
-                break;
-              }
-        }
+  /* The last rows of some profiles may be after the last band (with
+     shifts), so complete any profile that is still kept. */
+  for(i=0; i<p->numbandbuilt; ++i)
+    {
+      left = p->num - ++p->numcomplete;
+      builtqueue_complete(p, p->bandbuilt[i], left);
+    }
+  p->numbandbuilt=0;
 
-      /* Report if in verbose mode. */
-      ++complete;
-      if(!p->cp.quiet)
-        {
-          asprintf(&jobname, "row %zu complete, %zu left to go",
-                  ibq->id, num-complete);
-          gal_timing_report(NULL, jobname, 2);
-          free(jobname);
-        }
+  /* Integer outputs need the BLANK keyword when they have blank
+     pixels. */
+  if(anyblank)
+    {
+      blank=gal_blank_alloc_write(p->cp.type);
+      if(fits_write_key(fptr, gal_fits_type_to_datatype(p->cp.type),
+                        "BLANK", blank, "Pixels with no data.", &status) )
+        gal_fits_io_error(status, "adding the BLANK keyword");
+      free(blank);
+    }
+
+  /* Close the files. */
+  if(bptr && fits_close_file(bptr, &status))
+    gal_fits_io_error(status, NULL);
+  if(fits_close_file(fptr, &status))
+    gal_fits_io_error(status, NULL);
 
-      /* Free the array and the queue element and change it to the next one
-         and increment complete. Note that there is no problem to free a
-         NULL pointer (when the built array didn't overlap). */
-      free(ibq->img);
-      tbq=ibq->next;
-      free(ibq);
-      ibq=tbq;
+  /* In verbose mode, print the information. */
+  if(!p->cp.quiet)
+    {
+      asprintf(&jobname, "%s created (in %zu bands).", p->mergedimgname,
+               nbands);
+      gal_timing_report(&t1, jobname, 1);
+      free(jobname);
     }
 
+  /* Clean up. */
+  free(firstrow);
+  free(p->bandbuilt);
+  free(p->bandorder);
+  p->bandorder=NULL;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/************              The writer             *************/
+/**************************************************************/
+/* All the profiles have been added to the merged image (see
+   `mkprof_composite'), so write it. */
+void
+mkprof_write(struct mkprofparams *p)
+{
+  char *jobname;
+  struct timeval t1;
+  gal_data_t *out=p->out;
+
   /* Write the final array to the output FITS image if a merged image is to
      be created. */
   if(out->array)
@@ -557,80 +1215,69 @@ mkprof_write(struct mkprofparams *p)
 void
 mkprof(struct mkprofparams *p)
 {
-  int err;
   char *tmp;
-  pthread_t t;            /* Thread id not used, all are saved here. */
-  pthread_attr_t attr;
-  pthread_barrier_t b;
-  struct mkonthread *mkp;
-  size_t i, *indexs, thrdcols;
+  size_t i, dsize[2];
+  char **shardnames;
   gal_list_str_t *comments=NULL;
-  size_t nt=p->cp.numthreads, nb;
+  size_t nt=p->cp.numthreads;
   long onaxes[2], os=p->oversample;
 
 
-  /* Allocate the arrays to keep the thread and parameters for each
-     thread. Note that we only want nt-1 threads to do the
-     building. */
-  errno=0;
-  mkp=malloc(nt*sizeof *mkp);
-  if(mkp==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `mkp'",
-          __func__, (nt-1)*sizeof *mkp);
-
-  /* Distribute the different profiles for different threads. Note
-     that one thread is left out for writing, while nt-1 are left
-     for building. */
-  gal_threads_dist_in_threads(p->num, nt, &indexs, &thrdcols);
-
   /* onaxes are sides of the image without over-sampling. */
   onaxes[0] = (p->naxes[0]-2*p->shift[0])/os + 2*p->shift[0]/os;
   onaxes[1] = (p->naxes[1]-2*p->shift[1])/os + 2*p->shift[1]/os;
 
-  /* Build the profiles: */
-  if(nt==1)
+  /* If the individual images should be written as extensions, start the
+     writer. */
+  if(p->shards)
     {
-      mkp[0].p=p;
-      mkp[0].onaxes=onaxes;
-      mkp[0].indexs=indexs;
-      mkp[0].rng=gsl_rng_clone(p->rng);
-      mkprof_build(&mkp[0]);
+      errno=0;
+      shardnames=malloc(p->shards*sizeof *shardnames);
+      if(shardnames==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+              "`shardnames'", __func__, p->shards*sizeof *shardnames);
+      for(i=0;i<p->shards;++i)
+        if(p->shards==1)
+          asprintf(&shardnames[i], "%sall_%s", p->outdir, p->basename);
+        else
+          asprintf(&shardnames[i], "%sall%zu_%s", p->outdir, i+1,
+                   p->basename);
+      p->multiext=gal_multiext_start(shardnames, p->shards, p->num,
+                                     SHARD_WINDOW*nt, p->cp.dontdelete);
     }
-  else
+
+  /* In banded mode, allocate the band. */
+  if(p->bandheight)
     {
-      /* Initialize the attributes. Note that this main thread will
-         also have to be kept behind the barrier, so we need nt+1
-         barrier stops. */
-      if(p->num<nt) nb=p->num+1;
-      else nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
+      dsize[0] = ( p->bandheight<(size_t)p->naxes[1]
+                   ? p->bandheight : (size_t)p->naxes[1] );
+      dsize[1] = p->naxes[0];
+      p->band=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 2, dsize, NULL, 0,
+                             p->cp.minmapsize, NULL, NULL, NULL);
+    }
 
-      /* Initialize the condition variable and mutex. */
-      err=pthread_mutex_init(&p->qlock, NULL);
-      if(err) error(EXIT_FAILURE, 0, "%s: mutex not initialized", __func__);
-      err=pthread_cond_init(&p->qready, NULL);
-      if(err) error(EXIT_FAILURE, 0, "%s: condition variable not initialized",
-                    __func__);
+  /* Prepare the cache of built profiles and the strips of the merged
+     image. */
+  oneprofile_cache_init(p);
+  mkprof_composite_init(p);
 
-      /* Spin off the threads: */
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            mkp[i].p=p;
-            mkp[i].b=&b;
-            mkp[i].ibq=NULL;
-            mkp[i].onaxes=onaxes;
-            mkp[i].rng=gsl_rng_clone(p->rng);
-            mkp[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, mkprof_build, &mkp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
-                    __func__, i);
-          }
+  /* Build the profiles and write the merged image: in banded mode, the
+     merged image is written while the profiles are being built. */
+  if(p->band)
+    mkprof_bands(p, onaxes);
+  else
+    {
+      mkprof_build_in_threads(p, onaxes, p->num);
+      mkprof_write(p);
     }
 
-  /* Write the created arrays into the image. */
-  mkprof_write(p);
+  /* Write the remaining individual images and the index of the
+     extensions. */
+  if(p->multiext)
+    {
+      gal_multiext_finish(p->multiext);
+      p->multiext=NULL;
+    }
 
   /* Write the log file. */
   if(p->cp.log)
@@ -642,18 +1289,13 @@ mkprof(struct mkprofparams *p)
       gal_list_str_free(comments, 1);
     }
 
-  /* If numthreads>1, then wait for all the jobs to finish and destroy
-     the attribute and barrier. */
-  if(nt>1)
+  /* Free the allocated spaces. */
+  mkprof_composite_free(p);
+  oneprofile_cache_free(p);
+  if(p->band)
     {
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
-      pthread_cond_destroy(&p->qready);
-      pthread_mutex_destroy(&p->qlock);
+      gal_data_free(p->band);
+      gal_data_free(p->out);
+      p->band=NULL;
     }
-
-  /* Free the allocated spaces. */
-  free(mkp);
-  free(indexs);
 }
@@ -72,7 +72,7 @@ struct mkonthread
   struct mkprofparams  *p;   /* Pointer to the main.h structure.      */
   size_t          *indexs;   /* Indexs to build on this thread.       */
   pthread_barrier_t    *b;   /* Pthread barrier pointer.              */
-  struct builtqueue  *ibq;   /* Internally built queue.               */
+  struct builtqueue  *ibq;   /* Profile that is being built.          */
 };
 
 
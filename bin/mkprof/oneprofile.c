@@ -26,12 +26,12 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <string.h>
 #include <stdlib.h>
 
 #include <sys/time.h>            /* generate random seed */
 #include <gsl/gsl_rng.h>         /* used in setrandoms   */
 #include <gsl/gsl_randist.h>     /* To make noise.       */
-#include <gsl/gsl_integration.h> /* gsl_integration_qng  */
 
 #include <gnuastro/fits.h>
 #include <gnuastro/dimension.h>
@@ -99,11 +99,16 @@ r_circle(size_t p, struct mkonthread *mkp)
 /****************************************************************
  **************          Random points         ******************
  ****************************************************************/
-/* Fill pixel with random values */
+/* Fill pixel with random values. With `--quasirandom', the points are
+   the (fixed) quasi-random points that were generated once for all the
+   pixels (see `ui_make_quasirandom'). Unlike pseudo-random points, they
+   cover the pixel evenly, so the average converges faster. Since they are
+   only read, all the threads can use them. */
 float
 randompoints(struct mkonthread *mkp)
 {
   double xrange, yrange, sum=0.0f;
+  double *qr=mkp->p->qrpoints, *qrf;
   size_t i, numrandom=mkp->p->numrandom;
 
   /* Set the range of the x and y: */
@@ -111,13 +116,26 @@ randompoints(struct mkonthread *mkp)
   yrange=mkp->yh-mkp->yl;
 
   /* Find the sum of the profile on the random positions */
-  for(i=0;i<numrandom;++i)
+  if(qr)
     {
-      mkp->x = mkp->xl + gsl_rng_uniform(mkp->rng)*xrange;
-      mkp->y = mkp->yl + gsl_rng_uniform(mkp->rng)*yrange;
-      r_el(mkp);
-      sum+=mkp->profile(mkp);
+      qrf=qr+2*numrandom;
+      do
+        {
+          mkp->x = mkp->xl + qr[0]*xrange;
+          mkp->y = mkp->yl + qr[1]*yrange;
+          r_el(mkp);
+          sum+=mkp->profile(mkp);
+        }
+      while( (qr+=2)<qrf );
     }
+  else
+    for(i=0;i<numrandom;++i)
+      {
+        mkp->x = mkp->xl + gsl_rng_uniform(mkp->rng)*xrange;
+        mkp->y = mkp->yl + gsl_rng_uniform(mkp->rng)*yrange;
+        r_el(mkp);
+        sum+=mkp->profile(mkp);
+      }
 
   return sum/numrandom;
 }
@@ -141,93 +159,203 @@ randompoints(struct mkonthread *mkp)
 
 
 
-/****************************************************************
- *****************      2D integration       ********************
- ****************************************************************/
-/* This function is used in the integration of a profile. It
-   assumes a fixed y and integrates over a range of x values.  */
-double
-twod_over_x(double x, void *params)
+/**************************************************************/
+/************       Pixel by pixel building       *************/
+/*********        Positions are in C not FITS         *********/
+/**************************************************************/
+/* Return 1 if the pixel on row `row' and column `col' (in the C order) of
+   the profile's image is within the truncation radius. */
+static int
+oneprofile_inside(struct mkonthread *mkp, size_t row, long col)
 {
-  struct mkonthread *mkp=(struct mkonthread *) params;
+  double os=mkp->p->oversample;
 
-  mkp->x=x;
+  mkp->x=(row-mkp->xc)/os;
+  mkp->y=((size_t)col-mkp->yc)/os;
   r_el(mkp);
-  return mkp->profile(mkp);
+  return !(mkp->r>mkp->truncr);
 }
 
 
 
 
 
-/* Find the 2d integration over the region. */
-double
-twod_over_xy(double y, void *params)
-{
-  gsl_function F;
-  static double abserr;
-  static size_t neval=0;
-  double epsabs=0, epsrel=EPSREL_FOR_INTEG, result;
-  struct mkonthread *mkp=(struct mkonthread *) params;
-
-  F.function = &twod_over_x;
-  F.params = params;
-
-  mkp->y=y;
-  gsl_integration_qng(&F, mkp->xl, mkp->xh, epsabs, epsrel,
-                      &result, &abserr, &neval);
-  return result;
-}
+/* The pixels of each row (first C axis) that are within the truncation
+   radius are contiguous, so they can be found from the two points where
+   the row crosses the truncation ellipse. If `x' and `y' are the
+   distances from the center along the row and column (both divided by
+   the oversampling factor), `r_el' is a quadratic in `y':
 
+       r^2 = A*y^2 + B*y + C
 
+   To be exactly the same as checking each pixel with `r_el' (as was done
+   before), the two ends are then checked (and moved if necessary) with
+   `r_el'. If no pixel of this row is within the truncation radius, this
+   function will return 0. */
+static int
+oneprofile_row_span(struct mkonthread *mkp, size_t row, size_t *first,
+                    size_t *last)
+{
+  long lo, hi, mid, is1=mkp->width[0];
+  double c=mkp->c, s=mkp->s, q=mkp->q, os=mkp->p->oversample;
+  double A, B, C, D, m, x=(row-mkp->xc)/os, truncr=mkp->truncr;
+
+  /* Coefficients of the quadratic and its discriminant. */
+  A = s*s + c*c/q/q;
+  B = 2*x*c*s*(1-1/q/q);
+  C = x*x*(c*c + s*s/q/q) - truncr*truncr;
+  D = B*B - 4*A*C;
+
+  /* The pixel nearest to the smallest radius on this row. */
+  m = mkp->yc - os*B/(2*A);
+  m = isfinite(m) ? m : mkp->yc;
+  mid = m<0 ? 0 : ( m>is1-1 ? is1-1 : lround(m) );
+
+  /* Estimate the two ends from the roots of the quadratic. */
+  if(D>=0)
+    {
+      m  = mkp->yc + os*(-B-sqrt(D))/(2*A);
+      lo = m<0 ? 0 : ( m>is1 ? is1 : ceil(m) );
+      m  = mkp->yc + os*(-B+sqrt(D))/(2*A);
+      hi = m<0 ? -1 : ( m>is1-1 ? is1-1 : floor(m) );
+    }
+  else { lo=mid; hi=mid-1; }
 
+  /* Correct the ends with the radius of each pixel. */
+  while(lo<=hi && oneprofile_inside(mkp, row, lo)==0) ++lo;
+  while(hi>=lo && oneprofile_inside(mkp, row, hi)==0) --hi;
+  if(lo>hi)
+    {
+      if( oneprofile_inside(mkp, row, mid) ) lo=hi=mid;
+      else return 0;
+    }
+  while(lo>0     && oneprofile_inside(mkp, row, lo-1)) --lo;
+  while(hi<is1-1 && oneprofile_inside(mkp, row, hi+1)) ++hi;
 
-/* 2D integration of a profile.*/
-double
-integ2d(struct mkonthread *mkp)
-{
-  gsl_function F;
-  static double abserr;
-  static size_t neval=0;
-  double epsabs=0, epsrel=EPSREL_FOR_INTEG, result;
-
-  F.function = &twod_over_xy;
-  F.params = mkp;
-  gsl_integration_qng(&F, mkp->yl, mkp->yh, epsabs,
-                      epsrel, &result, &abserr, &neval);
-  return result;
+  /* Return the span. */
+  *first=lo;
+  *last=hi;
+  return 1;
 }
 
 
 
 
 
+/* For the circumference, if the profile is too elongated and
+   circumwidth is too small, then some parts of the circumference will
+   not be shown if the neighbors of the pixels within the truncation
+   radius aren't also given a value. */
+static void
+oneprofile_circum_pixel(struct mkonthread *mkp, size_t row, size_t col)
+{
+  double os=mkp->p->oversample;
 
+  mkp->x=(row-mkp->xc)/os;
+  mkp->y=(col-mkp->yc)/os;
+  r_el(mkp);
+  mkp->ibq->img[ row*mkp->width[0]+col ] = mkp->profile(mkp);
+}
 
 
 
 
 
+/* Fill all the pixels that don't need random points: those within the
+   truncation radius that are connected (with 4-connectivity) to the
+   central pixel (`pc'). Each row is a single span of pixels (see
+   `oneprofile_row_span'), and two neighboring rows are connected when
+   their spans overlap. So starting from the central row, we go up and
+   down until a row's span is empty or doesn't overlap with the row
+   before it. Pixels that were already filled with random points have a
+   value of 2 in `byt'.
 
+   The radius of each pixel is found on its own (not by adding to the
+   radius of the pixel before it), so the values are exactly the same as
+   checking the pixels one by one. */
+static void
+makepixbyrow(struct mkonthread *mkp, uint8_t *byt, size_t pc, int ispeak)
+{
+  float *img=mkp->ibq->img;
+  size_t *first, *last, f, l, p, pf, row, col, top, bottom;
+  double xc=mkp->xc, yc=mkp->yc, os=mkp->p->oversample;
+  double (*profile)(struct mkonthread *)=mkp->profile;
+  size_t is1=mkp->width[0], is0=mkp->width[1], crow=pc/is1, ccol=pc%is1;
+  int circum = mkp->func==PROFILE_CIRCUMFERENCE;
 
+  /* If the central pixel isn't within the truncation radius, no other
+     pixel will be connected to it. */
+  if( oneprofile_row_span(mkp, crow, &f, &l)==0 || ccol<f || ccol>l )
+    {
+      if(circum) oneprofile_circum_pixel(mkp, crow, ccol);
+      return;
+    }
 
+  /* Find the rows that are connected to the central row and their
+     spans. */
+  first=gal_data_malloc_array(GAL_TYPE_SIZE_T, is0);
+  last=gal_data_malloc_array(GAL_TYPE_SIZE_T, is0);
+  top=bottom=crow;
+  first[crow]=f;
+  last[crow]=l;
+  while( top>0 && oneprofile_row_span(mkp, top-1, &f, &l)
+         && f<=last[top] && l>=first[top] )
+    { --top; first[top]=f; last[top]=l; }
+  while( bottom<is0-1 && oneprofile_row_span(mkp, bottom+1, &f, &l)
+         && f<=last[bottom] && l>=first[bottom] )
+    { ++bottom; first[bottom]=f; last[bottom]=l; }
+
+  /* Fill the pixels of each span. */
+  for(row=top; row<=bottom; ++row)
+    {
+      mkp->x=(row-xc)/os;
+      pf=row*is1+last[row];
+      for(p=row*is1+first[row]; p<=pf; ++p)
+        if(byt[p]!=2)
+          {
+            mkp->y=(p%is1-yc)/os;
+            r_el(mkp);
+            img[p]=profile(mkp);
+
+            /* When no pixel was filled with random points, the central
+               pixel is the peak. */
+            if(ispeak && p==pc) mkp->peakflux=img[p];
+          }
+    }
+
+  /* For the circumference, also fill the neighbors of the spans that
+     are outside the truncation radius. */
+  if(circum)
+    for(row=top; row<=bottom; ++row)
+      {
+        if(first[row]>0)   oneprofile_circum_pixel(mkp, row, first[row]-1);
+        if(last[row]<is1-1) oneprofile_circum_pixel(mkp, row, last[row]+1);
+        for(col=first[row]; col<=last[row]; ++col)
+          {
+            if( row>0 && ( row==top || col<first[row-1]
+                           || col>last[row-1] ) )
+              oneprofile_circum_pixel(mkp, row-1, col);
+            if( row<is0-1 && ( row==bottom || col<first[row+1]
+                               || col>last[row+1] ) )
+              oneprofile_circum_pixel(mkp, row+1, col);
+          }
+      }
 
+  /* Clean up. */
+  free(first);
+  free(last);
+}
 
 
 
 
 
-/**************************************************************/
-/************       Pixel by pixel building       *************/
-/*********        Positions are in C not FITS         *********/
-/**************************************************************/
 static void
 makepixbypix(struct mkonthread *mkp)
 {
   size_t ndim=2, dsize[2]={mkp->width[1], mkp->width[0]};
 
   uint8_t *byt;
-  gal_list_sizet_t *Q=NULL;
   int use_rand_points=1, ispeak=1;
   struct builtqueue *ibq=mkp->ibq;
   float circ_r, *img=mkp->ibq->img;
@@ -238,8 +366,8 @@ makepixbypix(struct mkonthread *mkp)
   size_t p, x, y, is1=mkp->width[0], is0=mkp->width[1];
   double truncr=mkp->truncr, approx, hp=0.5f/mkp->p->oversample;
 
-  /* lQ: Largest. sQ: Smallest in queue */
-  gal_list_dosizet_t *lQ=NULL, *sQ;
+  /* Queue of pixels to check, ordered by distance from the center. */
+  gal_list_hsizet_t heap;
 
   /* Find the nearest pixel to the profile center and add it to the
      queue. */
@@ -254,35 +382,32 @@ makepixbypix(struct mkonthread *mkp)
     { img[p]=1; return; }
 
   /* Allocate the byt array to not repeat completed pixels. */
-  byt = gal_data_malloc_array(GAL_TYPE_UINT8, is0*is1);
+  byt = gal_data_calloc_array(GAL_TYPE_UINT8, is0*is1);
 
   /* Start the queue: */
   byt[p]=1;
-  gal_list_dosizet_add( &lQ, &sQ, p, r_circle(p, mkp) );
+  gal_list_hsizet_init(&heap, 0);
+  gal_list_hsizet_add(&heap, p, r_circle(p, mkp));
 
   /* If random points are necessary, then do it: */
   if(mkp->func==PROFILE_SERSIC || mkp->func==PROFILE_MOFFAT
      || mkp->func==PROFILE_GAUSSIAN)
     {
-      while(sQ)
+      while(heap.num)
         {
-          /* In case you want to see the status of the twosided ordered
-             queue, increasing and decreasing side by side, uncomment this
-             line. Note that there will be a lot of lines printed! */
-          /*print_tossll(lQ, sQ);*/
-
           /* Pop the pixel from the queue and check if it is within the
              truncation radius. Note that `xc` and `p` both belong to the
              over sampled image. But all the profile parameters are in the
              non-oversampled image. So we divide the distance by os
              (p->oversample in double type) */
-          p=gal_list_dosizet_pop_smallest(&lQ, &sQ, &circ_r);
+          p=gal_list_hsizet_pop_smallest(&heap, &circ_r);
           mkp->x=(p/is1-xc)/os;
           mkp->y=(p%is1-yc)/os;
           r_el(mkp);
           if(mkp->r>truncr) continue;
 
-          /* Find the value for this pixel: */
+          /* Find the value for this pixel (and mark it as done): */
+          byt[p]=2;
           mkp->xl=mkp->x-hp;
           mkp->xh=mkp->x+hp;
           mkp->yl=mkp->y-hp;
@@ -312,7 +437,7 @@ makepixbypix(struct mkonthread *mkp)
               if(byt[nind]==0)
                 {
                   byt[nind]=1;
-                  gal_list_dosizet_add( &lQ, &sQ, nind, r_circle(nind, mkp) );
+                  gal_list_hsizet_add(&heap, nind, r_circle(nind, mkp));
                 }
             } );
 
@@ -321,44 +446,12 @@ makepixbypix(struct mkonthread *mkp)
     }
 
 
-  /* All the pixels that required integration or random points are now
-     done, so we don't need an ordered array any more. */
-  gal_list_dosizet_to_sizet(lQ, &Q);
-
-
-  /* Order doesn't matter any more, add all the pixels you find. */
-  while(Q)
-    {
-      p=gal_list_sizet_pop(&Q);
-      mkp->x=(p/is1-xc)/os;
-      mkp->y=(p%is1-yc)/os;
-      r_el(mkp);
-      if(mkp->r>truncr)
-        {
-          /* For the circumference, if the profile is too elongated
-             and circumwidth is too small, then some parts of the
-             circumference will not be shown without this condition. */
-          if(mkp->func==PROFILE_CIRCUMFERENCE) img[p]=profile(mkp);
-          continue;
-        }
-
-      /* Find the value for this pixel: */
-      img[p]=profile(mkp);
+  /* All the pixels that required random points are now done, so we
+     don't need an ordered array any more: the rest of the pixels can be
+     found row by row. */
+  gal_list_hsizet_free(&heap);
+  makepixbyrow(mkp, byt, x*is1+y, ispeak);
 
-      /* Save the peak flux if this is the first pixel: */
-      if(ispeak) { mkp->peakflux=img[p]; ispeak=0; }
-
-      /* Go over the neighbours and add them to queue of elements
-         to check. */
-      GAL_DIMENSION_NEIGHBOR_OP(p, ndim, dsize, 1, dinc,
-        {
-          if(byt[nind]==0)
-            {
-              byt[nind]=1;
-              gal_list_sizet_add(&Q, nind);
-            }
-        } );
-    }
 
   /* Clean up. */
   free(byt);
@@ -396,7 +489,9 @@ oneprofile_ispsf(int fcode)
 
 
 
-/* About the shifts on the X column and y column:*/
+/* Set the parameters of this profile (in `mkp') from the catalog. Note
+   that the shifts have already been applied to the centers (see
+   `ui_finalize_coordinates'). */
 void
 oneprof_set_prof_params(struct mkonthread *mkp)
 {
@@ -407,8 +502,6 @@ oneprof_set_prof_params(struct mkonthread *mkp)
   size_t id=mkp->ibq->id;
 
   /* Fill in the profile independant parameters. */
-  p->x[id]       += p->shift[0]/p->oversample; /* Shifts were multiplied by */
-  p->y[id]       += p->shift[1]/p->oversample; /* `p->oversample' before.   */
   mkp->c          = cos( (90-p->p[id]) * DEGREESTORADIANS );
   mkp->s          = sin( (90-p->p[id]) * DEGREESTORADIANS );
   mkp->q          = p->q[id];
@@ -535,6 +628,224 @@ oneprof_set_prof_params(struct mkonthread *mkp)
 
 
 
+/**************************************************************/
+/************          Profile cache              *************/
+/**************************************************************/
+/* Building the Sersic, Moffat and Gaussian profiles (with the Monte Carlo
+   integration of their central pixels) is expensive. However, in many
+   mock catalogs, a large number of rows have the same profile parameters
+   and only differ in their position and magnitude. Before its brightness
+   is set, a profile only depends on its parameters and on the sub-pixel
+   position of its center (which is binned, see `--centerbins') and the
+   random points of its central pixels. So when a profile is built, a copy
+   is kept in the cache and any later profile with the same parameters and
+   center will just copy it (when its random points are also the same).
+
+   The cache is a hash table: `CACHE_NUM_LISTS' lists of profiles. Once a
+   profile is in the cache, it isn't changed or removed until the end, so
+   it can be read after the lock is released. To keep the memory bounded,
+   no more profiles are added after `CACHE_MAX_BYTES' is used. */
+void
+oneprofile_cache_init(struct mkprofparams *p)
+{
+  int err;
+
+  /* Allocate the lists. */
+  errno=0;
+  p->cachebytes=0;
+  p->cache=calloc(CACHE_NUM_LISTS, sizeof *p->cache);
+  if(p->cache==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `p->cache'",
+          __func__, CACHE_NUM_LISTS*sizeof *p->cache);
+
+  /* Initialize the mutex. */
+  err=pthread_mutex_init(&p->cachelock, NULL);
+  if(err) error(EXIT_FAILURE, 0, "%s: mutex not initialized", __func__);
+}
+
+
+
+
+
+void
+oneprofile_cache_free(struct mkprofparams *p)
+{
+  size_t i;
+  struct proftemplate *tmpl, *tmp;
+
+  for(i=0;i<CACHE_NUM_LISTS;++i)
+    for(tmpl=p->cache[i]; tmpl!=NULL; tmpl=tmp)
+      {
+        tmp=tmpl->next;
+        free(tmpl->img);
+        free(tmpl);
+      }
+  free(p->cache);
+  pthread_mutex_destroy(&p->cachelock);
+}
+
+
+
+
+
+/* Fill the parameters of the current profile into `key' and return the
+   index of its list in the cache. If this profile shouldn't use the cache,
+   return `GAL_BLANK_SIZE_T'. */
+static size_t
+oneprofile_cache_key(struct mkonthread *mkp, struct proftemplate *key)
+{
+  struct mkprofparams *p=mkp->p;
+
+  size_t i, id=mkp->ibq->id;
+  unsigned char *c, *cf;
+  uint32_t hash=2166136261U;
+  void *fields[]={&key->func, &key->r, &key->n, &key->p, &key->q,
+                  &key->t, &key->xc, &key->yc};
+  size_t sizes[]={sizeof key->func, sizeof key->r, sizeof key->n,
+                  sizeof key->p, sizeof key->q, sizeof key->t,
+                  sizeof key->xc, sizeof key->yc};
+
+  /* Only the expensive profiles are cached. */
+  if(mkp->func!=PROFILE_SERSIC && mkp->func!=PROFILE_MOFFAT
+     && mkp->func!=PROFILE_GAUSSIAN)
+    return GAL_BLANK_SIZE_T;
+
+  /* Without `--envseed', every profile uses different random points, so
+     a copy of an earlier profile isn't the same. With `--envseed' (or
+     with the fixed quasi-random points) all profiles use the same points
+     and the copy is identical to building it again. */
+  if(p->envseed==0 && p->qrpoints==NULL)
+    return GAL_BLANK_SIZE_T;
+
+  /* Set the parameters. */
+  key->func=mkp->func;
+  key->r=p->r[id];
+  key->n=p->n[id];
+  key->p=p->p[id];
+  key->q=p->q[id];
+  key->t=p->t[id];
+  key->xc=mkp->xc;
+  key->yc=mkp->yc;
+
+  /* Find the hash of the parameters (FNV-1a). */
+  for(i=0;i<sizeof sizes/sizeof *sizes;++i)
+    {
+      cf=(c=fields[i])+sizes[i];
+      do { hash^=*c; hash*=16777619U; } while(++c<cf);
+    }
+  return hash%CACHE_NUM_LISTS;
+}
+
+
+
+
+
+/* Return the profile in the cache with the same parameters as `key', or
+   NULL if there is none. Note that the lock has to be held when this is
+   called. */
+static struct proftemplate *
+oneprofile_cache_search(struct mkprofparams *p, struct proftemplate *key,
+                        size_t list)
+{
+  struct proftemplate *tmpl;
+
+  for(tmpl=p->cache[list]; tmpl!=NULL; tmpl=tmpl->next)
+    if( tmpl->func==key->func && tmpl->r==key->r && tmpl->n==key->n
+        && tmpl->p==key->p && tmpl->q==key->q && tmpl->t==key->t
+        && tmpl->xc==key->xc && tmpl->yc==key->yc )
+      return tmpl;
+  return NULL;
+}
+
+
+
+
+
+/* If a profile with the same parameters is already built, copy it into
+   this profile's image and return 1. Otherwise, return 0. */
+static int
+oneprofile_cache_get(struct mkonthread *mkp, struct proftemplate *key,
+                     size_t list, size_t size)
+{
+  struct mkprofparams *p=mkp->p;
+  struct proftemplate *tmpl;
+
+  /* Find the profile. */
+  pthread_mutex_lock(&p->cachelock);
+  tmpl=oneprofile_cache_search(p, key, list);
+  pthread_mutex_unlock(&p->cachelock);
+  if(tmpl==NULL || tmpl->size!=size) return 0;
+
+  /* Copy it. */
+  memcpy(mkp->ibq->img, tmpl->img, size*sizeof *tmpl->img);
+  mkp->peakflux=tmpl->peakflux;
+  mkp->ibq->numaccu=tmpl->numaccu;
+  mkp->ibq->accufrac=tmpl->accufrac;
+  mkp->ibq->fromcache=1;
+  return 1;
+}
+
+
+
+
+
+/* Keep a copy of the profile that was just built in the cache (unless
+   another thread has already added the same profile or the cache is
+   full). */
+static void
+oneprofile_cache_add(struct mkonthread *mkp, struct proftemplate *key,
+                     size_t list, size_t size)
+{
+  struct mkprofparams *p=mkp->p;
+
+  struct proftemplate *tmpl;
+  size_t bytes=size*sizeof *tmpl->img + sizeof *tmpl;
+
+  pthread_mutex_lock(&p->cachelock);
+  if( p->cachebytes+bytes<=CACHE_MAX_BYTES
+      && oneprofile_cache_search(p, key, list)==NULL )
+    {
+      /* Make the copy. */
+      errno=0;
+      tmpl=malloc(sizeof *tmpl);
+      if(tmpl==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `tmpl'",
+              __func__, sizeof *tmpl);
+      *tmpl=*key;
+      tmpl->size=size;
+      tmpl->peakflux=mkp->peakflux;
+      tmpl->numaccu=mkp->ibq->numaccu;
+      tmpl->accufrac=mkp->ibq->accufrac;
+      tmpl->img=gal_data_malloc_array(GAL_TYPE_FLOAT32, size);
+      memcpy(tmpl->img, mkp->ibq->img, size*sizeof *tmpl->img);
+
+      /* Add it to the list. */
+      tmpl->next=p->cache[list];
+      p->cache[list]=tmpl;
+      p->cachebytes+=bytes;
+    }
+  pthread_mutex_unlock(&p->cachelock);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /**************************************************************/
 /************          Outside functions          *************/
 /**************************************************************/
@@ -544,9 +855,11 @@ oneprofile_make(struct mkonthread *mkp)
   struct mkprofparams *p=mkp->p;
 
   float *f, *ff;
+  size_t size, list;
   long os=p->oversample;
+  struct proftemplate key;
   double sum, pixfrac, intpart;
-  size_t size, id=mkp->ibq->id;
+  size_t id=mkp->ibq->id, bins=p->centerbins;
 
 
   /* Find the profile center (see comments above
@@ -554,12 +867,12 @@ oneprofile_make(struct mkonthread *mkp)
   pixfrac = modf(fabs(p->x[id]), &intpart);
   mkp->yc = ( os * (mkp->width[0]/2 + pixfrac)
               + (pixfrac<0.50f ? os/2 : -1*os/2-1) );
-  mkp->yc = round(mkp->yc*100)/100;
+  mkp->yc = round(mkp->yc*bins)/bins;
 
   pixfrac = modf(fabs(p->y[id]), &intpart);
   mkp->xc = ( os*(mkp->width[1]/2 + pixfrac)
               + (pixfrac<0.5f ? os/2 : -1*os/2-1) );
-  mkp->xc = round(mkp->xc*100)/100;
+  mkp->xc = round(mkp->xc*bins)/bins;
 
 
   /* From this point on, the widths are the actual pixel
@@ -579,8 +892,17 @@ oneprofile_make(struct mkonthread *mkp)
           size*sizeof *mkp->ibq->img, mkp->ibq->id, p->catname);
 
 
-  /* Build the profile in the image. */
-  makepixbypix(mkp);
+  /* Build the profile in the image: if a profile with the same parameters
+     has already been built, just copy it. Otherwise, build it and keep a
+     copy in the cache for later profiles. */
+  list=oneprofile_cache_key(mkp, &key);
+  if( list==GAL_BLANK_SIZE_T )
+    makepixbypix(mkp);
+  else if( oneprofile_cache_get(mkp, &key, list, size)==0 )
+    {
+      makepixbypix(mkp);
+      oneprofile_cache_add(mkp, &key, list, size);
+    }
 
 
   /* Correct the sum of pixels in the profile so it has the fixed total
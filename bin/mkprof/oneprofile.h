@@ -34,4 +34,10 @@ oneprof_set_prof_params(struct mkonthread *mkp);
 void
 oneprofile_make(struct mkonthread *mkp);
 
+void
+oneprofile_cache_init(struct mkprofparams *p);
+
+void
+oneprofile_cache_free(struct mkprofparams *p);
+
 #endif
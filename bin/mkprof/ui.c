@@ -28,6 +28,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <string.h>
 
+#include <gsl/gsl_qrng.h>
+
 #include <gnuastro/wcs.h>
 #include <gnuastro/box.h>
 #include <gnuastro/fits.h>
@@ -240,6 +242,16 @@ ui_read_check_only_options(struct mkprofparams *p)
     error(EXIT_FAILURE, 0, "an output type `--type' is necessary when a "
           "merged image is to be built.");
 
+  /* Writing the profiles as extensions is only for individual profiles. */
+  if( p->shards && p->individual==0 )
+    error(EXIT_FAILURE, 0, "`--shards' is only relevant with "
+          "`--individual'");
+
+  /* The bands are only for the merged image. */
+  if( p->bandheight && p->nomerged )
+    error(EXIT_FAILURE, 0, "`--bandheight' is only relevant when a merged "
+          "image is built (it can't be called with `--nomerged')");
+
   /* Check if one of the coordinate columns has been given, the other is
      also given. To simplify the job, we use the fact that conditions in C
      return either a 0 (when failed) and 1 (when successful). Note that if
@@ -396,7 +408,8 @@ ui_read_cols(struct mkprofparams *p)
 
   /* Read the desired columns from the file. */
   cols=gal_table_read(p->catname, p->cp.hdu, colstrs, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads, p->cp.minmapsize,
+                      NULL);
 
   /* Set the number of objects. */
   p->num=cols->size;
@@ -583,6 +596,52 @@ ui_prepare_wcs(struct mkprofparams *p)
 
 
 
+/* In banded mode, the background image is only read one band at a time
+   while the merged image is being written (see `mkprof_bands'). So here,
+   we only need its size and units. */
+static void
+ui_prepare_canvas_banded(struct mkprofparams *p)
+{
+  char **str;
+  fitsfile *fptr;
+  int status=0, type;
+  gal_data_t *keysll=NULL;
+  size_t ndim, *dsize, dsize_key=1;
+
+  /* Read the size of the background image. */
+  fptr=gal_fits_hdu_open_format(p->backname, p->backhdu, 0);
+  gal_fits_img_info(fptr, &type, &ndim, &dsize);
+  if(ndim!=2)
+    error(EXIT_FAILURE, 0, "%s (hdu: %s): the background image has %zu "
+          "dimensions, it must be 2 dimensional", p->backname, p->backhdu,
+          ndim);
+  p->naxes[0]=dsize[1];
+  p->naxes[1]=dsize[0];
+
+  /* Make the output structure (without any array), and keep the units of
+     the background image if they are given. */
+  p->out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 0, dsize, NULL, 1,
+                        p->cp.minmapsize, NULL, NULL, NULL);
+  gal_list_data_add_alloc(&keysll, NULL, GAL_TYPE_STRING, 1, &dsize_key,
+                          NULL, 0, -1, "BUNIT", NULL, NULL);
+  gal_fits_key_read_from_ptr(fptr, keysll, 0, 0);
+  if(keysll->status==0)
+    {
+      str=keysll->array;
+      gal_checkset_allocate_copy(*str, &p->out->unit);
+    }
+
+  /* Clean up. */
+  gal_list_data_free(keysll);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+  free(dsize);
+}
+
+
+
+
+
 static void
 ui_prepare_canvas(struct mkprofparams *p)
 {
@@ -607,6 +666,8 @@ ui_prepare_canvas(struct mkprofparams *p)
       if(p->nomerged)
         p->out=gal_data_alloc(NULL, GAL_TYPE_FLOAT32, 0, dsize, NULL,
                               1, p->cp.minmapsize, NULL, NULL, NULL);
+      else if(p->bandheight)
+        ui_prepare_canvas_banded(p);
       else
         {
           /* Read the image. */
@@ -701,7 +762,10 @@ ui_prepare_canvas(struct mkprofparams *p)
           p->naxes[1] = (p->naxes[1] * p->oversample) + (2 * p->shift[1]);
           dsize[0]    = p->naxes[1];
           dsize[1]    = p->naxes[0];
-          ndim        = 2;
+
+          /* In banded mode, the merged image is never fully in memory
+             (see `mkprof_bands'), only its size is necessary. */
+          ndim        = p->bandheight ? 0 : 2;
         }
 
       /* Make the output structure. */
@@ -718,7 +782,7 @@ ui_prepare_canvas(struct mkprofparams *p)
   /* Set the name, comments and units of the output structure/file. Note
      that when no merged image is to be created, the array in `p->out' will
      be NULL.*/
-  if(p->out->array)
+  if(p->out->array || p->bandheight)
     {
       if(p->out->name) free(p->out->name);
       gal_checkset_allocate_copy("Mock profiles", &p->out->name);
@@ -759,7 +823,8 @@ ui_finalize_coordinates(struct mkprofparams *p)
       /* Note that we read the RA and Dec columns into the `p->x' and `p->y'
          arrays temporarily before. Here, we will convert them, free the old
          ones and replace them with the proper X and Y values. */
-      gal_wcs_world_to_img(p->out->wcs, p->x, p->y, &x, &y, p->num);
+      gal_wcs_world_to_img(p->out->wcs, p->x, p->y, &x, &y, p->num,
+                           p->cp.numthreads);
 
       /* If any conversions created a WCSLIB error, both the outputs will be
          set to NaN. */
@@ -785,6 +850,15 @@ ui_finalize_coordinates(struct mkprofparams *p)
   p->out->wcs->cdelt[1] /= p->oversample;
 
 
+  /* Shift the profile centers. Note that the shifts were multiplied by
+     `p->oversample' before. */
+  for(i=0;i<p->num;++i)
+    {
+      p->x[i] += p->shift[0]/p->oversample;
+      p->y[i] += p->shift[1]/p->oversample;
+    }
+
+
 
   /* For a sanity check:
   printf("\nui_finalize_coordinates sanity check:\n");
@@ -842,6 +916,30 @@ ui_make_log(struct mkprofparams *p)
 
 
 
+/* With `--quasirandom', the same `numrandom' points of a 2D Sobol
+   sequence (in the unit square) are used in all the pixels that need
+   Monte Carlo integration (see `randompoints'). So they are only
+   generated once here. */
+static void
+ui_make_quasirandom(struct mkprofparams *p)
+{
+  size_t i;
+  gsl_qrng *q;
+
+  q=gsl_qrng_alloc(gsl_qrng_sobol, 2);
+  if(q==NULL)
+    error(EXIT_FAILURE, 0, "%s: couldn't allocate the quasi-random number "
+          "generator", __func__);
+  p->qrpoints=gal_data_malloc_array(GAL_TYPE_FLOAT64, 2*p->numrandom);
+  for(i=0;i<p->numrandom;++i)
+    gsl_qrng_get(q, &p->qrpoints[2*i]);
+  gsl_qrng_free(q);
+}
+
+
+
+
+
 static void
 ui_preparations(struct mkprofparams *p)
 {
@@ -859,6 +957,10 @@ ui_preparations(struct mkprofparams *p)
   gsl_rng_env_setup();
   p->rng=gsl_rng_alloc(gsl_rng_default);
 
+  /* Make the quasi-random points if necessary. */
+  if(p->quasirandom)
+    ui_make_quasirandom(p);
+
   /* Make the log linked list. */
   ui_make_log(p);
 }
@@ -910,6 +1012,8 @@ ui_print_intro(struct mkprofparams *p)
       free(jobname);
     }
 
+  if(p->quasirandom)
+    gal_timing_report(NULL, "Quasi-random (Sobol) sub-pixel points.", 1);
   asprintf(&jobname, "Random number generator (RNG) type: %s",
            gsl_rng_name(p->rng));
   gal_timing_report(NULL, jobname, 1);
@@ -1033,8 +1137,9 @@ ui_free_report(struct mkprofparams *p, struct timeval *t1)
   if(p->individual)
     free(p->wcsheader);
 
-  /* Free the random number generator: */
+  /* Free the random number generator and quasi-random points. */
   gsl_rng_free(p->rng);
+  free(p->qrpoints);
 
   /* Free the log file information. */
   if(p->cp.log)
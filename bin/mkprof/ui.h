@@ -76,6 +76,10 @@ enum option_keys_enum
   UI_KEY_CRVAL1,
   UI_KEY_CRVAL2,
   UI_KEY_RESOLUTION,
+  UI_KEY_SHARDS,
+  UI_KEY_BANDHEIGHT,
+  UI_KEY_CENTERBINS,
+  UI_KEY_QUASIRANDOM,
 };
 
 
@@ -562,7 +562,8 @@ segmentation_save_sn_table(struct clumps_params *clprm)
   /* Set the column pointers and write them into a table.. */
   clumpinobj->next=sn;
   objind->next=clumpinobj;
-  gal_table_write(objind, comments, p->cp.tableformat, p->clumpsn_d_name, 1);
+  gal_table_write(objind, comments, p->cp.tableformat, p->clumpsn_d_name,
+                  p->cp.numthreads, 1);
 
 
   /* Clean up. */
@@ -215,7 +215,8 @@ threshold_write_sn_table(struct noisechiselparams *p, gal_data_t *insn,
 
 
   /* write the table. */
-  gal_table_write(cols, comments, p->cp.tableformat, filename, 1);
+  gal_table_write(cols, comments, p->cp.tableformat, filename,
+                  p->cp.numthreads, 1);
 
 
   /* Clean up (if necessary). */
@@ -562,7 +562,7 @@ write_output_table(struct statisticsparams *p, gal_data_t *table,
 
   /* Write the table. */
   gal_table_write(table, comments, p->cp.tableformat, output,
-                  p->cp.dontdelete);
+                  p->cp.numthreads, p->cp.dontdelete);
 
 
   /* Let the user know, if we aren't in quiet mode. */
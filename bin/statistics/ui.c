@@ -727,7 +727,8 @@ ui_read_columns(struct statisticsparams *p)
 
   /* Read the desired column(s). */
   cols=gal_table_read(p->inputname, p->cp.hdu, column, p->cp.searchin,
-                      p->cp.ignorecase, p->cp.minmapsize);
+                      p->cp.ignorecase, p->cp.numthreads, p->cp.minmapsize,
+                      NULL);
 
   /* Put the columns into the proper gal_data_t. */
   size=cols->size;
@@ -824,7 +825,7 @@ ui_preparations(struct statisticsparams *p)
             gal_fits_img_write(check, tl->tilecheckname, NULL, PROGRAM_NAME);
           else
             gal_table_write(check, NULL, cp->tableformat, tl->tilecheckname,
-                            cp->dontdelete);
+                            cp->numthreads, cp->dontdelete);
           gal_data_free(check);
         }
 
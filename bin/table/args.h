@@ -44,6 +44,32 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "rowrange",
+      UI_KEY_ROWRANGE,
+      "INT,INT",
+      0,
+      "Only read rows in this range (from 1, inclusive).",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->rowrange,
+      GAL_TYPE_STRING,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
+    {
+      "range",
+      UI_KEY_RANGE,
+      "STR,FLT,FLT",
+      0,
+      "Only read rows with column value in this range.",
+      GAL_OPTIONS_GROUP_INPUT,
+      &p->range,
+      GAL_TYPE_STRLL,
+      GAL_OPTIONS_RANGE_ANY,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
 
@@ -62,6 +88,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "cache",
+      UI_KEY_CACHE,
+      0,
+      0,
+      "Only write a cache of the table for fast reading.",
+      GAL_OPTIONS_GROUP_OPERATING_MODE,
+      &p->cache,
+      GAL_OPTIONS_NO_ARG_TYPE,
+      GAL_OPTIONS_RANGE_0_OR_1,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {0}
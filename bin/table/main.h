@@ -25,6 +25,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Include necessary headers */
 #include <gnuastro/data.h>
+#include <gnuastro/table.h>
 
 #include <gnuastro-internal/options.h>
 
@@ -47,10 +48,14 @@ struct tableparams
   char              *filename;  /* Input filename.                      */
   gal_list_str_t     *columns;  /* List of given columns.               */
   uint8_t         information;  /* ==1, only print FITS information.    */
+  uint8_t               cache;  /* ==1, only write the table's cache.   */
+  char              *rowrange;  /* First and last rows to read.         */
+  gal_list_str_t       *range;  /* Range of values in columns.          */
 
   /* Output: */
   gal_data_t           *table;  /* Linked list of output table columns. */
   gal_data_t      *allcolinfo;  /* Information of all the columns.      */
+  gal_table_rowsel_t  *rowsel;  /* Selection of rows to read.           */
   time_t              rawtime;  /* Starting time of the program.        */
 };
 
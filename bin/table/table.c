@@ -45,5 +45,5 @@ void
 table(struct tableparams *p)
 {
   gal_table_write(p->table, NULL, p->cp.tableformat, p->cp.output,
-                  p->cp.dontdelete);
+                  p->cp.numthreads, p->cp.dontdelete);
 }
@@ -22,6 +22,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 **********************************************************************/
 #include <config.h>
 
+#include <math.h>
 #include <argp.h>
 #include <errno.h>
 #include <error.h>
@@ -263,15 +264,116 @@ ui_check_options_and_arguments(struct tableparams *p)
 /**************************************************************/
 /***************       Preparations         *******************/
 /**************************************************************/
+/* Read the values of `--rowrange' and `--range' into the row selection
+   structure that is given to `gal_table_read'. */
+static void
+ui_prepare_rowsel(struct tableparams *p)
+{
+  double *d;
+  char *comma;
+  size_t ncomma;
+  gal_data_t *values;
+  gal_list_str_t *tmp;
+  gal_table_range_t *range;
+
+  /* If no row selection is requested, there is nothing to do. */
+  if(p->rowrange==NULL && p->range==NULL) return;
+
+  /* Allocate the row selection structure. */
+  errno=0;
+  p->rowsel=calloc(1, sizeof *p->rowsel);
+  if(p->rowsel==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `p->rowsel'",
+          __func__, sizeof *p->rowsel);
+
+  /* The range of rows: note that the user counts from 1. */
+  if(p->rowrange)
+    {
+      values=gal_options_parse_list_of_numbers(p->rowrange, NULL, 0);
+      d=values->array;
+      if( values->size!=2 || d[0]<1 || d[1]<d[0]
+          || ceil(d[0])!=d[0] || ceil(d[1])!=d[1] )
+        error(EXIT_FAILURE, 0, "`%s' (value to `--rowrange') must be two "
+              "positive integers (separated by a comma). The first is the "
+              "first row to read and the second is the last (counting "
+              "from 1, the second must be larger or equal to the first)",
+              p->rowrange);
+      p->rowsel->first  = d[0]-1;
+      p->rowsel->number = d[1]-d[0]+1;
+      gal_data_free(values);
+    }
+
+  /* The ranges of values: each value to `--range' has the format
+     `COLUMN,MIN,MAX'. Since a column name or regular expression might
+     also contain a comma, the last two commas are used. */
+  for(tmp=p->range; tmp!=NULL; tmp=tmp->next)
+    {
+      /* Find the start of the numbers. */
+      ncomma=0;
+      for(comma=tmp->v+strlen(tmp->v)-1; comma>tmp->v; --comma)
+        if( *comma==',' && ++ncomma==2 ) break;
+      if(ncomma!=2)
+        error(EXIT_FAILURE, 0, "`%s' (value to `--range') must have the "
+              "format `COLUMN,MIN,MAX'", tmp->v);
+
+      /* Read the two numbers. */
+      values=gal_options_parse_list_of_numbers(comma+1, NULL, 0);
+      d=values->array;
+      if(values->size!=2 || d[1]<d[0])
+        error(EXIT_FAILURE, 0, "`%s' (value to `--range') must have the "
+              "format `COLUMN,MIN,MAX', where MAX must be larger or equal "
+              "to MIN", tmp->v);
+
+      /* Add the range to the list. */
+      errno=0;
+      range=malloc(sizeof *range);
+      if(range==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `range'",
+              __func__, sizeof *range);
+      range->min=d[0];
+      range->max=d[1];
+      range->column=strndup(tmp->v, comma-tmp->v);
+      range->next=p->rowsel->ranges;
+      p->rowsel->ranges=range;
+      gal_data_free(values);
+    }
+}
+
+
+
+
+
 void
 ui_preparations(struct tableparams *p)
 {
-  char *tmp;
   int tableformat;
+  char *tmp, *msg;
   gal_data_t *allcols;
   size_t i, numcols, numrows;
   struct gal_options_common_params *cp=&p->cp;
 
+  /* If the user only wanted a cache of the table, write it and finish. The
+     cache is for the full table, so no selection should be requested. */
+  if(p->cache)
+    {
+      if(p->columns || p->rowrange || p->range)
+        error(EXIT_FAILURE, 0, "`--cache' writes a cache of the full table, "
+              "it can't be called with `--column', `--rowrange' or "
+              "`--range'");
+      gal_table_cache_write(p->filename, cp->hdu, cp->numthreads,
+                            cp->minmapsize);
+      if(!cp->quiet)
+        {
+          tmp=gal_table_cache_name(p->filename, cp->hdu);
+          asprintf(&msg, "%s created.", tmp);
+          gal_timing_report(NULL, msg, 1);
+          free(msg);
+          free(tmp);
+        }
+      ui_free_report(p);
+      exit(EXIT_SUCCESS);
+    }
+
   /* If there were no columns specified, we want the full set of
      columns. */
   if(p->columns==NULL)
@@ -327,14 +429,23 @@ ui_preparations(struct tableparams *p)
      elements were added to the list is the reverse of the order that they
      will be popped). */
   gal_list_str_reverse(&p->columns);
+  ui_prepare_rowsel(p);
   p->table=gal_table_read(p->filename, cp->hdu, p->columns, cp->searchin,
-                          cp->ignorecase, cp->minmapsize);
+                          cp->ignorecase, cp->numthreads, cp->minmapsize,
+                          p->rowsel);
 
   /* If there was no actual data in the file, then inform the user and
      abort. */
   if(p->table==NULL)
-    error(EXIT_FAILURE, 0, "%s: no usable data rows (non-commented and "
-          "non-blank lines)", p->filename);
+    {
+      if(p->rowsel)
+        error(EXIT_FAILURE, 0, "%s: no rows match the requested row "
+              "selection (`--rowrange' and `--range' options)",
+              p->filename);
+      else
+        error(EXIT_FAILURE, 0, "%s: no usable data rows (non-commented "
+              "and non-blank lines)", p->filename);
+    }
 
   /* Now that the data columns are ready, we can free the string linked
      list. */
@@ -440,8 +551,25 @@ ui_read_check_inputs_setup(int argc, char *argv[], struct tableparams *p)
 void
 ui_free_report(struct tableparams *p)
 {
+  gal_table_range_t *tmp;
+
   /* Free the allocated arrays: */
   free(p->cp.hdu);
+  free(p->rowrange);
   free(p->cp.output);
+  gal_list_str_free(p->range, 1);
   gal_list_data_free(p->table);
+
+  /* Free the row selection. */
+  if(p->rowsel)
+    {
+      while(p->rowsel->ranges)
+        {
+          tmp=p->rowsel->ranges->next;
+          free(p->rowsel->ranges->column);
+          free(p->rowsel->ranges);
+          p->rowsel->ranges=tmp;
+        }
+      free(p->rowsel);
+    }
 }
@@ -89,6 +89,19 @@ struct argp_option program_options[] =
       GAL_OPTIONS_NOT_MANDATORY,
       GAL_OPTIONS_NOT_SET
     },
+    {
+      "bandmem",
+      UI_KEY_BANDMEM,
+      "INT",
+      0,
+      "Warp in bands using this many bytes of memory.",
+      GAL_OPTIONS_GROUP_OUTPUT,
+      &p->bandmem,
+      GAL_TYPE_SIZE_T,
+      GAL_OPTIONS_RANGE_GE_0,
+      GAL_OPTIONS_NOT_MANDATORY,
+      GAL_OPTIONS_NOT_SET
+    },
 
 
     {
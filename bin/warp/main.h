@@ -25,6 +25,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Include necessary headers */
 #include <gnuastro/data.h>
+#include <gnuastro/fits.h>
 
 #include <gnuastro-internal/options.h>
 
@@ -48,6 +49,7 @@ struct warpparams
   uint8_t         keepwcs;  /* Wrap the warped/transfomed pixels.        */
   uint8_t  centeroncorner;  /* Shift center by 0.5 before and after.     */
   double      coveredfrac;  /* Acceptable fraction of output covered.    */
+  size_t          bandmem;  /* Memory for band-by-band warping (bytes).  */
 
   /* Internal parameters: */
   gal_data_t       *input;  /* Input data structure.                     */
@@ -60,6 +62,14 @@ struct warpparams
   size_t       ordinds[4];  /* Indexs of anticlockwise vertices.         */
   double    outfpixval[2];  /* Pixel value of first output pixel.        */
   double         opixarea;  /* Area of output pix in units of input pix. */
+  gal_data_t     *lattice;  /* Output pixel corners in input coordinates.*/
+  uint8_t          affine;  /* ==1: The inverse matrix is affine.        */
+  uint8_t       separable;  /* ==1: Only scaling and shifting the axes.  */
+  size_t         isize[2];  /* Size of the full input image.             */
+  size_t       ioffset[2];  /* Position of `input' in the full image.    */
+  size_t         osize[2];  /* Size of the full output image.            */
+  fitsfile        *infits;  /* Input pointer (when warping in bands).    */
+  fitsfile       *outfits;  /* Output pointer (when warping in bands).   */
 };
 
 #endif
@@ -333,6 +333,49 @@ ui_add_to_modular_warps_ll(struct argp_option *option, char *arg,
 /**************************************************************/
 /***************       Sanity Check         *******************/
 /**************************************************************/
+/* When warping band-by-band, we only need the size and units of the
+   input image. */
+static void
+ui_read_input_info(struct warpparams *p)
+{
+  int type;
+  char **str;
+  fitsfile *fptr;
+  size_t ndim, *dsize;
+  int status=0;
+  gal_data_t *keysll=NULL;
+  size_t dsize_key=1;
+
+  /* Open the HDU and read the size of the image. */
+  fptr=gal_fits_hdu_open_format(p->inputname, p->cp.hdu, 0);
+  gal_fits_img_info(fptr, &type, &ndim, &dsize);
+  if(ndim!=2)
+    error(EXIT_FAILURE, 0, "%s (hdu: %s) has %zu dimensions, Warp only "
+          "works on 2D images", p->inputname, p->cp.hdu, ndim);
+  p->isize[0]=dsize[0];
+  p->isize[1]=dsize[1];
+
+  /* Read the units (if they exist). */
+  gal_list_data_add_alloc(&keysll, NULL, GAL_TYPE_STRING, 1, &dsize_key,
+                          NULL, 0, -1, "BUNIT", NULL, NULL);
+  gal_fits_key_read_from_ptr(fptr, keysll, 0, 0);
+  str = keysll->status==0 ? keysll->array : NULL;
+
+  /* A zero-dimensional dataset to keep the meta-data. */
+  p->input=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 0, NULL, NULL, 0, -1,
+                          NULL, str ? *str : NULL, NULL);
+
+  /* Clean up. */
+  free(dsize);
+  gal_list_data_free(keysll);
+  fits_close_file(fptr, &status);
+  gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
 static void
 ui_check_options_and_arguments(struct warpparams *p)
 {
@@ -346,10 +389,20 @@ ui_check_options_and_arguments(struct warpparams *p)
               "zero), or extension name (generally, anything acceptable "
               "by CFITSIO)");
 
-      /* Read the input image as double type and its WCS structure. */
-      p->input=gal_fits_img_read_to_type(p->inputname, p->cp.hdu,
-                                         GAL_TYPE_FLOAT64,
-                                         p->cp.minmapsize);
+      /* Read the input image as double type and its WCS structure. When
+         warping band-by-band, only the size of the input is read here
+         (its pixels are read for each band), so `p->input' just keeps
+         the meta-data. */
+      if(p->bandmem)
+        ui_read_input_info(p);
+      else
+        {
+          p->input=gal_fits_img_read_to_type(p->inputname, p->cp.hdu,
+                                             GAL_TYPE_FLOAT64,
+                                             p->cp.minmapsize);
+          p->isize[0]=p->input->dsize[0];
+          p->isize[1]=p->input->dsize[1];
+        }
       p->input->wcs=gal_wcs_read(p->inputname, p->cp.hdu, p->hstartwcs,
                                  p->hendwcs, &p->input->nwcs);
     }
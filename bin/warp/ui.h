@@ -51,6 +51,7 @@ enum option_keys_enum
      automatically). */
   UI_KEY_HSTARTWCS       = 1000,
   UI_KEY_HENDWCS,
+  UI_KEY_BANDMEM,
 };
 
 
@@ -30,6 +30,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 #include <gnuastro/wcs.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/blank.h>
 #include <gnuastro/polygon.h>
 
 #include "main.h"
@@ -108,153 +109,548 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/***************************************************************/
+/**************        Corner lattice         ******************/
+/***************************************************************/
+/* Each corner of an output pixel is shared by four pixels, so the input
+   coordinates of all the (ny+1)x(nx+1) corners of the output pixels are
+   calculated once (on many threads, each row of corners is one action)
+   and stored in `p->lattice' (two values for each corner). Corner (x,y)
+   is the bottom-left corner of output pixel (x,y).
+
+   When the inverse matrix is affine (the first two elements of its last
+   row are zero), moving along a row of corners is just a constant change
+   in the input coordinates. So only the first corner of each row is
+   transformed with `mappoint' and there is no division for the rest. */
+static void *
+warp_lattice_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warpparams *p=(struct warpparams *)tprm->params;
+
+  double *c, ocrn[2], dx, dy, *T=p->inverse, *lattice=p->lattice->array;
+  size_t i, x, y, nx=p->output->dsize[1]+1;
+
+  /* Change in input coordinates along a row (only for affine). Note that
+     the inverse matrix isn't normalized. */
+  dx=T[0]/T[8];
+  dy=T[3]/T[8];
+
+  /* Go over all the rows of corners given to this thread. */
+  for(i=0; (y=tprm->indexs[i])!=GAL_BLANK_SIZE_T; ++i)
+    {
+      c=lattice+2*y*nx;
+      ocrn[1]=(double)y-0.5f+p->outfpixval[1];
+      if(p->affine)
+        {
+          ocrn[0]=-0.5f+p->outfpixval[0];
+          mappoint(ocrn, T, c);
+          for(x=1;x<nx;++x)
+            {
+              c[x*2]   = c[0] + x*dx;
+              c[x*2+1] = c[1] + x*dy;
+            }
+        }
+      else
+        for(x=0;x<nx;++x)
+          {
+            ocrn[0]=(double)x-0.5f+p->outfpixval[0];
+            mappoint(ocrn, T, &c[x*2]);
+          }
+    }
+
+  /* Wait for all the other threads to finish, then return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+warp_lattice(struct warpparams *p)
+{
+  size_t dsize[3]={p->output->dsize[0]+1, p->output->dsize[1]+1, 2};
+
+  /* Allocate the lattice (it may be large, so allow it to be
+     memory-mapped). */
+  p->lattice=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 3, dsize, NULL, 0,
+                            p->cp.minmapsize, NULL, NULL, NULL);
+
+  /* See if the inverse matrix is affine. */
+  p->affine = p->inverse[6]==0.0 && p->inverse[7]==0.0;
+
+  /* Fill the lattice. */
+  gal_threads_spin_off(warp_lattice_on_thread, p, dsize[0],
+                       p->cp.numthreads);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***************************************************************/
+/**************       Separable warping       ******************/
+/***************************************************************/
+/* When the transformation only scales and shifts the two axes, each
+   output pixel is a rectangle in the input image, so the overlap area of
+   an output and input pixel is the product of the overlaps along each
+   axis. In this case, the overlaps along each axis are found once (for
+   all the output rows or columns) and no polygon clipping is
+   necessary. */
+struct warpsepaxis
+{
+  size_t       *start;   /* First overlapping input pixel (FITS).      */
+  size_t         *num;   /* Number of overlapping input pixels.        */
+  double           *w;   /* Overlaps (`maxnum' for each output pixel). */
+  size_t       maxnum;   /* Maximum number of overlapping pixels.      */
+};
+
+struct warpsepparams
+{
+  struct warpparams  *p;   /* Main program parameters.                  */
+  struct warpsepaxis  x;   /* Overlaps along the first FITS axis.       */
+  struct warpsepaxis  y;   /* Overlaps along the second FITS axis.      */
+};
+
+
+
+
+
+/* Find the overlaps along one axis: `scale' and `shift' define the
+   transformation of the output coordinates to the input, `onum' and
+   `inum' are the number of output and input pixels along this axis,
+   `ioff' is the position of the first input pixel in the full image
+   (only non-zero when warping in bands) and `ofpix' is the coordinate of
+   the first output pixel. */
+static void
+warp_separable_axis(struct warpsepaxis *ax, double scale, double shift,
+                    size_t onum, size_t inum, size_t ioff, double ofpix)
+{
+  size_t o, k;
+  long s, e, i;
+  double a, b, t, lo, hi;
+
+  /* Allocate the starting points and number of overlapping pixels. */
+  ax->start = gal_data_malloc_array(GAL_TYPE_SIZE_T, onum);
+  ax->num   = gal_data_malloc_array(GAL_TYPE_SIZE_T, onum);
+
+  /* Find the range of input pixels of each output pixel. Similar to the
+     general case, the pixels outside the input are ignored. */
+  ax->maxnum=0;
+  for(o=0;o<onum;++o)
+    {
+      a = scale*((double)o-0.5f+ofpix) + shift;
+      b = scale*((double)o+0.5f+ofpix) + shift;
+      if(a>b) { t=a; a=b; b=t; }
+      s = nearestint_halfhigher(a);
+      e = nearestint_halflower(b) + 1;
+      if(s<(long)ioff+1) s=ioff+1;
+      if(e>(long)(ioff+inum)+1) e=ioff+inum+1;
+      ax->start[o]=s;
+      ax->num[o] = e>s ? e-s : 0;
+      if(ax->num[o]>ax->maxnum) ax->maxnum=ax->num[o];
+    }
+
+  /* Find the overlaps. */
+  ax->w=gal_data_calloc_array(GAL_TYPE_FLOAT64, onum*(ax->maxnum+1));
+  for(o=0;o<onum;++o)
+    {
+      a = scale*((double)o-0.5f+ofpix) + shift;
+      b = scale*((double)o+0.5f+ofpix) + shift;
+      if(a>b) { t=a; a=b; b=t; }
+      for(k=0;k<ax->num[o];++k)
+        {
+          i=ax->start[o]+k;
+          lo = a > i-0.5f ? a : i-0.5f;
+          hi = b < i+0.5f ? b : i+0.5f;
+          ax->w[o*ax->maxnum+k] = hi>lo ? hi-lo : 0.0f;
+        }
+    }
+}
+
+
+
+
+
+static void *
+warp_separable_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warpsepparams *sprm=(struct warpsepparams *)tprm->params;
+  struct warpparams *p=sprm->p;
+
+  size_t *numin;
+  struct warpsepaxis *X=&sprm->x, *Y=&sprm->y;
+  double v, s, w, wy, *row, *xw, *sum, *filled;
+  size_t i, j, k, l, r, n, is1=p->input->dsize[1], os1=p->output->dsize[1];
+  double *input=p->input->array, *output=p->output->array;
+  size_t xoff=p->ioffset[1]+1, yoff=p->ioffset[0]+1;
+
+  /* Allocate the buffers for one output row. */
+  sum    = gal_data_malloc_array(GAL_TYPE_FLOAT64, os1);
+  filled = gal_data_malloc_array(GAL_TYPE_FLOAT64, os1);
+  numin  = gal_data_malloc_array(GAL_TYPE_SIZE_T,  os1);
+
+  /* Go over the output rows given to this thread. */
+  for(i=0; (r=tprm->indexs[i])!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Initialize the buffers. */
+      for(j=0;j<os1;++j) { sum[j]=filled[j]=0.0f; numin[j]=0; }
+
+      /* Go over the input rows that overlap with this output row, and
+         resample each one along the first axis. */
+      for(k=0;k<Y->num[r];++k)
+        {
+          wy=Y->w[r*Y->maxnum+k];
+          row=input+(Y->start[r]-yoff+k)*is1;
+          for(j=0;j<os1;++j)
+            {
+              s=w=0.0f;
+              n=0;
+              xw=&X->w[j*X->maxnum];
+              for(l=0;l<X->num[j];++l)
+                {
+                  v=row[X->start[j]-xoff+l];
+                  if( !isnan(v) ) { s+=v*xw[l]; w+=xw[l]; ++n; }
+                }
+              sum[j]+=wy*s;
+              filled[j]+=wy*w;
+              numin[j]+=n;
+            }
+        }
+
+      /* Write the output values, similar to the general case. */
+      for(j=0;j<os1;++j)
+        {
+          if(numin[j] && filled[j]/p->opixarea < p->coveredfrac-1e-5)
+            numin[j]=0;
+          output[r*os1+j] = numin[j] ? sum[j] : NAN;
+        }
+    }
+
+  /* Clean up, wait for the other threads and return. */
+  free(sum);
+  free(numin);
+  free(filled);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+warp_separable(struct warpparams *p)
+{
+  double *T=p->inverse;
+  struct warpsepparams sprm;
+
+  /* Find the overlaps along each axis. Note that the inverse matrix isn't
+     normalized. */
+  sprm.p=p;
+  warp_separable_axis(&sprm.x, T[0]/T[8], T[2]/T[8], p->output->dsize[1],
+                      p->input->dsize[1], p->ioffset[1], p->outfpixval[0]);
+  warp_separable_axis(&sprm.y, T[4]/T[8], T[5]/T[8], p->output->dsize[0],
+                      p->input->dsize[0], p->ioffset[0], p->outfpixval[1]);
+
+  /* Do the resampling, each output row is one action. */
+  gal_threads_spin_off(warp_separable_on_thread, &sprm, p->output->dsize[0],
+                       p->cp.numthreads);
+
+  /* Clean up. */
+  free(sprm.x.w);
+  free(sprm.y.w);
+  free(sprm.x.num);
+  free(sprm.y.num);
+  free(sprm.x.start);
+  free(sprm.y.start);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /***************************************************************/
 /**************      Processing function      ******************/
 /***************************************************************/
-void *
-warponthread(void *inparam)
+/* The output pixels are warped in square tiles (of `WARP_TILE_WIDTH'
+   pixels on each side). Each thread takes the next tile from a shared
+   counter once it has finished its previous tile. So the input pixels
+   that a thread needs for one tile are close to each other (in memory)
+   and threads don't remain idle when some parts of the output are much
+   faster to warp than others (for example parts that don't overlap with
+   the input). */
+struct warpgeneral
 {
-  struct iwpparams *iwp=(struct iwpparams*)inparam;
-  struct warpparams *p=iwp->p;
+  struct warpparams   *p;   /* Main program parameters.                 */
+  size_t       ntiles[2];   /* Number of tiles along each dimension.    */
+  size_t            next;   /* Index of the next tile to be warped.     */
+  pthread_mutex_t  mutex;   /* Mutex to take the next tile.             */
+};
+
+
+
 
+
+/* Warp the output pixel with index `ind'. */
+static void
+warp_pixel(struct warpparams *p, size_t ind)
+{
   size_t *extinds=p->extinds, *ordinds=p->ordinds;
   long is0=p->input->dsize[0], is1=p->input->dsize[1];
+  long iy0=p->ioffset[0], ix0=p->ioffset[1];
   double area, filledarea, *input=p->input->array, v=NAN;
-  size_t i, j, ind, os1=p->output->dsize[1], numcrn, numinput;
+  size_t os1=p->output->dsize[1], numcrn, numinput;
   long x, y, xstart, xend, ystart, yend; /* Might be negative */
-  double ocrn[8], icrn_base[8], icrn[8], *output=p->output->array;
-  double pcrn[8], *outfpixval=p->outfpixval, ccrn[GAL_POLYGON_MAX_CORNERS];
+  double *c, icrn_base[8], icrn[8], *output=p->output->array;
+  double pcrn[8], *lattice=p->lattice->array, ccrn[GAL_POLYGON_MAX_CORNERS];
+
+  /* Initialize the output pixel value: */
+  numinput=0;
+  output[ind]=filledarea=0.0f;
+
+  /* Read the four corners of the output pixel in the input image
+     coordinates from the lattice (bottom-left, bottom-right, top-left
+     and top-right). The ind/os1 and ind%os1 start from 0. */
+  c=lattice + 2*( (ind/os1)*(os1+1) + ind%os1 );
+  icrn_base[0]=c[0];          icrn_base[1]=c[1];
+  icrn_base[2]=c[2];          icrn_base[3]=c[3];
+  c+=2*(os1+1);
+  icrn_base[4]=c[0];          icrn_base[5]=c[1];
+  icrn_base[6]=c[2];          icrn_base[7]=c[3];
+
+  /* Using the known relationships between the vertice locations,
+     put everything in the right place: */
+  xstart = nearestint_halfhigher( icrn_base[extinds[0]] );
+  xend   = nearestint_halflower(  icrn_base[extinds[1]] ) + 1;
+  ystart = nearestint_halfhigher( icrn_base[extinds[2]] );
+  yend   = nearestint_halflower(  icrn_base[extinds[3]] ) + 1;
+  icrn[0]=icrn_base[ordinds[0]*2]; icrn[1]=icrn_base[ordinds[0]*2+1];
+  icrn[2]=icrn_base[ordinds[1]*2]; icrn[3]=icrn_base[ordinds[1]*2+1];
+  icrn[4]=icrn_base[ordinds[2]*2]; icrn[5]=icrn_base[ordinds[2]*2+1];
+  icrn[6]=icrn_base[ordinds[3]*2]; icrn[7]=icrn_base[ordinds[3]*2+1];
 
-  for(i=0; (ind=iwp->indexs[i])!=GAL_BLANK_SIZE_T; ++i)
+  /* For a check:
+  if(ind==9999)
     {
-      /* Initialize the output pixel value: */
-      numinput=0;
-      output[ind]=filledarea=0.0f;
-
-      /* Set the corners of this output pixel. The ind/os1 and ind%os1
-         start from 0. Note that the outfpixval already contains the
-         correction for the fact that the FITS standard considers the
-         center of first pixel to be at (1.0f, 1.0f).*/
-      ocrn[0]=(double)(ind%os1)-0.5f+outfpixval[0];
-      ocrn[1]=(double)(ind/os1)-0.5f+outfpixval[1];
-      ocrn[2]=(double)(ind%os1)+0.5f+outfpixval[0];
-      ocrn[3]=(double)(ind/os1)-0.5f+outfpixval[1];
-      ocrn[4]=(double)(ind%os1)-0.5f+outfpixval[0];
-      ocrn[5]=(double)(ind/os1)+0.5f+outfpixval[1];
-      ocrn[6]=(double)(ind%os1)+0.5f+outfpixval[0];
-      ocrn[7]=(double)(ind/os1)+0.5f+outfpixval[1];
-
-
-      /* Transform the four corners of the output pixel to the input
-         image coordinates. */
-      for(j=0;j<4;++j) mappoint(&ocrn[j*2], p->inverse, &icrn_base[j*2]);
-
-      /* Using the known relationships between the vertice locations,
-         put everything in the right place: */
-      xstart = nearestint_halfhigher( icrn_base[extinds[0]] );
-      xend   = nearestint_halflower(  icrn_base[extinds[1]] ) + 1;
-      ystart = nearestint_halfhigher( icrn_base[extinds[2]] );
-      yend   = nearestint_halflower(  icrn_base[extinds[3]] ) + 1;
-      icrn[0]=icrn_base[ordinds[0]*2]; icrn[1]=icrn_base[ordinds[0]*2+1];
-      icrn[2]=icrn_base[ordinds[1]*2]; icrn[3]=icrn_base[ordinds[1]*2+1];
-      icrn[4]=icrn_base[ordinds[2]*2]; icrn[5]=icrn_base[ordinds[2]*2+1];
-      icrn[6]=icrn_base[ordinds[3]*2]; icrn[7]=icrn_base[ordinds[3]*2+1];
-
-      /* For a check:
-      if(ind==9999)
-        {
-          printf("\n\n\nind: %zu: (%zu, %zu):\n",
-                 ind, ind%os1+1, ind/os1+1);
-          for(j=0;j<4;++j)
-            printf("(%.3f, %.3f) --> (%.3f, %.3f)\n",
-                   ocrn[j*2], ocrn[j*2+1], icrn_base[j*2],
-                   icrn_base[j*2+1]);
-          printf("------- Ordered -------\n");
-          for(j=0;j<4;++j) printf("(%.3f, %.3f)\n", icrn[j*2], icrn[j*2+1]);
-          printf("------- Start and ending pixels -------\n");
-          printf("X: %ld -- %ld\n", xstart, xend);
-          printf("Y: %ld -- %ld\n", ystart, yend);
-        }
-      */
+      printf("\n\n\nind: %zu: (%zu, %zu):\n",
+             ind, ind%os1+1, ind/os1+1);
+      for(j=0;j<4;++j)
+        printf("(%.3f, %.3f)\n", icrn_base[j*2], icrn_base[j*2+1]);
+      printf("------- Ordered -------\n");
+      for(j=0;j<4;++j) printf("(%.3f, %.3f)\n", icrn[j*2], icrn[j*2+1]);
+      printf("------- Start and ending pixels -------\n");
+      printf("X: %ld -- %ld\n", xstart, xend);
+      printf("Y: %ld -- %ld\n", ystart, yend);
+    }
+  */
 
-      /* Go over all the input pixels that are covered. Note that x
-         and y are the centers of the pixel. */
-      for(y=ystart;y<yend;++y)
+  /* Go over all the input pixels that are covered. Note that x
+     and y are the centers of the pixel. */
+  for(y=ystart;y<yend;++y)
+    {
+      /* If the pixel isn't in the image (note that the pixel
+         coordinates start from 1), contine to next. Note that the
+         pixel polygon should be counter clockwise. When warping in
+         bands, `input' only contains part of the full image and
+         `ix0' and `iy0' are its position in the full image. */
+      if( y<=iy0 || y>iy0+is0 ) continue;
+      pcrn[1]=y-0.5f;      pcrn[3]=y-0.5f;
+      pcrn[5]=y+0.5f;      pcrn[7]=y+0.5f;
+      for(x=xstart;x<xend;++x)
         {
-          /* If the pixel isn't in the image (note that the pixel
-             coordinates start from 1), contine to next. Note that the
-             pixel polygon should be counter clockwise. */
-          if( y<1 || y>is0 ) continue;
-          pcrn[1]=y-0.5f;      pcrn[3]=y-0.5f;
-          pcrn[5]=y+0.5f;      pcrn[7]=y+0.5f;
-          for(x=xstart;x<xend;++x)
-            {
-              if( x<1 || x>is1 ) continue;
+          if( x<=ix0 || x>ix0+is1 ) continue;
 
-              /* Read the value of the input pixel. */
-              v=input[(y-1)*is1+x-1];
+          /* Read the value of the input pixel. */
+          v=input[(y-1-iy0)*is1+x-1-ix0];
 
-              pcrn[0]=x-0.5f;          pcrn[2]=x+0.5f;
-              pcrn[4]=x+0.5f;          pcrn[6]=x-0.5f;
+          pcrn[0]=x-0.5f;          pcrn[2]=x+0.5f;
+          pcrn[4]=x+0.5f;          pcrn[6]=x-0.5f;
 
-              /* Find the overlapping (clipped) polygon: */
-              gal_polygon_clip(icrn, 4, pcrn, 4, ccrn, &numcrn);
-              area=gal_polygon_area(ccrn, numcrn);
+          /* Find the overlapping (clipped) polygon: */
+          gal_polygon_clip(icrn, 4, pcrn, 4, ccrn, &numcrn);
+          area=gal_polygon_area(ccrn, numcrn);
 
-              /* Add the fractional value of this pixel. If this
-                 output pixel covers a NaN pixel in the input grid,
-                 then calculate the area of this NaN pixel to account
-                 for it later. */
-              if( !isnan(v) )
-                {
-                  ++numinput;
-                  filledarea+=area;
-                  output[ind]+=v*area;
-                }
+          /* Add the fractional value of this pixel. If this
+             output pixel covers a NaN pixel in the input grid,
+             then calculate the area of this NaN pixel to account
+             for it later. */
+          if( !isnan(v) )
+            {
+              ++numinput;
+              filledarea+=area;
+              output[ind]+=v*area;
+            }
 
-              /* For a polygon check:
-              if(ind==9999)
-                {
-                  printf("%zu -- (%zd, %zd):\n", ind, x, y);
-                  printf("icrn:\n");
-                  for(j=0;j<4;++j)
-                    printf("\t%.3f, %.3f\n", icrn[j*2], icrn[j*2+1]);
-                  printf("pcrn:\n");
-                  for(j=0;j<4;++j)
-                    printf("\t%.3f, %.3f\n", pcrn[j*2], pcrn[j*2+1]);
-                  printf("ccrn:\n");
-                  for(j=0;j<numcrn;++j)
-                    printf("\t%.3f, %.3f\n", ccrn[j*2], ccrn[j*2+1]);
-                  printf("[%zu]: %.3f of [%ld, %ld]: %f\n", ind,
-                         gal_polygon_area(ccrn, numcrn), x, y,
-                         input[(y-1)*is1+x-1]);
-                }
-              */
-
-              /* For a simple pixel value check:
-              if(ind==97387)
-                printf("%f --> (%zu) %f\n",
-                       v*gal_polygon_area(ccrn, numcrn),
-                       numinput, output[ind]);
-              */
+          /* For a polygon check:
+          if(ind==9999)
+            {
+              printf("%zu -- (%zd, %zd):\n", ind, x, y);
+              printf("icrn:\n");
+              for(j=0;j<4;++j)
+                printf("\t%.3f, %.3f\n", icrn[j*2], icrn[j*2+1]);
+              printf("pcrn:\n");
+              for(j=0;j<4;++j)
+                printf("\t%.3f, %.3f\n", pcrn[j*2], pcrn[j*2+1]);
+              printf("ccrn:\n");
+              for(j=0;j<numcrn;++j)
+                printf("\t%.3f, %.3f\n", ccrn[j*2], ccrn[j*2+1]);
+              printf("[%zu]: %.3f of [%ld, %ld]: %f\n", ind,
+                     gal_polygon_area(ccrn, numcrn), x, y,
+                     input[(y-1)*is1+x-1]);
             }
+          */
+
+          /* For a simple pixel value check:
+          if(ind==97387)
+            printf("%f --> (%zu) %f\n",
+                   v*gal_polygon_area(ccrn, numcrn),
+                   numinput, output[ind]);
+          */
         }
+    }
+
+  /* See if the pixel value should be set to NaN or not (because of not
+     enough coverage). */
+  if(numinput && filledarea/p->opixarea < p->coveredfrac-1e-5)
+    numinput=0;
+
+  /* Write the final value to disk: */
+  if(numinput==0) output[ind]=NAN;
+}
 
-      /* See if the pixel value should be set to NaN or not (because of not
-         enough coverage). */
-      if(numinput && filledarea/p->opixarea < p->coveredfrac-1e-5)
-        numinput=0;
 
-      /* Write the final value to disk: */
-      if(numinput==0) output[ind]=NAN;
+
+
+
+/* See if a tile of the output (with the given starting and (exclusive)
+   ending pixels along each dimension) is completely outside the input.
+   Since straight lines remain straight after the transformation, the
+   range of the input coordinates of the tile is defined by its four
+   corners. One extra pixel is added on each side to account for floating
+   point errors. */
+static int
+warp_tile_outside(struct warpparams *p, size_t *start, size_t *end)
+{
+  double *c, *lattice=p->lattice->array;
+  size_t i, nx=p->output->dsize[1]+1, crn[8];
+  double min[2]={DBL_MAX, DBL_MAX}, max[2]={-DBL_MAX, -DBL_MAX};
+  double lo[2]={p->ioffset[1]+0.5f, p->ioffset[0]+0.5f};
+  double hi[2]={lo[0]+p->input->dsize[1], lo[1]+p->input->dsize[0]};
+
+  /* Corners of the tile in the lattice. */
+  crn[0]=start[0];     crn[1]=start[1];
+  crn[2]=start[0];     crn[3]=end[1];
+  crn[4]=end[0];       crn[5]=start[1];
+  crn[6]=end[0];       crn[7]=end[1];
+
+  /* Find the range of input coordinates. */
+  for(i=0;i<4;++i)
+    {
+      c=lattice+2*(crn[i*2]*nx+crn[i*2+1]);
+      if(c[0]<min[0]) min[0]=c[0];
+      if(c[0]>max[0]) max[0]=c[0];
+      if(c[1]<min[1]) min[1]=c[1];
+      if(c[1]>max[1]) max[1]=c[1];
     }
 
+  /* Check if it overlaps with the input. */
+  return ( max[0] < lo[0]-1.0f || min[0] > hi[0]+1.0f
+           || max[1] < lo[1]-1.0f || min[1] > hi[1]+1.0f );
+}
 
 
-  /* Wait until all other threads finish. */
-  if(p->cp.numthreads>1)
-    pthread_barrier_wait(iwp->b);
 
+
+
+/* Take the next tile, GAL_BLANK_SIZE_T is returned when there are no
+   more tiles. */
+static size_t
+warp_tile_next(struct warpgeneral *gen)
+{
+  size_t tile;
+
+  pthread_mutex_lock(&gen->mutex);
+  tile = ( gen->next < gen->ntiles[0]*gen->ntiles[1]
+           ? gen->next++
+           : GAL_BLANK_SIZE_T );
+  pthread_mutex_unlock(&gen->mutex);
+  return tile;
+}
+
+
+
+
+
+void *
+warponthread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct warpgeneral *gen=(struct warpgeneral *)tprm->params;
+  struct warpparams *p=gen->p;
+
+  double *output=p->output->array;
+  size_t os0=p->output->dsize[0], os1=p->output->dsize[1];
+  size_t x, y, tile, start[2], end[2];
+
+  /* Go over the tiles until there are no more left. */
+  while( (tile=warp_tile_next(gen)) != GAL_BLANK_SIZE_T )
+    {
+      /* Set the range of pixels in this tile. */
+      start[0] = ( tile / gen->ntiles[1] ) * WARP_TILE_WIDTH;
+      start[1] = ( tile % gen->ntiles[1] ) * WARP_TILE_WIDTH;
+      end[0]   = start[0] + WARP_TILE_WIDTH;
+      end[1]   = start[1] + WARP_TILE_WIDTH;
+      if(end[0]>os0) end[0]=os0;
+      if(end[1]>os1) end[1]=os1;
+
+      /* Warp the pixels of the tile, if it is completely outside of the
+         input, all its pixels will be NaN. */
+      if( warp_tile_outside(p, start, end) )
+        for(y=start[0];y<end[0];++y)
+          for(x=start[1];x<end[1];++x)
+            output[y*os1+x]=NAN;
+      else
+        for(y=start[0];y<end[0];++y)
+          for(x=start[1];x<end[1];++x)
+            warp_pixel(p, y*os1+x);
+    }
+
+  /* Wait until all other threads finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
   return NULL;
 }
 
@@ -262,6 +658,43 @@ warponthread(void *inparam)
 
 
 
+/* The general case: each output pixel is clipped with all the input
+   pixels it covers. */
+static void
+warp_general(struct warpparams *p)
+{
+  size_t nt;
+  struct warpgeneral gen;
+  size_t os0=p->output->dsize[0], os1=p->output->dsize[1];
+
+  /* Transform all the corners of the output pixels. */
+  warp_lattice(p);
+
+  /* Set the tiles. */
+  gen.p=p;
+  gen.next=0;
+  gen.ntiles[0]=(os0+WARP_TILE_WIDTH-1)/WARP_TILE_WIDTH;
+  gen.ntiles[1]=(os1+WARP_TILE_WIDTH-1)/WARP_TILE_WIDTH;
+  pthread_mutex_init(&gen.mutex, NULL);
+
+  /* Spin off the threads (there is no need for more threads than
+     tiles). Each thread will keep taking tiles until they are
+     finished. */
+  nt = ( gen.ntiles[0]*gen.ntiles[1] < p->cp.numthreads
+         ? gen.ntiles[0]*gen.ntiles[1]
+         : p->cp.numthreads );
+  gal_threads_spin_off(warponthread, &gen, nt, nt);
+
+  /* Clean up. */
+  pthread_mutex_destroy(&gen.mutex);
+  gal_data_free(p->lattice);
+}
+
+
+
+
+
+
 
 
 
@@ -294,7 +727,7 @@ warponthread(void *inparam)
 void
 warppreparations(struct warpparams *p)
 {
-  double is0=p->input->dsize[0], is1=p->input->dsize[1];
+  double is0=p->isize[0], is1=p->isize[1];
 
   double output[8], forarea[8];
   double icrn[8]={0,0,0,0,0,0,0,0};
@@ -342,10 +775,14 @@ warppreparations(struct warpparams *p)
 
   /* We now know the size of the output and the starting and ending
      coordinates in the output image (bottom left corners of pixels)
-     for the transformation. */
-  p->output=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize,
-                           p->input->wcs, 0, p->cp.minmapsize, "Warped",
-                           p->input->unit, NULL);
+     for the transformation. When warping in bands, the output is only
+     allocated band-by-band, so here it is zero-dimensional and only
+     keeps the meta-data. */
+  p->osize[0]=dsize[0];
+  p->osize[1]=dsize[1];
+  p->output=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, p->bandmem ? 0 : 2,
+                           dsize, p->input->wcs, 0, p->cp.minmapsize,
+                           "Warped", p->input->unit, NULL);
 
 
   /* Order the corners of the inverse-transformed pixel (from the
@@ -398,6 +835,76 @@ warppreparations(struct warpparams *p)
   printf("xmin: %.3f\nxmax: %.3f\nymin: %.3f\nymax: %.3f\n",
          xmin, xmax, ymin, ymax);
   */
+
+  /* If the transformation only scales and shifts the two axes (the
+     off-diagonal and perspective elements of the inverse matrix are
+     zero), the separable resampling can be used. */
+  p->separable = ( p->inverse[1]==0.0 && p->inverse[3]==0.0
+                   && p->inverse[6]==0.0 && p->inverse[7]==0.0 );
+}
+
+
+
+
+
+/* When warping in bands, the output HDU (with all its keywords) is
+   created here and kept open for the bands to be written into it. */
+static void
+warp_output_open_bands(struct warpparams *p, gal_fits_list_key_t *headers)
+{
+  void *blank;
+  char *wcsstr;
+  int nkeyrec, status=0;
+  uint8_t type=p->cp.type;
+  long naxes[2]={p->osize[1], p->osize[0]};
+  int datatype=gal_fits_type_to_datatype(type);
+
+  /* Create the image HDU. */
+  p->outfits=gal_fits_open_to_write(p->cp.output);
+  if( fits_create_img(p->outfits, gal_fits_type_to_bitpix(type), 2, naxes,
+                      &status) )
+    gal_fits_io_error(status, NULL);
+
+  /* Remove the two comment lines put by CFITSIO (see
+     `gal_fits_img_write_to_ptr'). */
+  fits_delete_key(p->outfits, "COMMENT", &status);
+  fits_delete_key(p->outfits, "COMMENT", &status);
+  status=0;
+
+  /* We don't know if the output will have blank pixels before it is
+     warped, so for integer types, the BLANK keyword is always written. */
+  if(type!=GAL_TYPE_FLOAT32 && type!=GAL_TYPE_FLOAT64)
+    {
+      blank=gal_blank_alloc_write(type);
+      if(fits_write_key(p->outfits, datatype, "BLANK", blank,
+                        "Pixels with no data.", &status) )
+        gal_fits_io_error(status, "adding the BLANK keyword");
+      free(blank);
+    }
+
+  /* Write the name and units. */
+  if(p->output->name)
+    fits_write_key(p->outfits, TSTRING, "EXTNAME", p->output->name, "",
+                   &status);
+  if(p->output->unit)
+    fits_write_key(p->outfits, TSTRING, "BUNIT", p->output->unit, "",
+                   &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Write the WCS. */
+  if(p->output->wcs)
+    {
+      gal_wcs_decompose_pc_cdelt(p->output->wcs);
+      status=wcshdo(WCSHDO_safe, p->output->wcs, &nkeyrec, &wcsstr);
+      if(status)
+        error(EXIT_FAILURE, 0, "%s: wcshdo ERROR %d: %s", __func__,
+              status, wcs_errmsg[status]);
+      gal_fits_key_write_wcsstr(p->outfits, wcsstr, nkeyrec);
+      free(wcsstr);
+    }
+
+  /* Write the other keywords. */
+  gal_fits_key_write_version(p->outfits, headers, PROGRAM_STRING);
 }
 
 
@@ -460,10 +967,17 @@ correct_wcs_save_output(struct warpparams *p)
   if( fabs(diff/pixelscale[0])<RELATIVEFLTERROR )
     wcs->pc[3] =  ( (wcs->pc[3] < 0.0f ? -1.0f : 1.0f) * fabs(wcs->pc[0]) );
 
-  /* Save the output into the proper type and write it. */
-  if(p->cp.type!=p->output->type)
-    p->output=gal_data_copy_to_new_type_free(p->output, p->cp.type);
-  gal_fits_img_write(p->output, p->cp.output, headers, PROGRAM_STRING);
+  /* Save the output into the proper type and write it. When warping in
+     bands, only the header is written here, the pixels are written as
+     each band is warped. */
+  if(p->bandmem)
+    warp_output_open_bands(p, headers);
+  else
+    {
+      if(p->cp.type!=p->output->type)
+        p->output=gal_data_copy_to_new_type_free(p->output, p->cp.type);
+      gal_fits_img_write(p->output, p->cp.output, headers, PROGRAM_STRING);
+    }
 
   /* Clean up. */
   free(pixelscale);
@@ -489,79 +1003,359 @@ correct_wcs_save_output(struct warpparams *p)
 
 
 /***************************************************************/
-/**************       Outside function        ******************/
+/**************     Band-by-band warping      ******************/
 /***************************************************************/
-void
-warp(struct warpparams *p)
+/* When the input and output images are too large to fit in memory, the
+   output can be warped in bands of rows (with `--bandmem'). For each band,
+   only the region of the input that it covers is read, and once the band
+   is warped, it is written into the output HDU. The bands are pipelined:
+   while one band is being warped (on all the threads), the input of the
+   next band is read and the previous band is written on another
+   thread. Therefore at any moment, at most two bands are in memory, so
+   each band is defined to need at most half of `--bandmem'. */
+struct warpband
+{
+  size_t          row;    /* First output row of this band (from 0).   */
+  size_t         nrow;    /* Number of output rows in this band.       */
+  size_t     ifpix[2];    /* First necessary input pixel (from 0).     */
+  size_t     isize[2];    /* Size of the necessary input region.       */
+  gal_data_t      *in;    /* Necessary input pixels.                   */
+  gal_data_t     *out;    /* The warped band.                          */
+};
+
+struct warpbandio
 {
-  int err;
-  pthread_t t;          /* All thread ids saved in this, not used. */
-  pthread_attr_t attr;
-  pthread_barrier_t b;
-  struct iwpparams *iwp;
-  size_t nt=p->cp.numthreads;
-  size_t i, nb, *indexs, thrdcols;
+  struct warpparams  *p;  /* Main program parameters.                  */
+  struct warpband *read;  /* Band to read the input of (or NULL).      */
+  struct warpband *write; /* Band to write into the output (or NULL).  */
+};
 
 
-  /* Array keeping thread parameters for each thread. */
-  errno=0;
-  iwp=malloc(nt*sizeof *iwp);
-  if(iwp==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for iwp",
-          __func__, nt*sizeof *iwp);
 
 
-  /* Prepare the output array and all the necessary things: */
-  warppreparations(p);
+
+/* Find the region of the input that is necessary for the band (its
+   `row' and `nrow' must be set) and return the number of bytes that are
+   necessary for warping it. Since the sides of the band are straight
+   lines in the input also, the region is the bounding box of its four
+   corners. One extra pixel is added on each side to account for
+   floating point errors. */
+static size_t
+warp_band_region(struct warpparams *p, struct warpband *band)
+{
+  size_t i;
+  long start[2], end[2], is[2]={p->isize[1], p->isize[0]};
+  double icrn[8], min[2]={DBL_MAX, DBL_MAX}, max[2]={-DBL_MAX, -DBL_MAX};
+  double x0=p->outfpixval[0]-0.5f, x1=p->outfpixval[0]+p->osize[1]-0.5f;
+  double y0=p->outfpixval[1]+band->row-0.5f, y1=y0+band->nrow;
+  double ocrn[8]={x0, y0,   x1, y0,   x0, y1,   x1, y1};
+
+  /* Transform the corners into the input and find their range. */
+  for(i=0;i<4;++i)
+    {
+      mappoint(&ocrn[i*2], p->inverse, &icrn[i*2]);
+      if(icrn[i*2]   < min[0]) min[0]=icrn[i*2];
+      if(icrn[i*2]   > max[0]) max[0]=icrn[i*2];
+      if(icrn[i*2+1] < min[1]) min[1]=icrn[i*2+1];
+      if(icrn[i*2+1] > max[1]) max[1]=icrn[i*2+1];
+    }
+
+  /* Find the range of input pixels (in FITS order and coordinates). */
+  for(i=0;i<2;++i)
+    {
+      start[i] = nearestint_halfhigher(min[i]) - 1;
+      end[i]   = nearestint_halflower(max[i])  + 1;
+      if(start[i]<1)   start[i]=1;
+      if(end[i]>is[i]) end[i]=is[i];
+    }
+
+  /* Write the region (in C order and counting from 0). */
+  if(start[0]>end[0] || start[1]>end[1])
+    band->isize[0]=band->isize[1]=band->ifpix[0]=band->ifpix[1]=0;
+  else
+    {
+      band->ifpix[0] = start[1]-1;
+      band->ifpix[1] = start[0]-1;
+      band->isize[0] = end[1]-start[1]+1;
+      band->isize[1] = end[0]-start[0]+1;
+    }
+
+  /* Return the necessary memory: the input region, the output band (and
+     its copy when it is converted to the output type) and the corner
+     lattice (for the general case). */
+  return ( band->isize[0] * band->isize[1] * sizeof(double)
+           + band->nrow * p->osize[1] * ( sizeof(double)
+                                          + gal_type_sizeof(p->cp.type) )
+           + ( p->separable
+               ? 0
+               : (band->nrow+1) * (p->osize[1]+1) * 2 * sizeof(double) ) );
+}
+
+
+
+
+
+/* Divide the output rows into bands: each band has the largest number of
+   rows that fit in half of the given memory. */
+static struct warpband *
+warp_band_plan(struct warpparams *p, size_t *numbands)
+{
+  struct warpband *bands=NULL, tmp;
+  size_t lo, hi, size=0, num=0, row=0;
+  size_t maxmem=p->bandmem/2, os0=p->osize[0];
+
+  while(row<os0)
+    {
+      /* Make sure at least one row can be warped. */
+      tmp.row=row;
+      tmp.nrow=1;
+      if( warp_band_region(p, &tmp) > maxmem )
+        error(EXIT_FAILURE, 0, "%zu bytes are necessary to warp row %zu "
+              "of the output, but half of `--bandmem' is only %zu bytes. "
+              "Please give a larger value to `--bandmem'",
+              warp_band_region(p, &tmp), row+1, maxmem);
+
+      /* The memory of a band increases with its number of rows, so the
+         largest number of rows that fit can be found by bisection. */
+      lo=1;
+      hi=os0-row;
+      while(lo<hi)
+        {
+          tmp.nrow = lo + (hi-lo+1)/2;
+          if( warp_band_region(p, &tmp) > maxmem ) hi=tmp.nrow-1;
+          else                                     lo=tmp.nrow;
+        }
+
+      /* Add this band to the list. */
+      if(num==size)
+        {
+          size = size ? size*2 : 16;
+          errno=0;
+          bands=realloc(bands, size*sizeof *bands);
+          if(bands==NULL)
+            error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for "
+                  "`bands'", __func__, size*sizeof *bands);
+        }
+      bands[num].row=row;
+      bands[num].nrow=lo;
+      warp_band_region(p, &bands[num]);
+      bands[num].in=bands[num].out=NULL;
+
+      /* Go onto the next band. */
+      row+=lo;
+      ++num;
+    }
+
+  /* Return the bands. */
+  *numbands=num;
+  return bands;
+}
+
 
 
-  /* Distribute the output pixels into the threads: */
-  gal_threads_dist_in_threads(p->output->size, nt, &indexs, &thrdcols);
 
 
-  /* Start the convolution. */
-  if(nt==1)
+/* Read the necessary region of the input into `band->in'. Blank values
+   of integer images are converted to NaN by CFITSIO. */
+static void
+warp_band_read(struct warpparams *p, struct warpband *band)
+{
+  double nulval=NAN;
+  int anynul, status=0;
+  long fpixel[2], lpixel[2], inc[2]={1,1};
+
+  /* This band doesn't cover any part of the input. */
+  if(band->isize[0]==0) return;
+
+  /* Allocate the space and read the region (in FITS order). */
+  band->in=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, band->isize, NULL, 0,
+                          p->cp.minmapsize, NULL, NULL, NULL);
+  fpixel[0] = band->ifpix[1] + 1;
+  fpixel[1] = band->ifpix[0] + 1;
+  lpixel[0] = band->ifpix[1] + band->isize[1];
+  lpixel[1] = band->ifpix[0] + band->isize[0];
+  if( fits_read_subset(p->infits, TDOUBLE, fpixel, lpixel, inc, &nulval,
+                       band->in->array, &anynul, &status) )
+    gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
+/* Write the warped band into its place in the output HDU and free it. */
+static void
+warp_band_write(struct warpparams *p, struct warpband *band)
+{
+  int status=0;
+  gal_data_t *towrite;
+  long fpixel[2]={1, band->row+1};
+
+  /* Convert the band to the output type if necessary. */
+  towrite = ( band->out->type==p->cp.type
+              ? band->out
+              : gal_data_copy_to_new_type(band->out, p->cp.type) );
+
+  /* Write the band. */
+  if( fits_write_pix(p->outfits, gal_fits_type_to_datatype(towrite->type),
+                     fpixel, towrite->size, towrite->array, &status) )
+    gal_fits_io_error(status, NULL);
+
+  /* Clean up. */
+  if(towrite!=band->out) gal_data_free(towrite);
+  gal_data_free(band->out);
+  band->out=NULL;
+}
+
+
+
+
+
+/* Function for the reading/writing thread. The band is written first so
+   its memory is freed before the next one is allocated. */
+static void *
+warp_band_io(void *in_prm)
+{
+  struct warpbandio *io=(struct warpbandio *)in_prm;
+
+  if(io->write) warp_band_write(io->p, io->write);
+  if(io->read)  warp_band_read(io->p, io->read);
+  return NULL;
+}
+
+
+
+
+
+/* Warp one band: the input and output of the main structure are set to
+   those of the band, and the first output pixel is moved to the start of
+   the band, so the same functions as a full image can be used. */
+static void
+warp_band_warp(struct warpparams *p, struct warpband *band)
+{
+  double *d, *df, ofpix=p->outfpixval[1];
+  gal_data_t *input=p->input, *output=p->output;
+  size_t dsize[2]={band->nrow, p->osize[1]};
+
+  /* Allocate the output band. */
+  band->out=gal_data_alloc(NULL, GAL_TYPE_FLOAT64, 2, dsize, NULL, 0,
+                           p->cp.minmapsize, NULL, NULL, NULL);
+
+  /* Warp the band. */
+  if(band->in)
     {
-      iwp[0].p=p;
-      iwp[0].indexs=indexs;
-      warponthread(&iwp[0]);
+      p->input=band->in;
+      p->output=band->out;
+      p->outfpixval[1]+=band->row;
+      p->ioffset[0]=band->ifpix[0];
+      p->ioffset[1]=band->ifpix[1];
+      if(p->separable) warp_separable(p);
+      else             warp_general(p);
+      p->input=input;
+      p->output=output;
+      p->outfpixval[1]=ofpix;
+      p->ioffset[0]=p->ioffset[1]=0;
+      gal_data_free(band->in);
+      band->in=NULL;
     }
   else
     {
-      /* Initialize the attributes. Note that this running thread
-         (that spinns off the nt threads) is also a thread, so the
-         number the barrier should be one more than the number of
-         threads spinned off. */
-      if(p->output->size<nt) nb=p->output->size+1;
-      else                   nb=nt+1;
-      gal_threads_attr_barrier_init(&attr, &b, nb);
-
-      /* Spin off the threads: */
-      for(i=0;i<nt;++i)
-        if(indexs[i*thrdcols]!=GAL_BLANK_SIZE_T)
-          {
-            iwp[i].p=p;
-            iwp[i].b=&b;
-            iwp[i].indexs=&indexs[i*thrdcols];
-            err=pthread_create(&t, &attr, warponthread, &iwp[i]);
-            if(err)
-              error(EXIT_FAILURE, 0, "%s: can't create thread %zu",
-                    __func__, i);
-          }
+      df=(d=band->out->array)+band->out->size;
+      do *d++=NAN; while(d<df);
+    }
+}
+
 
-      /* Wait for all threads to finish and free the spaces. */
-      pthread_barrier_wait(&b);
-      pthread_attr_destroy(&attr);
-      pthread_barrier_destroy(&b);
+
+
+
+static void
+warp_bands(struct warpparams *p)
+{
+  int err, status=0;
+  pthread_t t;
+  struct warpbandio io;
+  struct warpband *bands;
+  size_t i, numbands;
+
+  /* Divide the output into bands and open the input. */
+  bands=warp_band_plan(p, &numbands);
+  p->infits=gal_fits_hdu_open_format(p->inputname, p->cp.hdu, 0);
+
+  /* Read the input of the first band, then go over the bands: while each
+     band is being warped, the previous band is written and the input of
+     the next band is read on another thread. */
+  io.p=p;
+  warp_band_read(p, &bands[0]);
+  for(i=0;i<numbands;++i)
+    {
+      io.read  = i+1<numbands ? &bands[i+1] : NULL;
+      io.write = i            ? &bands[i-1] : NULL;
+      if(io.read || io.write)
+        {
+          err=pthread_create(&t, NULL, warp_band_io, &io);
+          if(err)
+            error(EXIT_FAILURE, 0, "%s: can't create thread for reading "
+                  "and writing band %zu", __func__, i+1);
+        }
+      warp_band_warp(p, &bands[i]);
+      if(io.read || io.write) pthread_join(t, NULL);
     }
+  warp_band_write(p, &bands[numbands-1]);
+
+  /* Clean up. */
+  free(bands);
+  fits_close_file(p->infits, &status);
+  fits_close_file(p->outfits, &status);
+  gal_fits_io_error(status, NULL);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 
 
-  /* Save the output. */
-  correct_wcs_save_output(p);
+
+
+
+
+/***************************************************************/
+/**************       Outside function        ******************/
+/***************************************************************/
+void
+warp(struct warpparams *p)
+{
+  /* Prepare the output array and all the necessary things: */
+  warppreparations(p);
+
+
+  /* Do the warping: when the transformation only scales and shifts the
+     axes, the much faster separable resampling can be used. When warping
+     in bands, the output's header is written first and each band is
+     written after it is warped. */
+  if(p->bandmem)
+    {
+      correct_wcs_save_output(p);
+      warp_bands(p);
+    }
+  else
+    {
+      if(p->separable) warp_separable(p);
+      else             warp_general(p);
+      correct_wcs_save_output(p);
+    }
 
 
   /* Free the allocated spaces: */
-  free(iwp);
-  free(indexs);
   gal_data_free(p->output);
 }
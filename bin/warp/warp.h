@@ -31,16 +31,9 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #define RELATIVEFLTERROR 1e-6
 
 
-/* Internal structure. */
-struct iwpparams
-{
-  /* General input parameters: */
-  struct warpparams *p;
-
-  /* Thread parameters. */
-  size_t          *indexs;    /* Indexs to be used in this thread.     */
-  pthread_barrier_t    *b;    /* Barrier to keep threads waiting.      */
-};
+/* Width of the square tiles of output pixels that are given to each
+   thread (in the general case). */
+#define WARP_TILE_WIDTH 64
 
 
 /* Extenal functions. */
@@ -487,8 +487,18 @@ gal_fits_open_to_write(char *filename)
   /* When the file exists just open it. Otherwise, create the file. But we
      want to leave the first extension as a blank extension and put the
      image in the next extension to be consistent between tables and
-     images. */
-  if(access(filename,F_OK) == -1 )
+     images. An in-memory file (CFITSIO's `mem://') is lost when it is
+     closed, so it is only created (with the blank extension) and
+     returned. */
+  if( !strncmp(filename, "mem://", 6) )
+    {
+      if( fits_create_file(&fptr, filename, &status) )
+        gal_fits_io_error(status, NULL);
+      if( fits_create_img(fptr, BYTE_IMG, 0, &naxes, &status) )
+        gal_fits_io_error(status, NULL);
+      return fptr;
+    }
+  else if(access(filename,F_OK) == -1 )
     {
       /* Create the file. */
       if( fits_create_file(&fptr, filename, &status) )
@@ -2031,33 +2041,130 @@ gal_fits_tab_info(char *filename, char *hdu, size_t *numcols,
 
 
 
+/* Flag the rows (within the `nread' rows starting from `first') where the
+   values of all the columns in `ranges' are within their range. The table
+   is read in groups of `groupsize' rows, and only the columns in the
+   ranges are read. The number of flagged rows is put in `numflagged'. */
+static uint8_t *
+fits_tab_flag_rows(fitsfile *fptr, size_t first, size_t nread,
+                   long groupsize, gal_table_range_t *ranges,
+                   size_t *numflagged)
+{
+  uint8_t *flags;
+  double *v, *values;
+  gal_table_range_t *r;
+  long numingroup;
+  double nanval=NAN;
+  int status=0, anynul=0;
+  size_t i, start, numranges=0;
+
+  /* Allocate space to keep the values of all the range columns in one
+     group of rows. */
+  for(r=ranges; r!=NULL; r=r->next) ++numranges;
+  values=gal_data_malloc_array(GAL_TYPE_FLOAT64, numranges*groupsize);
+  flags=gal_data_malloc_array(GAL_TYPE_UINT8, nread);
+
+  /* Go over the groups of rows. Note that CFITSIO will convert the values
+     to double and blank values will be NaN (so they will not be
+     flagged). */
+  *numflagged=0;
+  for(start=0; start<nread; start+=groupsize)
+    {
+      /* Read the range columns in this group. */
+      numingroup = start+groupsize>nread ? nread-start : groupsize;
+      for(r=ranges, v=values; r!=NULL; r=r->next, v+=groupsize)
+        fits_read_col(fptr, TDOUBLE, r->index+1, first+start+1, 1,
+                      numingroup, &nanval, v, &anynul, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Check each row. */
+      for(i=0;i<numingroup;++i)
+        {
+          flags[start+i]=1;
+          for(r=ranges, v=values; r!=NULL; r=r->next, v+=groupsize)
+            if( !(v[i]>=r->min && v[i]<=r->max) )
+              { flags[start+i]=0; break; }
+          *numflagged += flags[start+i];
+        }
+    }
+
+  /* Clean up and return. */
+  free(values);
+  return flags;
+}
+
+
+
+
+
 /* Read the column indexs given in the `indexll' linked list from a FITS
    table into a linked list of data structures, note that this is a
    low-level function, so the output data linked list is the inverse of the
-   input indexs linked list. */
+   input indexs linked list.
+
+   FITS tables are stored row-by-row (all the columns of one row are
+   contiguous in the file). So reading each column over all the rows
+   independently will go over the whole file once for every requested
+   column. To avoid this, we read the table in groups of rows: CFITSIO's
+   `fits_get_rowsize' gives the number of rows that fit in its internal
+   buffers, so within each group all the requested columns are read from
+   the same buffered part of the file, and the file is only read once.
+
+   When `rowsel' is given, only the selected rows are read. If the
+   selection has ranges of values, the range columns are read first to
+   flag the desired rows. Then each group of rows is read into a temporary
+   buffer and only the flagged rows are copied into the output. */
 gal_data_t *
 gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *allcols, gal_list_sizet_t *indexll,
-                  int minmapsize)
+                  int minmapsize, gal_table_rowsel_t *rowsel)
 {
-  size_t i=0;
-  void *blank;
-  size_t dsize;
+  void **blank;
   char **strarr;
   fitsfile *fptr;
+  uint8_t *flags=NULL;
   gal_data_t *out=NULL;
-  int status=0, anynul=0;
   gal_list_sizet_t *ind;
+  int status=0, anynul=0;
+  long optimalrows, numingroup;
+  gal_data_t **cols, **bufs=NULL, *tmp;
+  size_t i, c, o, ncols=0, dsize, start, first=0, nread=numrows;
 
-  /* Open the FITS file */
+  /* Set the range of rows to read. */
+  if(rowsel)
+    {
+      first = rowsel->first<numrows ? rowsel->first : numrows;
+      nread = ( rowsel->number && first+rowsel->number<numrows
+                ? rowsel->number : numrows-first );
+    }
+  if(nread==0) return NULL;
+
+  /* Open the FITS file and find the optimal number of rows to read in
+     each group. */
   fptr=gal_fits_hdu_open_format(filename, hdu, 1);
+  fits_get_rowsize(fptr, &optimalrows, &status);
+  gal_fits_io_error(status, NULL);
+  if(optimalrows<1) optimalrows=1;
 
-  /* Pop each index and read/store the array. */
+  /* If there are ranges of values, flag the desired rows. */
+  dsize=nread;
+  if(rowsel && rowsel->ranges)
+    {
+      flags=fits_tab_flag_rows(fptr, first, nread, optimalrows,
+                               rowsel->ranges, &dsize);
+      if(dsize==0)
+        {
+          free(flags);
+          fits_close_file(fptr, &status);
+          gal_fits_io_error(status, NULL);
+          return NULL;
+        }
+    }
+
+  /* Allocate the necessary data structure (including the array) for each
+     requested column. */
   for(ind=indexll; ind!=NULL; ind=ind->next)
     {
-      /* Allocate the necessary data structure (including the array) for
-         this column. */
-      dsize=numrows;
       gal_list_data_add_alloc(&out, NULL, allcols[ind->v].type, 1, &dsize,
                               NULL, 0, minmapsize, allcols[ind->v].name,
                               allcols[ind->v].unit, allcols[ind->v].comment);
@@ -2067,7 +2174,7 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
          disp_width element of the data structure, which is done
          automatically in `gal_fits_table_info'. */
       if(out->type==GAL_TYPE_STRING)
-        for(i=0;i<numrows;++i)
+        for(i=0;i<dsize;++i)
           {
             strarr=out->array;
             errno=0;
@@ -2078,15 +2185,119 @@ gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                     (allcols[ind->v].disp_width+1) * sizeof *strarr[i], i);
           }
 
-      /* Allocate a blank value for the given type and read/store the
-         column using CFITSIO. Afterwards, free the blank value. */
-      blank=gal_blank_alloc_write(out->type);
-      fits_read_col(fptr, gal_fits_type_to_datatype(out->type), ind->v+1,
-                    1, 1, out->size, blank, out->array, &anynul, &status);
+      /* Count the number of columns. */
+      ++ncols;
+    }
+
+  /* If no columns were requested, close the file and return. */
+  if(ncols==0)
+    {
+      free(flags);
+      fits_close_file(fptr, &status);
       gal_fits_io_error(status, NULL);
-      free(blank);
+      return NULL;
     }
 
+  /* Keep a pointer to each output column (in the same order as `indexll',
+     which is the inverse of `out') along with its blank value. */
+  errno=0;
+  cols=malloc(ncols*sizeof *cols);
+  if(cols==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `cols'",
+          __func__, ncols*sizeof *cols);
+  errno=0;
+  blank=malloc(ncols*sizeof *blank);
+  if(blank==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `blank'",
+          __func__, ncols*sizeof *blank);
+  c=ncols;
+  for(tmp=out; tmp!=NULL; tmp=tmp->next)
+    {
+      cols[--c]=tmp;
+      blank[c]=gal_blank_alloc_write(tmp->type);
+    }
+
+  /* When only some rows in each group are desired, each column of a group
+     is first read into a buffer. Note that the buffers have to be in RAM
+     (they are re-used many times). */
+  if(flags)
+    {
+      errno=0;
+      bufs=malloc(ncols*sizeof *bufs);
+      if(bufs==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `bufs'",
+              __func__, ncols*sizeof *bufs);
+      dsize=optimalrows;
+      for(ind=indexll, c=0; ind!=NULL; ind=ind->next, ++c)
+        {
+          bufs[c]=gal_data_alloc(NULL, cols[c]->type, 1, &dsize, NULL, 0,
+                                 -1, NULL, NULL, NULL);
+          if(bufs[c]->type==GAL_TYPE_STRING)
+            for(i=0;i<dsize;++i)
+              {
+                strarr=bufs[c]->array;
+                errno=0;
+                strarr[i]=calloc(allcols[ind->v].disp_width+1,
+                                 sizeof *strarr[i]);
+                if(strarr[i]==NULL)
+                  error(EXIT_FAILURE, errno, "%s: allocating %zu bytes "
+                        "for buffer string %zu", __func__,
+                        (allcols[ind->v].disp_width+1) * sizeof *strarr[i],
+                        i);
+              }
+        }
+    }
+
+  /* Read all the columns within each group of rows. Note that CFITSIO
+     counts the rows and columns from 1. */
+  o=0;
+  for(start=0; start<nread; start+=optimalrows)
+    {
+      /* Read this group of rows. */
+      numingroup = ( start+optimalrows>nread
+                     ? nread-start : optimalrows );
+      for(ind=indexll, c=0; ind!=NULL; ind=ind->next, ++c)
+        fits_read_col(fptr, gal_fits_type_to_datatype(cols[c]->type),
+                      ind->v+1, first+start+1, 1, numingroup, blank[c],
+                      ( flags
+                        ? bufs[c]->array
+                        : gal_data_ptr_increment(cols[c]->array, start,
+                                                 cols[c]->type) ),
+                      &anynul, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Copy the flagged rows of this group into the output. */
+      if(flags)
+        for(i=0;i<numingroup;++i)
+          if(flags[start+i])
+            {
+              for(c=0;c<ncols;++c)
+                {
+                  if(cols[c]->type==GAL_TYPE_STRING)
+                    strcpy( ((char **)(cols[c]->array))[o],
+                            ((char **)(bufs[c]->array))[i] );
+                  else
+                    memcpy(gal_data_ptr_increment(cols[c]->array, o,
+                                                  cols[c]->type),
+                           gal_data_ptr_increment(bufs[c]->array, i,
+                                                  cols[c]->type),
+                           gal_type_sizeof(cols[c]->type));
+                }
+              ++o;
+            }
+    }
+
+  /* Clean up. */
+  if(flags)
+    {
+      for(c=0;c<ncols;++c) gal_data_free(bufs[c]);
+      free(flags);
+      free(bufs);
+    }
+  for(c=0;c<ncols;++c) free(blank[c]);
+  free(blank);
+  free(cols);
+
   /* Close the FITS file */
   fits_close_file(fptr, &status);
   gal_fits_io_error(status, NULL);
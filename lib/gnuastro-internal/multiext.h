@@ -0,0 +1,108 @@
+/*********************************************************************
+Write many small outputs as extensions of a few FITS files.
+This is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#ifndef __GAL_MULTIEXT_H__
+#define __GAL_MULTIEXT_H__
+
+/* Include other headers if necessary here. Note that other header files
+   must be included before the C++ preparations below */
+#include <pthread.h>
+#include <gnuastro/fits.h>
+
+
+
+/* C++ Preparations */
+#undef __BEGIN_C_DECLS
+#undef __END_C_DECLS
+#ifdef __cplusplus
+# define __BEGIN_C_DECLS extern "C" {
+# define __END_C_DECLS }
+#else
+# define __BEGIN_C_DECLS                /* empty */
+# define __END_C_DECLS                  /* empty */
+#endif
+/* End of C++ preparations */
+
+
+
+/* Actual header contants (the above were for the Pre-processor). */
+__BEGIN_C_DECLS  /* From C++ preparations */
+
+
+
+/* Name of the extension keeping the index of the written extensions. */
+#define GAL_MULTIEXT_INDEX_NAME "INDEX"
+
+
+
+
+/* The outputs are given to the writer (with `gal_multiext_add') as
+   in-memory FITS files (see CFITSIO's `mem://' files) with a position
+   (from 0 to `total-1'). The writer thread copies them into the output
+   file(s) in the order of their positions (so the outputs don't depend
+   on how the work was distributed between the threads). At any moment,
+   at most `window' outputs can be waiting to be written. */
+typedef struct
+{
+  size_t         numshards;  /* Number of output files.                 */
+  char              **names; /* Name of each output file.               */
+  fitsfile          **fptrs; /* Pointer to each output file.            */
+  size_t             total;  /* Total number of positions.              */
+  size_t            window;  /* Maximum number of waiting outputs.      */
+  size_t              next;  /* Position of the next output to write.   */
+  fitsfile         **queue;  /* Waiting outputs (`window' elements).    */
+  uint8_t          *filled;  /* ==1: this queue element is filled.      */
+  size_t          *queueid;  /* ID of each waiting output.              */
+  char         **queuename;  /* Extension name of each waiting output.  */
+  size_t          numindex;  /* Number of written outputs.              */
+  int64_t         *indexid;  /* ID of each written output.              */
+  char         **indexname;  /* Extension name of each written output.  */
+  int16_t      *indexshard;  /* Output file (counting from 1).          */
+  int32_t        *indexhdu;  /* HDU in its output file (counting from 0).*/
+  pthread_t         thread;  /* The writer thread.                      */
+  pthread_mutex_t    mutex;  /* Mutex to access the queue.              */
+  pthread_cond_t      cond;  /* Signal changes in the queue.            */
+} gal_multiext_t;
+
+
+
+
+
+gal_multiext_t *
+gal_multiext_start(char **names, size_t numshards, size_t total,
+                   size_t window, int dontdelete);
+
+char *
+gal_multiext_file(gal_multiext_t *me, size_t pos);
+
+void
+gal_multiext_add(gal_multiext_t *me, size_t pos, fitsfile *mem,
+                 size_t id, char *name);
+
+void
+gal_multiext_finish(gal_multiext_t *me);
+
+
+
+__END_C_DECLS    /* From C++ preparations */
+
+#endif           /* __GAL_MULTIEXT_H__ */
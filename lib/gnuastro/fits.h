@@ -72,6 +72,12 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/* `gnuastro/table.h' also includes this header, so when it is included
+   first, `gal_table_rowsel_t' isn't defined yet. */
+struct gal_table_rowsel_t;
+
+
+
 
 /* To create a linked list of headers. */
 typedef struct gal_fits_list_key_t
@@ -253,7 +259,7 @@ gal_fits_tab_info(char *filename, char *hdu, size_t *numcols,
 gal_data_t *
 gal_fits_tab_read(char *filename, char *hdu, size_t numrows,
                   gal_data_t *colinfo, gal_list_sizet_t *indexll,
-                  int minmapsize);
+                  int minmapsize, struct gal_table_rowsel_t *rowsel);
 
 void
 gal_fits_tab_write(gal_data_t *cols, gal_list_str_t *comments,
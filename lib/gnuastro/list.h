@@ -304,6 +304,76 @@ gal_list_dosizet_free(gal_list_dosizet_t *largest);
 
 
 
+/****************************************************************
+ *****************      Min-heap of size_t     ******************
+ ****************************************************************/
+typedef struct gal_list_hsizet_node_t
+{
+  size_t v;                       /* The actual value.              */
+  float s;                        /* The parameter to sort by.      */
+  size_t o;                       /* Order of addition (for ties).  */
+} gal_list_hsizet_node_t;
+
+typedef struct gal_list_hsizet_t
+{
+  gal_list_hsizet_node_t *nodes;  /* Array of nodes in the heap.    */
+  size_t num;                     /* Number of nodes in the heap.   */
+  size_t size;                    /* Allocated number of nodes.     */
+  size_t counter;                 /* Number of nodes added so far.  */
+} gal_list_hsizet_t;
+
+void
+gal_list_hsizet_init(gal_list_hsizet_t *heap, size_t size);
+
+void
+gal_list_hsizet_add(gal_list_hsizet_t *heap, size_t value, float tosort);
+
+size_t
+gal_list_hsizet_pop_smallest(gal_list_hsizet_t *heap, float *tosort);
+
+void
+gal_list_hsizet_to_sizet(gal_list_hsizet_t *heap, gal_list_sizet_t **out);
+
+void
+gal_list_hsizet_free(gal_list_hsizet_t *heap);
+
+
+
+
+
+/****************************************************************
+ ****************   Bucket queue of size_t   ********************
+ ****************************************************************/
+typedef struct gal_list_bsizet_t
+{
+  size_t **v;                     /* Values in each bucket.         */
+  size_t *num;                    /* Number of values in bucket.    */
+  size_t *start;                  /* First un-popped in bucket.     */
+  size_t *size;                   /* Allocated space in bucket.     */
+  size_t nbuckets;                /* Number of buckets.             */
+  size_t current;                 /* Smallest possibly full bucket. */
+  size_t numv;                    /* Total number of values.        */
+} gal_list_bsizet_t;
+
+void
+gal_list_bsizet_init(gal_list_bsizet_t *queue);
+
+void
+gal_list_bsizet_add(gal_list_bsizet_t *queue, size_t value, size_t key);
+
+size_t
+gal_list_bsizet_pop_smallest(gal_list_bsizet_t *queue, size_t *key);
+
+void
+gal_list_bsizet_reset(gal_list_bsizet_t *queue);
+
+void
+gal_list_bsizet_free(gal_list_bsizet_t *queue);
+
+
+
+
+
 /****************************************************************
  *****************        gal_data_t         ********************
  ****************************************************************/
@@ -25,6 +25,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 /* Include other headers if necessary here. Note that other header files
    must be included before the C++ preparations below */
+#include <stdint.h>
 
 
 
@@ -73,6 +74,12 @@ void
 gal_polygon_clip(double *s, size_t n, double *c, size_t m,
                  double *o, size_t *numcrn);
 
+int
+gal_polygon_is_convex(double *v, size_t n);
+
+void
+gal_polygon_fill(double *v, size_t n, size_t *dsize, uint8_t *mask);
+
 
 __END_C_DECLS    /* From C++ preparations */
 
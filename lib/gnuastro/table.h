@@ -26,6 +26,8 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 /* Include other headers if necessary here. Note that other header files
    must be included before the C++ preparations below */
 
+#include <time.h>
+
 #include <gnuastro/list.h>
 #include <gnuastro/fits.h>
 
@@ -121,6 +123,38 @@ enum gal_table_where_to_search
 
 
 
+
+
+/* Range of acceptable values in one column when reading a table (see
+   `gal_table_rowsel_t'). The column is identified with the same kind of
+   string that is given to `gal_table_read' for selecting columns. */
+typedef struct gal_table_range_t
+{
+  char                      *column;  /* Column number, name or regexp.  */
+  size_t                      index;  /* Column index (set internally). */
+  double                        min;  /* Minimum acceptable (inclusive). */
+  double                        max;  /* Maximum acceptable (inclusive). */
+  struct gal_table_range_t    *next;  /* Next range in the list.         */
+} gal_table_range_t;
+
+
+
+
+
+/* Selection of the rows to read from a table. Only the `number' rows
+   starting from row `first' (counting from zero) are considered, if
+   `number' is zero, all the rows until the end of the table are
+   considered. From these rows, only those where the values of all the
+   columns in `ranges' are within their range will be read. */
+typedef struct gal_table_rowsel_t
+{
+  size_t                      first;  /* First row to check (from 0).    */
+  size_t                     number;  /* Number of rows (0: to the end). */
+  gal_table_range_t         *ranges;  /* Ranges of values (can be NULL). */
+} gal_table_rowsel_t;
+
+
+
 /************************************************************************/
 /***************         Information about a table        ***************/
 /************************************************************************/
@@ -133,12 +167,25 @@ gal_table_print_info(gal_data_t *allcols, size_t numcols, size_t numrows);
 
 
 
+/************************************************************************/
+/***************            Native table cache            ***************/
+/************************************************************************/
+char *
+gal_table_cache_name(char *filename, char *hdu);
+
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      int minmapsize);
+
+
+
 /************************************************************************/
 /***************               Read a table               ***************/
 /************************************************************************/
 gal_data_t *
 gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
-               int searchin, int ignorecase, int minmapsize);
+               int searchin, int ignorecase, size_t numthreads,
+               int minmapsize, gal_table_rowsel_t *rowsel);
 
 
 
@@ -151,7 +198,8 @@ gal_table_comments_add_intro(gal_list_str_t **comments,
 
 void
 gal_table_write(gal_data_t *cols, gal_list_str_t *comments,
-                int tableformat, char *filename, int dontdelete);
+                int tableformat, char *filename, size_t numthreads,
+                int dontdelete);
 
 void
 gal_table_write_log(gal_data_t *logll, char *program_string,
@@ -27,6 +27,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
    must be included before the C++ preparations below */
 
 #include <gnuastro/list.h>
+#include <gnuastro/table.h>
 
 
 
@@ -83,14 +84,15 @@ gal_txt_table_info(char *filename, size_t *numcols, size_t *numrows);
 
 gal_data_t *
 gal_txt_table_read(char *filename, size_t numrows, gal_data_t *colinfo,
-                   gal_list_sizet_t *indexll, size_t minmapsize);
+                   gal_list_sizet_t *indexll, size_t numthreads,
+                   size_t minmapsize, gal_table_rowsel_t *rowsel);
 
 gal_data_t *
 gal_txt_image_read(char *filename, size_t minmapsize);
 
 void
 gal_txt_write(gal_data_t *input, gal_list_str_t *comment, char *filename,
-              int dontdelete);
+              size_t numthreads, int dontdelete);
 
 
 
@@ -52,6 +52,27 @@ __BEGIN_C_DECLS  /* From C++ preparations */
 
 
 
+/*************************************************************
+ ***********         Fast conversion structure     ***********
+ *************************************************************/
+typedef struct gal_wcs_fast_t
+{
+  int            toworld;  /* ==1: image to world, ==0: world to image. */
+  struct wcsprm     *wcs;  /* Copy of WCS, for the exact conversion.    */
+  size_t        dsize[2];  /* Number of grid nodes (C order).           */
+  double        start[2];  /* Input coordinates of the first node.      */
+  double            step;  /* Distance between the nodes.               */
+  double             ref;  /* Reference RA for continuity.              */
+  double          maxerr;  /* Maximum measured error (in pixels).       */
+  double             *c1;  /* First output coordinate on the nodes.     */
+  double             *c2;  /* Second output coordinate on the nodes.    */
+  uint8_t         *exact;  /* ==1: cell must be converted exactly.      */
+} gal_wcs_fast_t;
+
+
+
+
+
 /*************************************************************
  ***********               Read WCS                ***********
  *************************************************************/
@@ -100,11 +121,32 @@ gal_wcs_pixel_area_arcsec2(struct wcsprm *wcs);
 /**************************************************************/
 void
 gal_wcs_world_to_img(struct wcsprm *wcs, double *ra, double *dec,
-                     double **x, double **y, size_t size);
+                     double **x, double **y, size_t size,
+                     size_t numthreads);
 
 void
 gal_wcs_img_to_world(struct wcsprm *wcs, double *x, double *y,
-                     double **ra, double **dec, size_t size);
+                     double **ra, double **dec, size_t size,
+                     size_t numthreads);
+
+
+
+
+
+/**************************************************************/
+/**********      Fast (approximate) conversion     ************/
+/**************************************************************/
+gal_wcs_fast_t *
+gal_wcs_fast_make(struct wcsprm *wcs, double *range, int toworld,
+                  double tolerance, size_t numthreads);
+
+void
+gal_wcs_fast_convert(gal_wcs_fast_t *fast, double *in1, double *in2,
+                     double **out1, double **out2, size_t size,
+                     size_t numthreads);
+
+void
+gal_wcs_fast_free(gal_wcs_fast_t *fast);
 
 
 
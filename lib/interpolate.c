@@ -85,11 +85,10 @@ interpolate_close_neighbors_on_thread(void *in_prm)
 
   /* Rest of variables. */
   void *nv;
-  float pdist;
   uint8_t *b, *bf, *bb;
   gal_list_void_t *tvll;
-  gal_list_dosizet_t *lQ, *sQ;
-  size_t ngb_counter, dist, pind, *dinc;
+  gal_list_bsizet_t queue;
+  size_t ngb_counter, dist, pdist, pind, *dinc;
   size_t i, index, fullind, chstart=0, ndim=input->ndim;
   gal_data_t *median, *tin, *tout, *tnear, *nearest=NULL;
   size_t *icoord=gal_data_malloc_array(GAL_TYPE_SIZE_T, ndim);
@@ -103,6 +102,7 @@ interpolate_close_neighbors_on_thread(void *in_prm)
   bb=prm->blanks->array;
   bf=(b=fullflag)+input->size;
   dinc=gal_dimension_increment(ndim, dsize);
+  gal_list_bsizet_init(&queue);
   do *b = *bb++ ? INTERPOLATE_FLAGS_BLANK : 0; while(++b<bf);
 
 
@@ -180,15 +180,15 @@ interpolate_close_neighbors_on_thread(void *in_prm)
       gal_dimension_index_to_coord(index, ndim, dsize, icoord);
 
 
-      /* Start parsing the neighbors. We will use a two-way ordered linked
-         list structure. To start from the nearest and go out to the
-         farthest. */
-      lQ=sQ=NULL;
-      gal_list_dosizet_add(&lQ, &sQ, index, 0.0f);
-      while(sQ)
+      /* Start parsing the neighbors. The distances are integers, so we
+         will use a bucket queue to start from the nearest and go out to
+         the farthest. */
+      gal_list_bsizet_reset(&queue);
+      gal_list_bsizet_add(&queue, index, 0);
+      while(queue.numv)
         {
           /* Pop-out (p) an index from the queue: */
-          pind=gal_list_dosizet_pop_smallest(&lQ, &sQ, &pdist);
+          pind=gal_list_bsizet_pop_smallest(&queue, &pdist);
 
           /* If this isn't a blank value then add its values to the list of
              neighbor values. Note that we didn't check whether the values
@@ -206,13 +206,10 @@ interpolate_close_neighbors_on_thread(void *in_prm)
                   tin=tin->next;
                 }
 
-              /* If we have filled all the elements clean up the linked
-                 list and break out. */
+              /* If we have filled all the elements, break out (the queue
+                 is reset for the next element). */
               if(++ngb_counter>=prm->numneighbors)
-                {
-                  if(lQ) gal_list_dosizet_free(lQ);
-                  break;
-                }
+                break;
             }
 
           /* Go over all the neighbors of this popped pixel and add them to
@@ -232,7 +229,7 @@ interpolate_close_neighbors_on_thread(void *in_prm)
                  dist=gal_dimension_dist_manhattan(icoord, ncoord, ndim);
 
                  /* Add this neighbor to the list. */
-                 gal_list_dosizet_add(&lQ, &sQ, nind, dist);
+                 gal_list_bsizet_add(&queue, nind, dist);
 
                  /* Flag this neighbor as checked. */
                  flag[nind] |= INTERPOLATE_FLAGS_CHECKED;
@@ -243,7 +240,7 @@ interpolate_close_neighbors_on_thread(void *in_prm)
              shows, there were not enough points for
              interpolation. Normally, this loop should only be exited
              through the `currentnum>=numnearest' check above. */
-          if(sQ==NULL)
+          if(queue.numv==0)
             error(EXIT_FAILURE, 0, "%s: only %zu neighbors found while "
                   "you had asked to use %zu neighbors for close neighbor "
                   "interpolation", __func__, ngb_counter, prm->numneighbors);
@@ -268,6 +265,7 @@ interpolate_close_neighbors_on_thread(void *in_prm)
   /* Clean up. */
   for(tnear=nearest; tnear!=NULL; tnear=tnear->next) tnear->array=NULL;
   gal_list_data_free(nearest);
+  gal_list_bsizet_free(&queue);
   free(icoord);
   free(ncoord);
   free(dinc);
@@ -1172,6 +1172,318 @@ gal_list_dosizet_free(gal_list_dosizet_t *largest)
 
 
 
+/****************************************************************
+ *****************      Min-heap of size_t     ******************
+ ****************************************************************/
+/* The heap is kept in one contiguous array where the children of node `i'
+   are at `2i+1' and `2i+2'. Adding and popping are therefore O(log(n))
+   and no allocation is necessary once the array is large enough. When two
+   nodes have the same sorting value, the one that was added first is
+   popped first (like the doubly linked ordered list). */
+#define LIST_HSIZET_SMALLER(A,B) ( (A)->s < (B)->s                       \
+                                   || ( (A)->s == (B)->s                 \
+                                        && (A)->o < (B)->o ) )
+void
+gal_list_hsizet_init(gal_list_hsizet_t *heap, size_t size)
+{
+  heap->num=heap->counter=0;
+  heap->size = size ? size : 64;
+  errno=0;
+  heap->nodes=malloc(heap->size * sizeof *heap->nodes);
+  if(heap->nodes==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for the heap",
+          __func__, heap->size * sizeof *heap->nodes);
+}
+
+
+
+
+
+void
+gal_list_hsizet_add(gal_list_hsizet_t *heap, size_t value, float tosort)
+{
+  size_t i, parent;
+  gal_list_hsizet_node_t node, *nodes;
+
+  /* Make sure there is enough space. */
+  if(heap->num==heap->size)
+    {
+      heap->size *= 2;
+      errno=0;
+      heap->nodes=realloc(heap->nodes, heap->size * sizeof *heap->nodes);
+      if(heap->nodes==NULL)
+        error(EXIT_FAILURE, errno, "%s: re-allocating %zu bytes",
+              __func__, heap->size * sizeof *heap->nodes);
+    }
+
+  /* Move the new node up from the end of the array until its parent is
+     smaller than it. */
+  node.v=value;
+  node.s=tosort;
+  node.o=heap->counter++;
+  nodes=heap->nodes;
+  i=heap->num++;
+  while(i)
+    {
+      parent=(i-1)/2;
+      if( LIST_HSIZET_SMALLER(&nodes[parent], &node) ) break;
+      nodes[i]=nodes[parent];
+      i=parent;
+    }
+  nodes[i]=node;
+}
+
+
+
+
+
+/* Pop the value with the smallest sorting value. When the heap is empty,
+   `GAL_BLANK_SIZE_T' is returned and `tosort' is set to NaN. */
+size_t
+gal_list_hsizet_pop_smallest(gal_list_hsizet_t *heap, float *tosort)
+{
+  size_t i, child, value;
+  gal_list_hsizet_node_t *last, *nodes=heap->nodes;
+
+  /* Empty heap. */
+  if(heap->num==0)
+    {
+      *tosort=NAN;
+      return GAL_BLANK_SIZE_T;
+    }
+
+  /* Keep the output. */
+  value=nodes[0].v;
+  *tosort=nodes[0].s;
+
+  /* Move the last node down from the top until both its children are
+     larger than it. */
+  last=&nodes[--heap->num];
+  i=0;
+  while( (child=2*i+1) < heap->num )
+    {
+      if( child+1 < heap->num
+          && LIST_HSIZET_SMALLER(&nodes[child+1], &nodes[child]) )
+        ++child;
+      if( LIST_HSIZET_SMALLER(last, &nodes[child]) ) break;
+      nodes[i]=nodes[child];
+      i=child;
+    }
+  nodes[i]=*last;
+
+  return value;
+}
+
+
+
+
+
+/* Add all the values in the heap to a `size_t' list (without any order)
+   and empty the heap. The heap's allocated space isn't freed, so it can
+   be used again. */
+void
+gal_list_hsizet_to_sizet(gal_list_hsizet_t *heap, gal_list_sizet_t **out)
+{
+  size_t i;
+  for(i=0;i<heap->num;++i)
+    gal_list_sizet_add(out, heap->nodes[i].v);
+  heap->num=0;
+}
+
+
+
+
+
+/* Only the space allocated within the heap is freed, not the heap
+   structure its self. */
+void
+gal_list_hsizet_free(gal_list_hsizet_t *heap)
+{
+  free(heap->nodes);
+  heap->nodes=NULL;
+  heap->num=heap->size=heap->counter=0;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/****************************************************************
+ ****************   Bucket queue of size_t   ********************
+ ****************************************************************/
+/* A bucket queue is a priority queue for integer sorting values: all the
+   values that have the same key are kept in one bucket (in the order they
+   were added) and popping the smallest value is done by moving forward
+   over the buckets. This is ideal for parsing a grid outwards from a
+   point with an integer (for example Manhattan) distance: adding and
+   popping are both O(1). */
+void
+gal_list_bsizet_init(gal_list_bsizet_t *queue)
+{
+  queue->v=NULL;
+  queue->num=queue->start=queue->size=NULL;
+  queue->nbuckets=queue->current=queue->numv=0;
+}
+
+
+
+
+
+static void
+list_bsizet_alloc_buckets(gal_list_bsizet_t *queue, size_t key)
+{
+  size_t i, nbuckets=queue->nbuckets ? 2*queue->nbuckets : 16;
+
+  /* Make sure the requested key fits. */
+  if(nbuckets<=key) nbuckets=key+1;
+
+  /* Allocate all the arrays. */
+  errno=0;
+  queue->v     = realloc(queue->v,     nbuckets*sizeof *queue->v);
+  queue->num   = realloc(queue->num,   nbuckets*sizeof *queue->num);
+  queue->size  = realloc(queue->size,  nbuckets*sizeof *queue->size);
+  queue->start = realloc(queue->start, nbuckets*sizeof *queue->start);
+  if( !queue->v || !queue->num || !queue->size || !queue->start )
+    error(EXIT_FAILURE, errno, "%s: allocating space for %zu buckets",
+          __func__, nbuckets);
+
+  /* Initialize the new buckets. */
+  for(i=queue->nbuckets; i<nbuckets; ++i)
+    {
+      queue->v[i]=NULL;
+      queue->num[i]=queue->size[i]=queue->start[i]=0;
+    }
+  queue->nbuckets=nbuckets;
+}
+
+
+
+
+
+void
+gal_list_bsizet_add(gal_list_bsizet_t *queue, size_t value, size_t key)
+{
+  size_t *size;
+
+  /* Make sure there is a bucket for this key. */
+  if(key>=queue->nbuckets) list_bsizet_alloc_buckets(queue, key);
+
+  /* Make sure there is space in this bucket. */
+  size=&queue->size[key];
+  if(queue->num[key]==*size)
+    {
+      *size = *size ? 2 * *size : 16;
+      errno=0;
+      queue->v[key]=realloc(queue->v[key], *size * sizeof *queue->v[key]);
+      if(queue->v[key]==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for bucket "
+              "%zu", __func__, *size * sizeof *queue->v[key], key);
+    }
+
+  /* Add the value. Note that the keys don't have to be added in
+     increasing order. */
+  queue->v[key][ queue->num[key]++ ]=value;
+  if(queue->numv==0 || key<queue->current) queue->current=key;
+  ++queue->numv;
+}
+
+
+
+
+
+/* Pop the value with the smallest key. When the queue is empty,
+   `GAL_BLANK_SIZE_T' is returned and also put in `key'. */
+size_t
+gal_list_bsizet_pop_smallest(gal_list_bsizet_t *queue, size_t *key)
+{
+  size_t c, value;
+
+  /* Empty queue. */
+  if(queue->numv==0)
+    {
+      *key=GAL_BLANK_SIZE_T;
+      return GAL_BLANK_SIZE_T;
+    }
+
+  /* Find the first non-empty bucket. */
+  c=queue->current;
+  while(queue->start[c]==queue->num[c]) ++c;
+  queue->current=*key=c;
+
+  /* Pop the value, and if this bucket is now empty, reset it so its
+     space can be used from the start again. */
+  value=queue->v[c][ queue->start[c]++ ];
+  if(queue->start[c]==queue->num[c]) queue->start[c]=queue->num[c]=0;
+  --queue->numv;
+  return value;
+}
+
+
+
+
+
+/* Remove all the values in the queue, but keep the allocated space so
+   the queue can be used again. */
+void
+gal_list_bsizet_reset(gal_list_bsizet_t *queue)
+{
+  size_t i;
+  for(i=0;i<queue->nbuckets;++i) queue->num[i]=queue->start[i]=0;
+  queue->current=queue->numv=0;
+}
+
+
+
+
+
+/* Only the space allocated within the queue is freed, not the structure
+   its self. */
+void
+gal_list_bsizet_free(gal_list_bsizet_t *queue)
+{
+  size_t i;
+  for(i=0;i<queue->nbuckets;++i) free(queue->v[i]);
+  free(queue->v);
+  free(queue->num);
+  free(queue->size);
+  free(queue->start);
+  gal_list_bsizet_init(queue);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /*********************************************************************/
 /*************    Data structure as a linked list   ******************/
 /*********************************************************************/
@@ -0,0 +1,347 @@
+/*********************************************************************
+Write many small outputs as extensions of a few FITS files.
+This is part of GNU Astronomy Utilities (Gnuastro) package.
+
+Original author:
+     agent <agent@local>
+Contributing author(s):
+Copyright (C) 2026, Free Software Foundation, Inc.
+
+Gnuastro is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation, either version 3 of the License, or (at your
+option) any later version.
+
+Gnuastro is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
+**********************************************************************/
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gnuastro/data.h>
+#include <gnuastro/fits.h>
+
+#include <gnuastro-internal/checkset.h>
+#include <gnuastro-internal/multiext.h>
+
+
+
+
+/* Many of Gnuastro's programs can produce one (small) output for each row
+   of an input catalog. With a very large number of rows, the file system
+   (creating, opening and closing so many files) becomes the bottleneck.
+   So optionally, these outputs can be written as extensions of one file
+   (or `numshards' files, to keep each file at a reasonable size).
+
+   CFITSIO can't write into one file from multiple threads. So the
+   threads make each output in an in-memory FITS file and a single writer
+   thread copies them into the output file(s). Each output has a position
+   in the final output (its index in the list of things to do), the
+   writer will write them in that order, so the outputs don't depend on
+   how the jobs were distributed between the threads. The output with
+   position `pos' is written in the output file `pos % numshards'.
+
+   After all the outputs are written, a table is written in the last
+   extension of the first output file (with the name
+   `GAL_MULTIEXT_INDEX_NAME'), giving the ID, extension name, output file
+   and HDU of every written output. */
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/**********               The writer               ************/
+/**************************************************************/
+static void *
+multiext_writer(void *inparam)
+{
+  gal_multiext_t *me=(gal_multiext_t *)inparam;
+
+  char *name;
+  int hdunum, status=0;
+  fitsfile *mem, *fptr;
+  size_t id, pos, slot, shard;
+
+  for(pos=0;pos<me->total;++pos)
+    {
+      /* Wait until the output with this position is ready. */
+      slot=pos%me->window;
+      pthread_mutex_lock(&me->mutex);
+      while(me->filled[slot]==0)
+        pthread_cond_wait(&me->cond, &me->mutex);
+      mem=me->queue[slot];
+      id=me->queueid[slot];
+      name=me->queuename[slot];
+      me->filled[slot]=0;
+      me->next=pos+1;
+      pthread_cond_broadcast(&me->cond);
+      pthread_mutex_unlock(&me->mutex);
+
+      /* Nothing should be written for this position. */
+      if(mem==NULL) continue;
+
+      /* Copy the output into its file. In the in-memory file, the output
+         is in the second HDU (the first is blank). */
+      shard=pos%me->numshards;
+      fptr=me->fptrs[shard];
+      fits_movabs_hdu(mem, 2, NULL, &status);
+      fits_copy_hdu(mem, fptr, 0, &status);
+      if(name)
+        fits_update_key(fptr, TSTRING, "EXTNAME", name,
+                        "Name of this output.", &status);
+      fits_get_hdu_num(fptr, &hdunum);
+      fits_close_file(mem, &status);
+      gal_fits_io_error(status, NULL);
+
+      /* Keep the information for the index. */
+      me->indexid[me->numindex]=id;
+      me->indexname[me->numindex]=name ? name : strdup("");
+      me->indexshard[me->numindex]=shard+1;
+      me->indexhdu[me->numindex]=hdunum-1;
+      ++me->numindex;
+    }
+
+  return NULL;
+}
+
+
+
+
+
+/* Write the index table into the last extension of the first output. */
+static void
+multiext_write_index(gal_multiext_t *me)
+{
+  size_t i, maxlen=1;
+  int status=0, tfields=4;
+  fitsfile *fptr=me->fptrs[0];
+  char *ttype[]={"ID", "NAME", "FILE", "HDU"};
+  char *tunit[]={"counter", "name", "counter", "counter"};
+  char namef[30], *tform[]={"1K", namef, "1I", "1J"};
+
+  /* Find the format of the name column. */
+  for(i=0;i<me->numindex;++i)
+    if(strlen(me->indexname[i])>maxlen) maxlen=strlen(me->indexname[i]);
+  sprintf(namef, "%zuA", maxlen);
+
+  /* Make the table and write the columns. */
+  fits_create_tbl(fptr, BINARY_TBL, me->numindex, tfields, ttype, tform,
+                  tunit, GAL_MULTIEXT_INDEX_NAME, &status);
+  if(me->numindex)
+    {
+      fits_write_col(fptr, TLONGLONG, 1, 1, 1, me->numindex, me->indexid,
+                     &status);
+      fits_write_col(fptr, TSTRING, 2, 1, 1, me->numindex, me->indexname,
+                     &status);
+      fits_write_col(fptr, TSHORT, 3, 1, 1, me->numindex, me->indexshard,
+                     &status);
+      fits_write_col(fptr, TINT, 4, 1, 1, me->numindex, me->indexhdu,
+                     &status);
+    }
+  fits_write_comment(fptr, "FILE: counting from 1 in the list of output "
+                     "files.", &status);
+  fits_write_comment(fptr, "HDU: counting from 0 (like `--hdu').",
+                     &status);
+  gal_fits_io_error(status, NULL);
+
+  /* Write the version information. */
+  gal_fits_key_write_version(fptr, NULL, NULL);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/**********           Interface functions          ************/
+/**************************************************************/
+/* Open the output files and start the writer thread. `names' (an array
+   of `numshards' strings) will be freed in `gal_multiext_finish'. */
+gal_multiext_t *
+gal_multiext_start(char **names, size_t numshards, size_t total,
+                   size_t window, int dontdelete)
+{
+  int err;
+  size_t i;
+  gal_multiext_t *me;
+
+  /* Allocate the structure. */
+  errno=0;
+  me=malloc(sizeof *me);
+  if(me==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `me'",
+          __func__, sizeof *me);
+
+  /* Initialize the values. */
+  me->next=0;
+  me->numindex=0;
+  me->names=names;
+  me->total=total;
+  me->numshards=numshards;
+  me->window = window ? window : 1;
+
+  /* Allocate the queue and the index. */
+  me->queue=malloc(me->window * sizeof *me->queue);
+  me->queueid=malloc(me->window * sizeof *me->queueid);
+  me->queuename=malloc(me->window * sizeof *me->queuename);
+  me->filled=gal_data_calloc_array(GAL_TYPE_UINT8, me->window);
+  me->indexid=gal_data_malloc_array(GAL_TYPE_INT64, total);
+  me->indexhdu=gal_data_malloc_array(GAL_TYPE_INT32, total);
+  me->indexshard=gal_data_malloc_array(GAL_TYPE_INT16, total);
+  me->indexname=malloc(total * sizeof *me->indexname);
+  me->fptrs=malloc(numshards * sizeof *me->fptrs);
+  if(me->queue==NULL || me->queueid==NULL || me->queuename==NULL
+     || me->indexname==NULL || me->fptrs==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating the queue", __func__);
+
+  /* Open the output files (removing them if they already exist). */
+  for(i=0;i<numshards;++i)
+    {
+      gal_checkset_check_remove_file(names[i], 0, dontdelete);
+      me->fptrs[i]=gal_fits_open_to_write(names[i]);
+    }
+
+  /* Start the writer thread. */
+  pthread_mutex_init(&me->mutex, NULL);
+  pthread_cond_init(&me->cond, NULL);
+  err=pthread_create(&me->thread, NULL, multiext_writer, me);
+  if(err)
+    error(EXIT_FAILURE, 0, "%s: can't create the writer thread", __func__);
+
+  return me;
+}
+
+
+
+
+
+/* Name of the file that the output with the given position will be
+   written in. */
+char *
+gal_multiext_file(gal_multiext_t *me, size_t pos)
+{
+  return me->names[ pos % me->numshards ];
+}
+
+
+
+
+
+/* Give the output with position `pos' to the writer. `mem' is an
+   in-memory FITS file (with the output in its second HDU) that will be
+   closed by the writer. When `mem==NULL', nothing will be written for
+   this position, but every position (from 0 to `total-1') must be given
+   once (otherwise the writer will wait for it). The output will be
+   written with the given extension name (`name', which will be freed
+   after the index is written) and `id' in the index.
+
+   If the writer is too far behind this position (there are already
+   `window' outputs waiting), this function will wait until there is
+   space. */
+void
+gal_multiext_add(gal_multiext_t *me, size_t pos, fitsfile *mem,
+                 size_t id, char *name)
+{
+  size_t slot=pos%me->window;
+
+  /* Sanity check. */
+  if(pos>=me->total)
+    error(EXIT_FAILURE, 0, "%s: a bug! Please contact us at %s to fix the "
+          "problem. Position %zu is larger than the total (%zu)", __func__,
+          PACKAGE_BUGREPORT, pos, me->total);
+
+  /* When nothing is to be written, the name isn't needed. */
+  if(mem==NULL && name) { free(name); name=NULL; }
+
+  /* Wait until this position is within the window and put it in. */
+  pthread_mutex_lock(&me->mutex);
+  while(pos>=me->next+me->window)
+    pthread_cond_wait(&me->cond, &me->mutex);
+  me->queue[slot]=mem;
+  me->queueid[slot]=id;
+  me->queuename[slot]=name;
+  me->filled[slot]=1;
+  pthread_cond_broadcast(&me->cond);
+  pthread_mutex_unlock(&me->mutex);
+}
+
+
+
+
+
+/* Wait for the writer to finish, write the index, close the output files
+   and free all the allocated space. */
+void
+gal_multiext_finish(gal_multiext_t *me)
+{
+  size_t i;
+  int status=0;
+
+  /* Wait for the writer thread to finish. */
+  pthread_join(me->thread, NULL);
+  pthread_cond_destroy(&me->cond);
+  pthread_mutex_destroy(&me->mutex);
+
+  /* Write the index and close the files. */
+  multiext_write_index(me);
+  for(i=0;i<me->numshards;++i)
+    {
+      if( fits_close_file(me->fptrs[i], &status) )
+        gal_fits_io_error(status, NULL);
+      free(me->names[i]);
+    }
+
+  /* Clean up. */
+  for(i=0;i<me->numindex;++i) free(me->indexname[i]);
+  free(me->queuename);
+  free(me->indexshard);
+  free(me->indexname);
+  free(me->indexhdu);
+  free(me->indexid);
+  free(me->queueid);
+  free(me->filled);
+  free(me->queue);
+  free(me->fptrs);
+  free(me->names);
+  free(me);
+}
@@ -27,6 +27,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <error.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gsl/gsl_sort.h>
 
@@ -437,3 +438,307 @@ gal_polygon_clip(double *s, size_t n, double *c, size_t m,
     }
   *numcrn=outnum;
 }
+
+
+
+
+
+/* See if the polygon with `n' vertices in `v' (in the same format as
+   `gal_polygon_pin') is convex. The vertices can be in a clockwise or
+   counter-clockwise order, but they have to be in the order that they
+   are connected (like the output of `gal_polygon_ordered_corners').
+
+   In a convex polygon, all the turns at the vertices are in the same
+   direction. But this is also true for self-intersecting polygons like a
+   pentagram, so we also check that the X and Y directions of the edges
+   only change twice while going around the polygon. */
+int
+gal_polygon_is_convex(double *v, size_t n)
+{
+  int sign=0, s;
+  double *A, *B, *C, d[2], pd[2];
+  size_t i, xchanges=0, ychanges=0;
+
+  /* A polygon needs atleast three vertices. */
+  if(n<3) return 0;
+
+  /* Go over all the vertices, `B' is the vertex and `A' and `C' are the
+     previous and next ones. */
+  pd[0]=pd[1]=0.0f;
+  for(i=0;i<n;++i)
+    {
+      A=&v[ ((i+n-1)%n)*2 ];
+      B=&v[ i*2 ];
+      C=&v[ ((i+1)%n)*2 ];
+
+      /* Direction of the turn at this vertex. */
+      if( !GAL_POLYGON_COLLINEAR_WITH_LINE(A, B, C) )
+        {
+          s = GAL_POLYGON_TRI_CROSS_PRODUCT(A, B, C) > 0 ? 1 : -1;
+          if(sign && s!=sign) return 0;
+          sign=s;
+        }
+
+      /* Changes in the direction of the edges along each axis (zero
+         differences don't change the direction). */
+      d[0]=C[0]-B[0];
+      d[1]=C[1]-B[1];
+      if(d[0]!=0.0f)
+        {
+          if(pd[0]!=0.0f && (d[0]>0) != (pd[0]>0)) ++xchanges;
+          pd[0]=d[0];
+        }
+      if(d[1]!=0.0f)
+        {
+          if(pd[1]!=0.0f && (d[1]>0) != (pd[1]>0)) ++ychanges;
+          pd[1]=d[1];
+        }
+    }
+
+  /* The change between the last and first edges isn't counted, but the
+     number of changes around a closed polygon is even, so this doesn't
+     affect the check. */
+  return sign!=0 && xchanges<=2 && ychanges<=2;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/***************************************************************/
+/**************          Rasterization        ******************/
+/***************************************************************/
+/* An edge of the polygon: `a' is the vertex with the smaller Y. */
+struct polygonedge
+{
+  double           *a;          /* Vertex with the smaller Y.          */
+  double           *b;          /* Vertex with the larger Y.           */
+};
+
+
+
+
+
+/* Sort the edges by their smaller Y. */
+static int
+polygon_edge_increasing(const void *a, const void *b)
+{
+  double ya = ((struct polygonedge *)a)->a[1];
+  double yb = ((struct polygonedge *)b)->a[1];
+  return ya<yb ? -1 : (ya>yb ? 1 : 0);
+}
+
+
+
+
+
+/* The X of a point on the (infinite) line of the edge at the given Y. The
+   edge must not be horizontal. */
+static double
+polygon_edge_x(struct polygonedge *e, double y)
+{
+  return e->a[0] + (y-e->a[1]) * (e->b[0]-e->a[0]) / (e->b[1]-e->a[1]);
+}
+
+
+
+
+
+/* Clip the given column (as a floating point) to the range of the
+   columns in the image: 0 to `ncols'. */
+static double
+polygon_fill_clip(double c, size_t ncols)
+{
+  return c<0 ? 0 : (c>ncols ? ncols : c);
+}
+
+
+
+
+
+/* For a non-convex polygon, a point is inside if it is on one of the
+   edges or if the number of edges that cross its row before it is odd
+   (using the same conventions as the spans in `gal_polygon_fill'). */
+static int
+polygon_fill_in(double *v, size_t n, double *p)
+{
+  int in=0;
+  double *a, *b;
+  size_t i=0, j=n-1;
+
+  while(i<n)
+    {
+      /* Put the vertex with the smaller Y in `a'. */
+      if(v[j*2+1]<=v[i*2+1]) { a=&v[j*2]; b=&v[i*2]; }
+      else                   { a=&v[i*2]; b=&v[j*2]; }
+
+      /* On the edge. */
+      if( GAL_POLYGON_COLLINEAR_WITH_LINE(a, b, p)
+          && p[1]>=a[1]-GAL_POLYGON_ROUND_ERR
+          && p[1]<=b[1]+GAL_POLYGON_ROUND_ERR
+          && p[0]>=GAL_POLYGON_MIN_OF_TWO(a[0], b[0])-GAL_POLYGON_ROUND_ERR
+          && p[0]<=GAL_POLYGON_MAX_OF_TWO(a[0], b[0])+GAL_POLYGON_ROUND_ERR )
+        return 1;
+
+      /* The edge crosses this row before the point. */
+      if( a[1]<=p[1] && p[1]<b[1]
+          && a[0] + (p[1]-a[1]) * (b[0]-a[0]) / (b[1]-a[1]) <= p[0] )
+        in=!in;
+
+      j=i++;
+    }
+  return in;
+}
+
+
+
+
+
+/* Set the pixels of the 2D `mask' array (with `dsize[0]' rows and
+   `dsize[1]' columns) whose centers are inside the polygon with `n'
+   vertices in `v' to 1 and the rest to 0. Like the FITS standard, the
+   center of the first pixel is at (1, 1) and the first coordinate of
+   each vertex is along the columns.
+
+   This is a scan-line rasterization: the edges are sorted by their
+   smaller Y (the edge table) and while going up the rows, the edges that
+   cross (or are near) each row are kept in an active list. On each row,
+   the pixels between each pair of crossings are filled without any
+   check. So the cost is proportional to the number of pixels, not the
+   number of pixels times the number of vertices (which is the case when
+   every pixel is checked with `gal_polygon_pin').
+
+   The pixels that are within one pixel of an edge are then checked
+   individually: If the polygon is convex, this is done with
+   `gal_polygon_pin' (so the result is exactly the same as checking all
+   the pixels with it). Otherwise, a pixel is inside if it is on an edge
+   or if an odd number of edges cross its row before it. Therefore for a
+   non-convex polygon, the vertices have to be given in the order that
+   they are connected. */
+void
+gal_polygon_fill(double *v, size_t n, size_t *dsize, uint8_t *mask)
+{
+  double area=0.0f, *cv=v, x, x0, x1, y0, y1, p[2], *xs;
+  size_t i, j, k, c, row, next=0, nactive, nx, ne=0;
+  struct polygonedge *edges, *e, **active;
+  int convex=gal_polygon_is_convex(v, n);
+
+  /* Initialize the mask. */
+  memset(mask, 0, dsize[0]*dsize[1]*sizeof *mask);
+  if(n<3) return;
+
+  /* `gal_polygon_pin' needs the vertices in counter-clockwise order. */
+  for(i=0,j=n-1;i<n;j=i++) area+=GAL_POLYGON_CROSS_PRODUCT(v+j*2, v+i*2);
+  if( convex && area<0 )
+    {
+      errno=0;
+      cv=malloc(2*n*sizeof *cv);
+      if(cv==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `cv'",
+              __func__, 2*n*sizeof *cv);
+      for(i=0;i<n;++i)
+        { cv[i*2]=v[(n-1-i)*2]; cv[i*2+1]=v[(n-1-i)*2+1]; }
+    }
+
+  /* Allocate the edge table, the active edges and the crossings. */
+  errno=0;
+  edges=malloc(n*sizeof *edges);
+  active=malloc(n*sizeof *active);
+  xs=malloc(n*sizeof *xs);
+  if(edges==NULL || active==NULL || xs==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for the edges",
+          __func__, n*(sizeof *edges + sizeof *active + sizeof *xs));
+
+  /* Fill the edge table and sort it. */
+  for(i=0,j=n-1;i<n;j=i++)
+    {
+      e=&edges[ne++];
+      if(cv[j*2+1]<=cv[i*2+1]) { e->a=&cv[j*2]; e->b=&cv[i*2]; }
+      else                     { e->a=&cv[i*2]; e->b=&cv[j*2]; }
+    }
+  qsort(edges, ne, sizeof *edges, polygon_edge_increasing);
+
+  /* Go over the rows. */
+  nactive=0;
+  for(row=0;row<dsize[0];++row)
+    {
+      p[1]=row+1;
+
+      /* Add the edges that are now within one pixel of this row to the
+         active list and remove those that have been passed. */
+      while(next<ne && edges[next].a[1]-1<=p[1])
+        active[nactive++]=&edges[next++];
+      for(i=k=0;i<nactive;++i)
+        if(active[i]->b[1]+1>=p[1]) active[k++]=active[i];
+      nactive=k;
+
+      /* Find the crossings of the edges with this row and sort them
+         (there are only a few, so an insertion sort is used). */
+      nx=0;
+      for(i=0;i<nactive;++i)
+        if(active[i]->a[1]<=p[1] && p[1]<active[i]->b[1])
+          {
+            x=polygon_edge_x(active[i], p[1]);
+            for(k=nx++; k>0 && xs[k-1]>x; --k) xs[k]=xs[k-1];
+            xs[k]=x;
+          }
+
+      /* Fill the spans: the X of pixel `c' is `c+1' and it is inside
+         the span if `xs[i]<=c+1<xs[i+1]'. */
+      for(i=0;i+1<nx;i+=2)
+        {
+          x0=polygon_fill_clip(ceil(xs[i])-1,   dsize[1]);
+          x1=polygon_fill_clip(ceil(xs[i+1])-1, dsize[1]);
+          for(c=x0;c<x1;++c) mask[row*dsize[1]+c]=1;
+        }
+
+      /* Check the pixels near the edges: the part of each edge between
+         the previous and next rows is within one pixel of this row. */
+      for(i=0;i<nactive;++i)
+        {
+          e=active[i];
+          if(e->a[1]==e->b[1])
+            { x0=e->a[0]; x1=e->b[0]; }
+          else
+            {
+              y0=p[1]-1; if(y0<e->a[1]) y0=e->a[1];
+              y1=p[1]+1; if(y1>e->b[1]) y1=e->b[1];
+              x0=polygon_edge_x(e, y0);
+              x1=polygon_edge_x(e, y1);
+            }
+          if(x0>x1) { x=x0; x0=x1; x1=x; }
+
+          /* Pixels whose X is in the range of `x0-1' to `x1+1'. */
+          x0=polygon_fill_clip(floor(x0-1)-1, dsize[1]);
+          x1=polygon_fill_clip(ceil(x1+1),    dsize[1]);
+          for(c=x0;c<x1;++c)
+            {
+              p[0]=c+1;
+              mask[row*dsize[1]+c] = ( convex
+                                       ? gal_polygon_pin(cv, p, n)
+                                       : polygon_fill_in(cv, n, p) );
+            }
+        }
+    }
+
+  /* Clean up. */
+  free(xs);
+  free(edges);
+  free(active);
+  if(cv!=v) free(cv);
+}
@@ -25,12 +25,19 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
 #include <regex.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stat-time.h>
 
 #include <gnuastro/git.h>
 #include <gnuastro/txt.h>
+#include <gnuastro/fits.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
 
@@ -153,6 +160,325 @@ gal_table_print_info(gal_data_t *allcols, size_t numcols, size_t numrows)
 
 
 
+/************************************************************************/
+/***************            Native table cache            ***************/
+/************************************************************************/
+/* Parsing a large table (in particular a plain text table) can take a
+   long time. To avoid parsing the same table in every run, its columns
+   can be kept in a "cache" file next to it (see `gal_table_cache_name').
+   The cache is a binary file in the native byte order of the host, and is
+   memory-mapped when reading. It has these components (each one starts
+   on an 8-byte boundary):
+
+     - A `table_cache_header' structure.
+     - The HDU name (only for FITS tables, `hdulen' bytes).
+     - One `table_cache_column' structure for each column.
+     - The name, unit and comment strings of all the columns.
+     - The data of each column. Numbers are stored like they are in
+       memory. For strings, an array of `numrows+1' offsets (`uint64_t')
+       is followed by the characters of all the strings (each finishing
+       with a `\0'), string `i' starts at offset `i'.
+
+   The cache is only used when the modification time and size of the table
+   are identical to the values stored in it.*/
+#define TABLE_CACHE_MAGIC     "GALTBLC"
+#define TABLE_CACHE_VERSION   1
+#define TABLE_CACHE_BYTEORDER 0x01020304
+#define TABLE_CACHE_ALIGN(A)  ( ( (A) + 7 ) & ~(size_t)7 )
+
+struct table_cache_header
+{
+  char         magic[8];  /* `TABLE_CACHE_MAGIC'.                        */
+  uint32_t    byteorder;  /* `TABLE_CACHE_BYTEORDER' in writer's order.  */
+  uint32_t      version;  /* `TABLE_CACHE_VERSION'.                      */
+  int64_t         mtime;  /* Modification time of table (seconds).       */
+  int64_t    mtime_nsec;  /* Nano-seconds of the modification time.      */
+  uint64_t         size;  /* Size of the table file (bytes).             */
+  uint64_t      numcols;  /* Number of columns.                          */
+  uint64_t      numrows;  /* Number of rows.                             */
+  uint64_t       hdulen;  /* Length of HDU string (with `\0').           */
+};
+
+struct table_cache_column
+{
+  int32_t          type;  /* Type of the column.                         */
+  int32_t    disp_width;  /* Width to print the column.                  */
+  uint64_t      namelen;  /* Length of name (with `\0', 0 when NULL).    */
+  uint64_t      unitlen;  /* Length of unit (with `\0', 0 when NULL).    */
+  uint64_t   commentlen;  /* Length of comment (with `\0', 0 when NULL). */
+  uint64_t       offset;  /* Start of the data (from start of file).     */
+  uint64_t       nbytes;  /* Number of bytes in the data.                */
+};
+
+
+
+
+
+/* Return the name of the cache file of a table (allocated). */
+char *
+gal_table_cache_name(char *filename, char *hdu)
+{
+  char *out;
+
+  if( hdu && gal_fits_name_is_fits(filename) )
+    asprintf(&out, "%s.%s.gtc", filename, hdu);
+  else
+    asprintf(&out, "%s.gtc", filename);
+  return out;
+}
+
+
+
+
+
+/* Write `size' bytes from `ptr' into the cache, then write zeros until the
+   position (`*pos') is on an 8-byte boundary. */
+static void
+table_cache_fwrite(FILE *fp, void *ptr, size_t size, size_t *pos,
+                   int pad, char *name)
+{
+  size_t npad;
+  char zeros[8]={0};
+
+  errno=0;
+  if( size && fwrite(ptr, 1, size, fp)!=size )
+    error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", name, size);
+  *pos+=size;
+
+  if(pad && (npad=TABLE_CACHE_ALIGN(*pos)-*pos) )
+    {
+      if( fwrite(zeros, 1, npad, fp)!=npad )
+        error(EXIT_FAILURE, errno, "%s: couldn't write %zu bytes", name,
+              npad);
+      *pos+=npad;
+    }
+}
+
+
+
+
+
+/* Write the cache of a table (see the comments at the start of this
+   section). All the columns of the table are read (with
+   `gal_table_read') and written into the file given by
+   `gal_table_cache_name'. To make sure an incomplete cache is never used,
+   it is first written into a temporary file and then renamed. */
+void
+gal_table_cache_write(char *filename, char *hdu, size_t numthreads,
+                      int minmapsize)
+{
+  FILE *fp;
+  char **strarr;
+  uint64_t *offs;
+  struct stat st;
+  int tableformat;
+  gal_list_str_t *colstr=NULL;
+  struct table_cache_column *c;
+  gal_data_t *allcols, *cols, *col;
+  struct table_cache_header h={{0}};
+  char *tmp, *name, *tmpname, *hname;
+  size_t i, j, pos=0, numcols, numrows;
+
+  /* Get the modification time and size of the table before reading it, so
+     any change during the reading will invalidate the cache. */
+  errno=0;
+  if( stat(filename, &st) )
+    error(EXIT_FAILURE, errno, "%s", filename);
+
+  /* Read all the columns of the table. */
+  allcols=gal_table_info(filename, hdu, &numcols, &numrows, &tableformat);
+  hname=gal_fits_name_save_as_string(filename, hdu);
+  if(allcols==NULL || numrows==0)
+    error(EXIT_FAILURE, 0, "%s: no usable data rows to cache", hname);
+  gal_data_array_free(allcols, numcols, 1);
+  for(i=numcols;i>0;--i)
+    {
+      asprintf(&tmp, "%zu", i);
+      gal_list_str_add(&colstr, tmp, 0);
+    }
+  cols=gal_table_read(filename, hdu, colstr, GAL_TABLE_SEARCH_NAME, 0,
+                      numthreads, minmapsize, NULL);
+  gal_list_str_free(colstr, 1);
+
+  /* Fill in the header. */
+  memcpy(h.magic, TABLE_CACHE_MAGIC, sizeof TABLE_CACHE_MAGIC);
+  h.byteorder  = TABLE_CACHE_BYTEORDER;
+  h.version    = TABLE_CACHE_VERSION;
+  h.mtime      = st.st_mtime;
+  h.mtime_nsec = get_stat_mtime_ns(&st);
+  h.size       = st.st_size;
+  h.numcols    = numcols;
+  h.numrows    = numrows;
+  h.hdulen     = ( tableformat==GAL_TABLE_FORMAT_TXT || hdu==NULL
+                   ? 0 : strlen(hdu)+1 );
+
+  /* Fill in the information of each column and find where its data will
+     start. */
+  errno=0;
+  c=calloc(numcols, sizeof *c);
+  if(c==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `c'",
+          __func__, numcols*sizeof *c);
+  pos = ( sizeof h + TABLE_CACHE_ALIGN(h.hdulen)
+          + TABLE_CACHE_ALIGN(numcols*sizeof *c) );
+  for(col=cols, i=0; col!=NULL; col=col->next, ++i)
+    {
+      c[i].type       = col->type;
+      c[i].disp_width = col->disp_width;
+      c[i].namelen    = col->name    ? strlen(col->name)+1    : 0;
+      c[i].unitlen    = col->unit    ? strlen(col->unit)+1    : 0;
+      c[i].commentlen = col->comment ? strlen(col->comment)+1 : 0;
+      pos += c[i].namelen + c[i].unitlen + c[i].commentlen;
+    }
+  pos=TABLE_CACHE_ALIGN(pos);
+  for(col=cols, i=0; col!=NULL; col=col->next, ++i)
+    {
+      c[i].offset=pos;
+      if(col->type==GAL_TYPE_STRING)
+        {
+          strarr=col->array;
+          c[i].nbytes=(numrows+1)*sizeof *offs;
+          for(j=0;j<numrows;++j) c[i].nbytes+=strlen(strarr[j])+1;
+        }
+      else
+        c[i].nbytes=numrows*gal_type_sizeof(col->type);
+      pos=TABLE_CACHE_ALIGN(pos+c[i].nbytes);
+    }
+
+  /* Open the temporary file. */
+  name=gal_table_cache_name(filename, hdu);
+  asprintf(&tmpname, "%s.tmp", name);
+  errno=0;
+  fp=fopen(tmpname, "w");
+  if(fp==NULL)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to write", tmpname);
+
+  /* Write the header, the HDU, the column information and strings. */
+  pos=0;
+  table_cache_fwrite(fp, &h, sizeof h, &pos, 1, tmpname);
+  table_cache_fwrite(fp, hdu, h.hdulen, &pos, 1, tmpname);
+  table_cache_fwrite(fp, c, numcols*sizeof *c, &pos, 1, tmpname);
+  for(col=cols, i=0; col!=NULL; col=col->next, ++i)
+    {
+      table_cache_fwrite(fp, col->name, c[i].namelen, &pos, 0, tmpname);
+      table_cache_fwrite(fp, col->unit, c[i].unitlen, &pos, 0, tmpname);
+      table_cache_fwrite(fp, col->comment, c[i].commentlen, &pos, 0,
+                         tmpname);
+    }
+  table_cache_fwrite(fp, NULL, 0, &pos, 1, tmpname);
+
+  /* Write the data of each column. */
+  offs=gal_data_malloc_array(GAL_TYPE_UINT64, numrows+1);
+  for(col=cols, i=0; col!=NULL; col=col->next, ++i)
+    if(col->type==GAL_TYPE_STRING)
+      {
+        strarr=col->array;
+        offs[0]=0;
+        for(j=0;j<numrows;++j) offs[j+1]=offs[j]+strlen(strarr[j])+1;
+        table_cache_fwrite(fp, offs, (numrows+1)*sizeof *offs, &pos, 0,
+                           tmpname);
+        for(j=0;j<numrows;++j)
+          table_cache_fwrite(fp, strarr[j], strlen(strarr[j])+1, &pos,
+                             j==numrows-1, tmpname);
+      }
+    else
+      table_cache_fwrite(fp, col->array, c[i].nbytes, &pos, 1, tmpname);
+
+  /* Close the file and put it in its final place. */
+  errno=0;
+  if(fclose(fp))
+    error(EXIT_FAILURE, errno, "%s: couldn't close after writing",
+          tmpname);
+  errno=0;
+  if( rename(tmpname, name) )
+    error(EXIT_FAILURE, errno, "%s: couldn't rename to `%s'", tmpname,
+          name);
+
+  /* Clean up. */
+  gal_list_data_free(cols);
+  free(tmpname);
+  free(hname);
+  free(name);
+  free(offs);
+  free(c);
+}
+
+
+
+
+
+/* Check if the memory-mapped cache (with `size' bytes) is valid for the
+   table with the given status and HDU. */
+static int
+table_cache_check(char *map, size_t size, struct stat *st, char *hdu)
+{
+  size_t i, pos;
+  uint64_t *offs;
+  struct table_cache_column *c;
+  struct table_cache_header *h=(struct table_cache_header *)map;
+
+  /* Check the header. */
+  if( size < sizeof *h
+      || memcmp(h->magic, TABLE_CACHE_MAGIC, sizeof TABLE_CACHE_MAGIC)
+      || h->byteorder  != TABLE_CACHE_BYTEORDER
+      || h->version    != TABLE_CACHE_VERSION
+      || h->mtime      != st->st_mtime
+      || h->mtime_nsec != get_stat_mtime_ns(st)
+      || h->size       != st->st_size )
+    return 0;
+
+  /* Check the HDU (only for FITS tables). */
+  pos=sizeof *h;
+  if(h->hdulen)
+    {
+      if( hdu==NULL || pos+h->hdulen>size || map[pos+h->hdulen-1]!='\0'
+          || strcmp(map+pos, hdu) )
+        return 0;
+      pos=TABLE_CACHE_ALIGN(pos+h->hdulen);
+    }
+
+  /* Check the columns (that all their data are within the file). */
+  c=(struct table_cache_column *)(map+pos);
+  if( pos + h->numcols*sizeof *c > size ) return 0;
+  for(i=0;i<h->numcols;++i)
+    {
+      if( c[i].type==GAL_TYPE_BIT || gal_type_sizeof(c[i].type)==0
+          || c[i].offset+c[i].nbytes > size )
+        return 0;
+      if(c[i].type==GAL_TYPE_STRING)
+        {
+          offs=(uint64_t *)(map+c[i].offset);
+          if( c[i].nbytes < (h->numrows+1)*sizeof *offs
+              || offs[h->numrows] != c[i].nbytes-(h->numrows+1)*sizeof *offs)
+            return 0;
+        }
+      else if( c[i].nbytes != h->numrows*gal_type_sizeof(c[i].type) )
+        return 0;
+    }
+
+  /* Everything is fine. */
+  return 1;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /************************************************************************/
 /***************               Read a table               ***************/
 /************************************************************************/
@@ -371,6 +697,206 @@ make_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
 
 
 
+/* Find the index of the column that each range in the row selection
+   refers to. Each range must match exactly one numeric column. */
+static void
+table_rowsel_set_indexs(gal_table_rowsel_t *rowsel, gal_data_t *allcols,
+                        size_t numcols, int searchin, int ignorecase,
+                        char *filename, char *hdu)
+{
+  gal_list_str_t colstr;
+  gal_table_range_t *r;
+  gal_list_sizet_t *indexll;
+
+  for(r=rowsel->ranges; r!=NULL; r=r->next)
+    {
+      /* Use the same column selection criteria as the output columns. */
+      colstr.v=r->column;
+      colstr.next=NULL;
+      indexll=make_list_of_indexs(&colstr, allcols, numcols, searchin,
+                                  ignorecase, filename, hdu);
+
+      /* Only one column should match. */
+      if(indexll->next)
+        error(EXIT_FAILURE, 0, "%s: `%s' matches more than one column. "
+              "The column of a range must be unique",
+              gal_fits_name_save_as_string(filename, hdu), r->column);
+
+      /* The column must be numeric. */
+      if(allcols[indexll->v].type==GAL_TYPE_STRING)
+        error(EXIT_FAILURE, 0, "%s: column `%s' contains strings. A range "
+              "of values can only be defined on numeric columns",
+              gal_fits_name_save_as_string(filename, hdu), r->column);
+
+      /* Keep the index and clean up. */
+      r->index=indexll->v;
+      gal_list_sizet_free(indexll);
+    }
+}
+
+
+
+
+
+/* Read the requested columns from the cache of the table (see the
+   `Native table cache' section above). If there is no cache, or it isn't
+   valid for the table any more, `*found' will be 0 and NULL is returned,
+   so the table should be read normally. The data are copied from the
+   memory-mapped cache without any parsing.*/
+static gal_data_t *
+table_cache_read(char *filename, char *hdu, gal_list_str_t *cols,
+                 int searchin, int ignorecase, int minmapsize,
+                 gal_table_rowsel_t *rowsel, int *found)
+{
+  int fd;
+  char *map;
+  double *d;
+  char **strarr;
+  uint64_t *offs;
+  uint8_t *flags=NULL;
+  struct stat st, cst;
+  gal_table_range_t *r;
+  gal_list_sizet_t *ind, *indexll;
+  struct table_cache_column *c;
+  struct table_cache_header *h;
+  gal_data_t *allcols, *out=NULL, *tmp, *dbl;
+  char *name, *chars, *start, *cname, *cunit, *ccomm;
+  size_t i, j, o, tsize, first=0, nrange, nread, numcols, numrows;
+
+  /* Open and map the cache (if it exists). */
+  *found=0;
+  if( stat(filename, &st) ) return NULL;
+  name=gal_table_cache_name(filename, hdu);
+  fd=open(name, O_RDONLY);
+  free(name);
+  if(fd==-1) return NULL;
+  if( fstat(fd, &cst) || cst.st_size==0 ) { close(fd); return NULL; }
+  map=mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map==MAP_FAILED) return NULL;
+
+  /* Make sure the cache is valid for this table. */
+  if( table_cache_check(map, cst.st_size, &st, hdu)==0 )
+    {
+      munmap(map, cst.st_size);
+      return NULL;
+    }
+  *found=1;
+  h=(struct table_cache_header *)map;
+  numcols=h->numcols;
+  numrows=h->numrows;
+  c=(struct table_cache_column *)(map + sizeof *h
+                                  + TABLE_CACHE_ALIGN(h->hdulen));
+
+  /* Set the information of all the columns (to select the columns). */
+  allcols=gal_data_array_calloc(numcols);
+  start=(char *)(c+numcols);
+  for(i=0;i<numcols;++i)
+    {
+      cname = c[i].namelen    ? start                           : NULL;
+      cunit = c[i].unitlen    ? start+c[i].namelen              : NULL;
+      ccomm = c[i].commentlen ? start+c[i].namelen+c[i].unitlen : NULL;
+      gal_checkset_allocate_copy(cname, &allcols[i].name);
+      gal_checkset_allocate_copy(cunit, &allcols[i].unit);
+      gal_checkset_allocate_copy(ccomm, &allcols[i].comment);
+      allcols[i].type=c[i].type;
+      allcols[i].disp_width=c[i].disp_width;
+      start += c[i].namelen + c[i].unitlen + c[i].commentlen;
+    }
+  indexll=make_list_of_indexs(cols, allcols, numcols, searchin, ignorecase,
+                              filename, hdu);
+  if(rowsel)
+    table_rowsel_set_indexs(rowsel, allcols, numcols, searchin, ignorecase,
+                            filename, hdu);
+
+  /* Set the range of rows to check (like the other readers). */
+  nrange=numrows;
+  if(rowsel)
+    {
+      first = rowsel->first<numrows ? rowsel->first : numrows;
+      nrange = ( rowsel->number && first+rowsel->number<numrows
+                 ? rowsel->number : numrows-first );
+    }
+  nread=nrange;
+
+  /* Flag the rows that are within all the ranges. Blank values are
+     converted to NaN by `gal_data_copy_to_new_type', so they will not be
+     in any range. */
+  if(nrange && rowsel && rowsel->ranges)
+    {
+      flags=gal_data_malloc_array(GAL_TYPE_UINT8, nrange);
+      memset(flags, 1, nrange);
+      for(r=rowsel->ranges; r!=NULL; r=r->next)
+        {
+          tsize=gal_type_sizeof(c[r->index].type);
+          tmp=gal_data_alloc(map + c[r->index].offset + first*tsize,
+                             c[r->index].type, 1, &nrange, NULL, 0, -1,
+                             NULL, NULL, NULL);
+          dbl=gal_data_copy_to_new_type(tmp, GAL_TYPE_FLOAT64);
+          d=dbl->array;
+          for(i=0;i<nrange;++i)
+            if( !(d[i]>=r->min && d[i]<=r->max) ) flags[i]=0;
+          tmp->array=NULL;
+          gal_data_free(tmp);
+          gal_data_free(dbl);
+        }
+      nread=0;
+      for(i=0;i<nrange;++i) nread+=flags[i];
+    }
+
+  /* Copy the desired columns. Like the other readers, the output list
+     will have the inverse order of `indexll' (which is reversed here). */
+  gal_list_sizet_reverse(&indexll);
+  if(nread)
+    for(ind=indexll; ind!=NULL; ind=ind->next)
+      {
+        i=ind->v;
+        gal_list_data_add_alloc(&out, NULL, c[i].type, 1, &nread, NULL, 0,
+                                minmapsize, allcols[i].name, allcols[i].unit,
+                                allcols[i].comment);
+        out->disp_width=c[i].disp_width;
+        if(c[i].type==GAL_TYPE_STRING)
+          {
+            strarr=out->array;
+            offs=(uint64_t *)(map+c[i].offset);
+            chars=(char *)(offs+numrows+1);
+            for(j=0, o=0; j<nrange; ++j)
+              if( flags==NULL || flags[j] )
+                {
+                  if( offs[first+j] >= offs[numrows] )
+                    error(EXIT_FAILURE, 0, "%s: the cache of this table "
+                          "is corrupted, please remove it", filename);
+                  gal_checkset_allocate_copy(chars+offs[first+j],
+                                             &strarr[o++]);
+                }
+          }
+        else
+          {
+            tsize=gal_type_sizeof(c[i].type);
+            start=map + c[i].offset + first*tsize;
+            if(flags==NULL)
+              memcpy(out->array, start, nread*tsize);
+            else
+              for(j=0, o=0; j<nrange; ++j)
+                if(flags[j])
+                  memcpy(gal_data_ptr_increment(out->array, o++,
+                                                c[i].type),
+                         start+j*tsize, tsize);
+          }
+      }
+
+  /* Clean up and return. */
+  free(flags);
+  munmap(map, cst.st_size);
+  gal_list_sizet_free(indexll);
+  gal_data_array_free(allcols, numcols, 1);
+  return out;
+}
+
+
+
+
+
 /* Read the specified columns in a table (named `filename') into a linked
    list of data structures. If the file is FITS, then `hdu' will also be
    used, otherwise, `hdu' is ignored. The information to search for columns
@@ -381,6 +907,14 @@ make_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
    `gal_table_where_to_search' enumerator and has to be one of its given
    types. If `cols' is NULL, then this function will read the full table.
 
+   If `rowsel' is not NULL, only the rows it selects will be read (see the
+   description of `gal_table_rowsel_t'). The selection is done while
+   reading, so the memory used is proportional to the number of selected
+   rows, not the full table. If no rows are selected, NULL is returned.
+
+   If the table has a valid cache (see `gal_table_cache_write'), the
+   columns are read from the cache and the table isn't parsed at all.
+
    The output is a linked list with the same order of the cols linked
    list. Note that one column node in the `cols' list might give multiple
    columns, in this case, the order of output columns that correspond to
@@ -389,9 +923,10 @@ make_list_of_indexs(gal_list_str_t *cols, gal_data_t *allcols,
    on. */
 gal_data_t *
 gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
-               int searchin, int ignorecase, int minmapsize)
+               int searchin, int ignorecase, size_t numthreads,
+               int minmapsize, gal_table_rowsel_t *rowsel)
 {
-  int tableformat;
+  int tableformat, found;
   gal_list_sizet_t *indexll;
   size_t i, numcols, numrows;
   gal_data_t *allcols, *out=NULL;
@@ -399,6 +934,11 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
   /* If the column string linked list is empty, no need to continue. */
   if(cols==NULL) return NULL;
 
+  /* If the table has a valid cache, read the columns from it. */
+  out=table_cache_read(filename, hdu, cols, searchin, ignorecase,
+                       minmapsize, rowsel, &found);
+  if(found) return out;
+
   /* First get the information of all the columns. */
   allcols=gal_table_info(filename, hdu, &numcols, &numrows, &tableformat);
 
@@ -409,6 +949,11 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
   indexll=make_list_of_indexs(cols, allcols, numcols, searchin,
                               ignorecase, filename, hdu);
 
+  /* Find the columns that the row selection ranges refer to. */
+  if(rowsel)
+    table_rowsel_set_indexs(rowsel, allcols, numcols, searchin, ignorecase,
+                            filename, hdu);
+
   /* Depending on the table format, read the columns into the output
      structure. Note that the functions here pop each index, read/store the
      desired column and pop the next, so after these functions, the output
@@ -423,13 +968,13 @@ gal_table_read(char *filename, char *hdu, gal_list_str_t *cols,
     {
     case GAL_TABLE_FORMAT_TXT:
       out=gal_txt_table_read(filename, numrows, allcols, indexll,
-                             minmapsize);
+                             numthreads, minmapsize, rowsel);
       break;
 
     case GAL_TABLE_FORMAT_AFITS:
     case GAL_TABLE_FORMAT_BFITS:
       out=gal_fits_tab_read(filename, hdu, numrows, allcols, indexll,
-                            minmapsize);
+                            minmapsize, rowsel);
       break;
 
     default:
@@ -511,7 +1056,8 @@ gal_table_comments_add_intro(gal_list_str_t **comments, char *program_string,
    value of 1, then it won't be deleted and an error will be printed. */
 void
 gal_table_write(gal_data_t *cols, gal_list_str_t *comments,
-                int tableformat, char *filename, int dontdelete)
+                int tableformat, char *filename, size_t numthreads,
+                int dontdelete)
 {
   /* If a filename was given, then the tableformat is relevant and must be
      used. When the filename is empty, a text table must be printed on the
@@ -522,10 +1068,10 @@ gal_table_write(gal_data_t *cols, gal_list_str_t *comments,
         gal_fits_tab_write(cols, comments, tableformat, filename,
                            dontdelete);
       else
-        gal_txt_write(cols, comments, filename, dontdelete);
+        gal_txt_write(cols, comments, filename, numthreads, dontdelete);
     }
   else
-    gal_txt_write(cols, comments, filename, dontdelete);
+    gal_txt_write(cols, comments, filename, numthreads, dontdelete);
 }
 
 
@@ -543,7 +1089,7 @@ gal_table_write_log(gal_data_t *logll, char *program_string,
   gal_table_comments_add_intro(&comments, program_string, rawtime);
 
   /* Write the log file to disk */
-  gal_table_write(logll, comments, GAL_TABLE_FORMAT_TXT, filename,
+  gal_table_write(logll, comments, GAL_TABLE_FORMAT_TXT, filename, 1,
                   dontdelete);
 
   /* In verbose mode, print the information. */
@@ -27,13 +27,19 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <errno.h>
 #include <error.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gnuastro/txt.h>
 #include <gnuastro/list.h>
 #include <gnuastro/blank.h>
 #include <gnuastro/table.h>
+#include <gnuastro/threads.h>
 
 #include <gnuastro-internal/checkset.h>
 #include <gnuastro-internal/tableintern.h>
@@ -46,6 +52,159 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 
 
 
+/************************************************************************/
+/***************         Access to the file contents      ***************/
+/************************************************************************/
+/* Put the full contents of `filename' in memory and return a pointer to
+   its start. When possible, the file is memory-mapped (so the operating
+   system will only read the parts that are actually used, without any
+   extra copying). If it can't be mapped, the file is read into allocated
+   space. The size of the file is put in `size' and `ismapped' is set to 1
+   when the file was memory-mapped. For an empty file, NULL is returned.*/
+static char *
+txt_file_map(char *filename, size_t *size, int *ismapped)
+{
+  int fd;
+  struct stat st;
+  char *out=NULL;
+  ssize_t nread;
+  size_t done=0;
+
+  /* Open the file and find its size. */
+  errno=0;
+  fd=open(filename, O_RDONLY);
+  if(fd==-1)
+    error(EXIT_FAILURE, errno, "%s: couldn't open to read as plain text "
+          "in %s", filename, __func__);
+  errno=0;
+  if( fstat(fd, &st)==-1 )
+    error(EXIT_FAILURE, errno, "%s: couldn't get the size in %s", filename,
+          __func__);
+  *size=st.st_size;
+  *ismapped=0;
+
+  /* Map (or read) the contents. */
+  if(*size)
+    {
+      out=mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(out==MAP_FAILED)
+        {
+          errno=0;
+          out=malloc(*size);
+          if(out==NULL)
+            error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `out'",
+                  __func__, *size);
+          while(done<*size)
+            {
+              errno=0;
+              nread=read(fd, out+done, *size-done);
+              if(nread<=0)
+                error(EXIT_FAILURE, errno, "%s: couldn't read the contents "
+                      "in %s", filename, __func__);
+              done+=nread;
+            }
+        }
+      else
+        {
+          *ismapped=1;
+          madvise(out, *size, MADV_SEQUENTIAL);
+        }
+    }
+
+  /* Close the file (the mapping is independent of the file descriptor)
+     and return the contents. */
+  errno=0;
+  if( close(fd) )
+    error(EXIT_FAILURE, errno, "%s: couldn't close file in %s", filename,
+          __func__);
+  return out;
+}
+
+
+
+
+
+/* Free the space that was given by `txt_file_map'. */
+static void
+txt_file_unmap(char *file, size_t size, int ismapped)
+{
+  if(file==NULL) return;
+  if(ismapped)
+    {
+      errno=0;
+      if( munmap(file, size) )
+        error(EXIT_FAILURE, errno, "%s: couldn't un-map the file", __func__);
+    }
+  else free(file);
+}
+
+
+
+
+
+/* Copy the line that starts at `start' (with `len' characters, not
+   counting its new-line character) into `*buf', finishing it with a
+   new-line and `\0' (similar to the output of `getline'). The lines of the
+   memory-mapped file can't be modified, but the parsing functions
+   (for example `strtok_r') need to modify the line. `*buflen' is the
+   allocated size of `*buf', it will be increased when necessary.*/
+static char *
+txt_line_copy(char *start, size_t len, char **buf, size_t *buflen)
+{
+  if(len+2>*buflen)
+    {
+      *buflen=2*(len+2);
+      errno=0;
+      *buf=realloc(*buf, *buflen);
+      if(*buf==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `buf'",
+              __func__, *buflen);
+    }
+  memcpy(*buf, start, len);
+  (*buf)[len]='\n';
+  (*buf)[len+1]='\0';
+  return *buf;
+}
+
+
+
+
+
+/* Return the status of the line that starts at `start' (see
+   `gal_txt_line_stat'). `end' is the end of the file: `gal_txt_line_stat'
+   parses the line until a new-line character, but the last line of a file
+   may not have one, so in that case, the line is first copied to `*buf'
+   (with `txt_line_copy'). The length of the line (not counting the
+   new-line) is put in `len'. */
+static int
+txt_line_stat_mapped(char *start, char *end, size_t *len, char **buf,
+                     size_t *buflen)
+{
+  char *nl=memchr(start, '\n', end-start);
+  *len = (nl ? nl : end) - start;
+  return gal_txt_line_stat( nl ? start : txt_line_copy(start, *len, buf,
+                                                         buflen) );
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 /************************************************************************/
 /***************           Get table information          ***************/
 /************************************************************************/
@@ -504,57 +663,48 @@ txt_infoll_to_array(gal_data_t *datall, size_t *numdata)
 
 
 /* Return the information about a text file table. If there were no
-   readable rows, it will return NULL.*/
+   readable rows, it will return NULL. The file is memory-mapped and only
+   the comment lines and the first data row are copied (to be parsed), for
+   the other lines, we only need to know if they are data rows.*/
 static gal_data_t *
 txt_get_info(char *filename, int format, size_t *numdata, size_t *dsize)
 {
-  FILE *fp;
+  int ismapped;
   size_t numtokens;
   int firstlinedone=0;
+  char *file, *end, *start;
   gal_data_t *datall=NULL, *dataarr;
-  char *line, *format_err, *comm_start;
-  size_t linelen=10; /* `linelen' will be increased by `getline'. */
+  char *line=NULL, *comm_start;
+  size_t len, size, linelen=0; /* `linelen' increased by `txt_line_copy'.*/
 
 
   /* Set the constant strings */
   switch(format)
     {
-    case TXT_FORMAT_TABLE: format_err="table"; comm_start="# Column "; break;
-    case TXT_FORMAT_IMAGE: format_err="image"; comm_start="# Image ";  break;
+    case TXT_FORMAT_TABLE: comm_start="# Column "; break;
+    case TXT_FORMAT_IMAGE: comm_start="# Image ";  break;
     default:
       error(EXIT_FAILURE, 0, "%s: code %d not recognized",
             __func__, format);
     }
 
 
-  /* Open the file. */
-  errno=0;
-  fp=fopen(filename, "r");
-  if(fp==NULL)
-    error(EXIT_FAILURE, errno, "%s: could't open to read as a plain "
-          "text %s in %s", filename, format_err, __func__);
-
-
-  /* Allocate the space necessary to keep each line as we parse it. Note
-     that `getline' is going to later `realloc' this space to fit the line
-     length. */
-  errno=0;
-  line=malloc(linelen*sizeof *line);
-  if(line==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for line",
-          __func__, linelen*sizeof *line);
+  /* Map the file into memory. */
+  file=txt_file_map(filename, &size, &ismapped);
+  end=file+size;
 
 
   /* Read the comments of the line for possible information about the
      lines, but also confirm/complete the info by parsing the first
      uncommented line. */
   dsize[0]=0;
-  while( getline(&line, &linelen, fp) != -1 )
-    switch( gal_txt_line_stat(line) )
+  for(start=file; start<end; start+=len+1)
+    switch( txt_line_stat_mapped(start, end, &len, &line, &linelen) )
       {
         /* Line is a comment, see if it has formatted information. */
       case GAL_TXT_LINESTAT_COMMENT:
-        txt_info_from_comment(line, &datall, comm_start);
+        txt_info_from_comment(txt_line_copy(start, len, &line, &linelen),
+                              &datall, comm_start);
         break;
 
         /* Line is actual data, use it to fill in the gaps.  */
@@ -563,7 +713,10 @@ txt_get_info(char *filename, int format, size_t *numdata, size_t *dsize)
         if(firstlinedone==0)
           {
             firstlinedone=1;
-            numtokens=txt_info_from_first_row(line, &datall, format);
+            numtokens=txt_info_from_first_row(txt_line_copy(start, len,
+                                                            &line,
+                                                            &linelen),
+                                              &datall, format);
             if(format==TXT_FORMAT_IMAGE) dsize[1]=numtokens;
           }
         break;
@@ -584,13 +737,7 @@ txt_get_info(char *filename, int format, size_t *numdata, size_t *dsize)
      case. If the list is indeed empty, then `gal_data_free_ll' won't do
      anything. */
   free(line);
-
-
-  /* Close the file. */
-  errno=0;
-  if(fclose(fp))
-    error(EXIT_FAILURE, errno, "%s: couldn't close file after reading plain "
-          "text %s information in %s", filename, format_err, __func__);
+  txt_file_unmap(file, size, ismapped);
 
 
   /* Return the array of column information. */
@@ -642,6 +789,109 @@ gal_txt_image_info(char *filename, size_t *numimg, size_t *dsize)
 /************************************************************************/
 /***************             Read a txt table             ***************/
 /************************************************************************/
+/* Powers of ten that are exactly representable in a double. */
+static const double txt_pow10[]={1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                 1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                 1e18, 1e19, 1e20, 1e21, 1e22};
+
+
+
+
+
+/* Read a floating point number from `str' (similar to `strtod', with the
+   same output into `tailptr'). Numbers in a text table are usually simple
+   decimals (like `-12.345e-6'). When the significant digits of such a
+   number fit in 53 bits and its power of ten is within +-22, both are
+   exactly representable as doubles, so a single multiplication or
+   division gives the correctly rounded result (which is identical to
+   `strtod'), see Clinger (1990, PLDI, pp 92). Any other number or format
+   (for example `nan', `inf' or hexadecimal) is passed to `strtod'. */
+static double
+txt_str_to_double(char *str, char **tailptr)
+{
+  double d;
+  uint64_t m=0;
+  char *c=str;
+  int neg=0, eneg, e, exp10=0, ndigits=0, anydigit=0;
+
+  /* The sign and significant digits. Leading zeros aren't counted as
+     digits (they don't change the significand). */
+  if(*c=='-') { neg=1; ++c; } else if(*c=='+') ++c;
+  for(; *c>='0' && *c<='9'; ++c)
+    {
+      anydigit=1;
+      if( m || *c!='0' )
+        { if(++ndigits>19) goto fallback; m = m*10 + (*c-'0'); }
+    }
+  if(*c=='.')
+    for(++c; *c>='0' && *c<='9'; ++c)
+      {
+        anydigit=1;
+        --exp10;
+        if( m || *c!='0' )
+          { if(++ndigits>19) goto fallback; m = m*10 + (*c-'0'); }
+      }
+  if(anydigit==0) goto fallback;
+
+  /* The exponent. */
+  if(*c=='e' || *c=='E')
+    {
+      eneg=0;
+      ++c;
+      if(*c=='-') { eneg=1; ++c; } else if(*c=='+') ++c;
+      if(*c<'0' || *c>'9') goto fallback;
+      for(e=0; *c>='0' && *c<='9'; ++c)
+        { if(e>10000) goto fallback; e = e*10 + (*c-'0'); }
+      exp10 += eneg ? -e : e;
+    }
+
+  /* Only use the fast path when the full token has been parsed and the
+     conditions above hold. */
+  if( *c!='\0' || m>((uint64_t)1<<53) ) goto fallback;
+  if(m==0) d=0.0;
+  else if(exp10>=-22 && exp10<=22)
+    d = exp10<0 ? (double)m/txt_pow10[-exp10] : (double)m*txt_pow10[exp10];
+  else goto fallback;
+  *tailptr=c;
+  return neg ? -d : d;
+
+ fallback:
+  return strtod(str, tailptr);
+}
+
+
+
+
+
+/* Similar to `txt_str_to_double', but for integers: the equivalent of
+   `strtol' with a base of 0. Simple decimal integers (with less than 19
+   digits, so they can't overflow) are read directly, anything else
+   (including numbers starting with `0' that are read as octal or
+   hexadecimal) is passed to `strtol'. */
+static long
+txt_str_to_long(char *str, char **tailptr)
+{
+  long l=0;
+  int neg=0;
+  char *c=str, *digits;
+
+  if(*c=='-') { neg=1; ++c; } else if(*c=='+') ++c;
+  if( *c<'1' || *c>'9' ) goto fallback;
+  for(digits=c; *c>='0' && *c<='9'; ++c)
+    { if(c-digits>=18) goto fallback; l = l*10 + (*c-'0'); }
+  if(*c!='\0') goto fallback;
+  *tailptr=c;
+  return neg ? -l : l;
+
+ fallback:
+  return strtol(str, tailptr, 0);
+}
+
+
+
+
+
 static void
 txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
                size_t i, char *filename, size_t lineno, size_t colnum)
@@ -672,37 +922,37 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
       break;
 
     case GAL_TYPE_UINT8:
-      uc[i]=strtol(token, &tailptr, 0);
+      uc[i]=txt_str_to_long(token, &tailptr);
       if( (ucb=info->array) && *ucb==uc[i] )
         uc[i]=GAL_BLANK_UINT8;
       break;
 
     case GAL_TYPE_INT8:
-      c[i]=strtol(token, &tailptr, 0);
+      c[i]=txt_str_to_long(token, &tailptr);
       if( (cb=info->array) && *cb==c[i] )
         c[i]=GAL_BLANK_INT8;
       break;
 
     case GAL_TYPE_UINT16:
-      us[i]=strtol(token, &tailptr, 0);
+      us[i]=txt_str_to_long(token, &tailptr);
       if( (usb=info->array) && *usb==us[i] )
         us[i]=GAL_BLANK_UINT16;
       break;
 
     case GAL_TYPE_INT16:
-      s[i]=strtol(token, &tailptr, 0);
+      s[i]=txt_str_to_long(token, &tailptr);
       if( (sb=info->array) && *sb==s[i] )
         s[i]=GAL_BLANK_INT16;
       break;
 
     case GAL_TYPE_UINT32:
-      ui[i]=strtol(token, &tailptr, 0);
+      ui[i]=txt_str_to_long(token, &tailptr);
       if( (uib=info->array) && *uib==ui[i] )
         ui[i]=GAL_BLANK_UINT32;
       break;
 
     case GAL_TYPE_INT32:
-      ii[i]=strtol(token, &tailptr, 0);
+      ii[i]=txt_str_to_long(token, &tailptr);
       if( (ib=info->array) && *ib==ii[i] )
         ii[i]=GAL_BLANK_INT32;
       break;
@@ -714,7 +964,7 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
       break;
 
     case GAL_TYPE_INT64:
-      l[i]=strtol(token, &tailptr, 0);
+      l[i]=txt_str_to_long(token, &tailptr);
       if( (lb=info->array) && *lb==l[i] )
         l[i]=GAL_BLANK_INT64;
       break;
@@ -724,14 +974,14 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
          condition check (even `=='). If it isn't NaN, then we can
          compare the values. */
     case GAL_TYPE_FLOAT32:
-      f[i]=strtod(token, &tailptr);
+      f[i]=txt_str_to_double(token, &tailptr);
       if( (fb=info->array)
           && ( (isnan(*fb) && isnan(f[i])) || *fb==f[i] ) )
         f[i]=GAL_BLANK_FLOAT64;
       break;
 
     case GAL_TYPE_FLOAT64:
-      d[i]=strtod(token, &tailptr);
+      d[i]=txt_str_to_double(token, &tailptr);
       if( (db=info->array)
           && ( (isnan(*db) && isnan(d[i])) || *db==d[i] ) )
         d[i]=GAL_BLANK_FLOAT64;
@@ -753,12 +1003,13 @@ txt_read_token(gal_data_t *data, gal_data_t *info, char *token,
 
 
 
+/* Break the line into tokens (one token for each column), the pointer to
+   the start of column `n' (counting from 1) will be put in `tokens[n]'. */
 static void
-txt_fill(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
-         gal_data_t *out, size_t rowind, char *filename, size_t lineno)
+txt_tokenize(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
+             char *filename, size_t lineno)
 {
-  size_t i, n=0;
-  gal_data_t *data;
+  size_t n=0;
   int notenoughcols=0;
   char *end=line+strlen(line);
 
@@ -804,6 +1055,21 @@ txt_fill(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
                   "this line. Previous (uncommented) lines in this file had "
                   "%zu columns, but this line has %zu columns", maxcolnum,
                   n-1); /* This must be `n-1' (since n starts from 1). */
+}
+
+
+
+
+
+static void
+txt_fill(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
+         gal_data_t *out, size_t rowind, char *filename, size_t lineno)
+{
+  size_t i;
+  gal_data_t *data;
+
+  /* Break the line into its tokens. */
+  txt_tokenize(line, tokens, maxcolnum, info, filename, lineno);
 
   /* For a sanity check:
   printf("row: %zu: ", rowind+1);
@@ -839,37 +1105,322 @@ txt_fill(char *line, char **tokens, size_t maxcolnum, gal_data_t *info,
 
 
 
+/* Check if the values of the range columns of a row (already broken into
+   `tokens') are within their ranges. `blanks' keeps the blank value of
+   each range column (as a double, NaN when the column has no blank
+   value). Blank values are not within any range. */
+static int
+txt_row_in_ranges(char **tokens, gal_table_range_t *ranges, double *blanks,
+                  char *filename, size_t lineno)
+{
+  double v;
+  size_t k=0;
+  char *tailptr;
+  gal_table_range_t *r;
+
+  for(r=ranges; r!=NULL; r=r->next, ++k)
+    {
+      /* Read the value as a double. */
+      v=txt_str_to_double(tokens[r->index+1], &tailptr);
+      if(*tailptr!='\0')
+        error_at_line(EXIT_FAILURE, 0, filename, lineno, "column %zu "
+                      "(`%s') couldn't be read as a number", r->index+1,
+                      tokens[r->index+1]);
+
+      /* Check the range (a blank value, or NaN, will fail both
+         conditions). */
+      if( v==blanks[k] || !(v>=r->min && v<=r->max) ) return 0;
+    }
+  return 1;
+}
+
+
+
+
+
+/* To read the file over several threads, it is broken into chunks that
+   all start at the start of a line and the reading is done in three
+   steps over all the chunks (the chunks are independent in each step):
+
+     TXT_READ_COUNT: Count the number of lines and data rows of each chunk
+                     (so each chunk knows the row and line number of its
+                     first line).
+
+     TXT_READ_FLAG:  Only when ranges of values are requested: flag the
+                     rows that are in the ranges and count them (so each
+                     chunk knows where its first output row should be).
+
+     TXT_READ_FILL:  Read the values of the selected rows into the output.
+
+   Chunks smaller than `TXT_READ_MIN_CHUNK' (in bytes) are not worth the
+   overhead of a thread.*/
+#define TXT_READ_MIN_CHUNK 1048576
+enum txt_read_steps
+{
+  TXT_READ_COUNT,
+  TXT_READ_FLAG,
+  TXT_READ_FILL,
+};
+
+struct txt_read_params
+{
+  char          *filename;  /* Name of file (for error messages).       */
+  char              *file;  /* Contents of the file.                    */
+  size_t        numchunks;  /* Number of chunks.                        */
+  size_t          *cstart;  /* Start of each chunk (from file start).   */
+  size_t          *clines;  /* Number of lines in each chunk.           */
+  size_t           *crows;  /* Number of data rows in each chunk.       */
+  size_t      *clinestart;  /* Number of lines before each chunk.       */
+  size_t       *crowstart;  /* Number of data rows before each chunk.   */
+  size_t       *cselected;  /* Number of selected rows in each chunk.   */
+  size_t       *coutstart;  /* Output index of each chunk's first row.  */
+  size_t            first;  /* First row to read (counting from 0).     */
+  size_t           nrange;  /* Number of rows to check after `first'.   */
+  uint8_t          *flags;  /* Flag of rows that are in the ranges.     */
+  double          *blanks;  /* Blank value of each range column.        */
+  gal_table_range_t *ranges; /* Ranges of values to select rows.        */
+  size_t        maxcolnum;  /* Largest necessary column number.         */
+  gal_data_t        *info;  /* Information of all columns.              */
+  gal_data_t         *out;  /* Output dataset(s).                       */
+  int                step;  /* Step of the reading (`txt_read_steps').  */
+};
+
+
+
+
+
+static void *
+txt_read_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_read_params *p=(struct txt_read_params *)tprm->params;
+
+  char **tokens;
+  char *line=NULL, *start, *end;
+  size_t i, c, len, rowind, lineno, outind, linelen=0;
+
+  /* Allocate the space to keep the pointers to each token in the
+     line. This is done here to avoid having to allocate/free this array
+     for each line in `txt_fill'. Note that the column numbers are counted
+     from one (unlike indexes that are counted from zero), so we need
+     `maxcolnum+1' elements in the array of tokens.*/
+  errno=0;
+  tokens=malloc((p->maxcolnum+1)*sizeof *tokens);
+  if(tokens==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `tokens'",
+          __func__, (p->maxcolnum+1)*sizeof *tokens);
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the starting and ending pointers of this chunk. */
+      c=tprm->indexs[i];
+      end=p->file+p->cstart[c+1];
+      start=p->file+p->cstart[c];
+
+      /* In the first step, we just need to count the lines and rows. */
+      if(p->step==TXT_READ_COUNT)
+        {
+          for(; start<end; start+=len+1)
+            {
+              ++p->clines[c];
+              if( txt_line_stat_mapped(start, end, &len, &line, &linelen)
+                  == GAL_TXT_LINESTAT_DATAROW )
+                ++p->crows[c];
+            }
+          continue;
+        }
+
+      /* Ignore this chunk if none of its rows are in the desired range. */
+      rowind=p->crowstart[c];
+      if( rowind >= p->first+p->nrange
+          || rowind+p->crows[c] <= p->first )
+        continue;
+
+      /* Parse the lines of this chunk. Rows outside the selection are not
+         parsed at all. */
+      outind=p->coutstart[c];
+      lineno=p->clinestart[c];
+      for(; start<end && rowind<p->first+p->nrange; start+=len+1)
+        {
+          ++lineno;
+          if( txt_line_stat_mapped(start, end, &len, &line, &linelen)
+              != GAL_TXT_LINESTAT_DATAROW )
+            continue;
+
+          if( rowind>=p->first )
+            {
+              txt_line_copy(start, len, &line, &linelen);
+              if(p->step==TXT_READ_FLAG)
+                {
+                  txt_tokenize(line, tokens, p->maxcolnum, p->info,
+                               p->filename, lineno);
+                  p->cselected[c] += p->flags[rowind-p->first] =
+                    txt_row_in_ranges(tokens, p->ranges, p->blanks,
+                                      p->filename, lineno);
+                }
+              else if( p->flags==NULL || p->flags[rowind-p->first] )
+                txt_fill(line, tokens, p->maxcolnum, p->info, p->out,
+                         outind++, p->filename, lineno);
+            }
+          ++rowind;
+        }
+    }
+
+  /* Clean up and wait until all other threads finish. */
+  free(line);
+  free(tokens);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Break the file into chunks that start at the start of a line. */
+static void
+txt_read_chunks(struct txt_read_params *p, size_t size, size_t numthreads)
+{
+  char *nl;
+  size_t c, s;
+
+  /* Set the number of chunks (at least one). */
+  p->numchunks=size/TXT_READ_MIN_CHUNK+1;
+  if(p->numchunks>numthreads) p->numchunks=numthreads;
+
+  /* Allocate all the per-chunk arrays in one block. */
+  p->cstart     = gal_data_calloc_array(GAL_TYPE_SIZE_T, 7*p->numchunks+1);
+  p->clines     = p->cstart     + p->numchunks + 1;
+  p->crows      = p->clines     + p->numchunks;
+  p->clinestart = p->crows      + p->numchunks;
+  p->crowstart  = p->clinestart + p->numchunks;
+  p->cselected  = p->crowstart  + p->numchunks;
+  p->coutstart  = p->cselected  + p->numchunks;
+
+  /* Move the start of each chunk to the start of the next line. */
+  p->cstart[p->numchunks]=size;
+  for(c=1;c<p->numchunks;++c)
+    {
+      s=c*(size/p->numchunks);
+      if(s<p->cstart[c-1]) s=p->cstart[c-1];
+      if( s>0 && p->file[s-1]!='\n' )
+        s = ( (nl=memchr(p->file+s, '\n', size-s))
+              ? nl-p->file+1
+              : size );
+      p->cstart[c]=s;
+    }
+}
+
+
+
+
+
 static gal_data_t *
 gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
-             gal_list_sizet_t *indexll, int minmapsize, int format)
+             gal_list_sizet_t *indexll, size_t numthreads, int minmapsize,
+             int format, gal_table_rowsel_t *rowsel)
 {
-  FILE *fp;
-  char *line;
-  char **tokens;
-  gal_data_t *out=NULL;
+  size_t ndim;
+  int ismapped;
+  gal_data_t *tmp;
+  gal_table_range_t *r;
   gal_list_sizet_t *ind;
-  size_t maxcolnum=0, rowind=0, lineno=0, ndim;
-  size_t linelen=10;        /* `linelen' will be increased by `getline'. */
+  struct txt_read_params p={0};
+  size_t c, k, size, nread, numrows=dsize[0];
 
-  /* Open the file. */
-  errno=0;
-  fp=fopen(filename, "r");
-  if(fp==NULL)
-    error(EXIT_FAILURE, errno, "%s: could't open to read as a text table "
-          "in %s", filename, __func__);
+  /* Set the range of rows to check (only for tables). When there are no
+     ranges of values, all these rows will be read. */
+  p.nrange=numrows;
+  if(rowsel)
+    {
+      p.first = rowsel->first<numrows ? rowsel->first : numrows;
+      p.nrange = ( rowsel->number && p.first+rowsel->number<numrows
+                   ? rowsel->number : numrows-p.first );
+      if(p.nrange==0) return NULL;
+      p.ranges=rowsel->ranges;
+    }
+  nread=p.nrange;
+  if(numthreads==0) numthreads=1;
 
-  /* Allocate the space necessary to keep a copy of each line as we parse
-     it. Note that `getline' is going to later `realloc' this space to fit
-     the line length. */
-  errno=0;
-  line=malloc(linelen*sizeof *line);
-  if(line==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `line'",
-          __func__, linelen*sizeof *line);
-
-  /* Allocate all the desired columns for output. We will be reading the
-     text file line by line, and writing in the necessary values of each
-     row individually. */
+  /* Find the largest column number that is necessary. */
+  switch(format)
+    {
+    case TXT_FORMAT_TABLE:
+      for(ind=indexll; ind!=NULL; ind=ind->next)
+        p.maxcolnum = p.maxcolnum>ind->v+1 ? p.maxcolnum : ind->v+1;
+      for(r=p.ranges; r!=NULL; r=r->next)
+        p.maxcolnum = p.maxcolnum>r->index+1 ? p.maxcolnum : r->index+1;
+      break;
+    case TXT_FORMAT_IMAGE:
+      p.maxcolnum=dsize[1];
+      break;
+    default:
+      error(EXIT_FAILURE, 0, "%s: format code %d not recognized",
+            __func__, format);
+    }
+
+  /* Map the file into memory, break it into chunks and count the lines
+     and rows in each chunk. */
+  p.info=info;
+  p.filename=filename;
+  p.file=txt_file_map(filename, &size, &ismapped);
+  txt_read_chunks(&p, size, numthreads);
+  p.step=TXT_READ_COUNT;
+  gal_threads_spin_off(txt_read_on_thread, &p, p.numchunks, numthreads);
+  for(c=1;c<p.numchunks;++c)
+    {
+      p.crowstart[c]  = p.crowstart[c-1]  + p.crows[c-1];
+      p.clinestart[c] = p.clinestart[c-1] + p.clines[c-1];
+    }
+
+  /* When ranges of values are given, we need to go over the file once to
+     flag the rows that should be read and count them. This is necessary
+     to allocate the output columns only for the desired rows. */
+  if(p.ranges)
+    {
+      /* Keep the blank value of each range column as a double. */
+      k=0;
+      for(r=p.ranges; r!=NULL; r=r->next) ++k;
+      p.blanks=gal_data_malloc_array(GAL_TYPE_FLOAT64, k);
+      for(r=p.ranges, k=0; r!=NULL; r=r->next, ++k)
+        if(info[r->index].array)
+          {
+            tmp=gal_data_copy_to_new_type(&info[r->index],
+                                          GAL_TYPE_FLOAT64);
+            p.blanks[k]=*(double *)(tmp->array);
+            gal_data_free(tmp);
+          }
+        else p.blanks[k]=NAN;
+
+      /* Flag the rows and find the output row of each chunk. */
+      p.flags=gal_data_calloc_array(GAL_TYPE_UINT8, p.nrange);
+      p.step=TXT_READ_FLAG;
+      gal_threads_spin_off(txt_read_on_thread, &p, p.numchunks, numthreads);
+      nread=p.cselected[0];
+      for(c=1;c<p.numchunks;++c)
+        {
+          p.coutstart[c] = p.coutstart[c-1] + p.cselected[c-1];
+          nread += p.cselected[c];
+        }
+      free(p.blanks);
+
+      /* If no rows were selected, clean up and return. */
+      if(nread==0)
+        {
+          free(p.flags);
+          free(p.cstart);
+          txt_file_unmap(p.file, size, ismapped);
+          return NULL;
+        }
+    }
+  else
+    for(c=0;c<p.numchunks;++c)
+      p.coutstart[c] = ( p.crowstart[c]<p.first ? 0
+                         : ( p.crowstart[c]<p.first+p.nrange
+                             ? p.crowstart[c]-p.first : p.nrange ) );
+
+  /* Allocate all the desired columns for output. */
   switch(format)
     {
 
@@ -878,12 +1429,12 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
       for(ind=indexll; ind!=NULL; ind=ind->next)
         {
           ndim=1;
-          maxcolnum = maxcolnum>ind->v+1 ? maxcolnum : ind->v+1;
-          gal_list_data_add_alloc(&out, NULL, info[ind->v].type, ndim, dsize,
-                                  NULL, 0, minmapsize, info[ind->v].name,
-                                  info[ind->v].unit, info[ind->v].comment);
-          out->disp_width=info[ind->v].disp_width;
-          out->status=ind->v+1;
+          gal_list_data_add_alloc(&p.out, NULL, info[ind->v].type, ndim,
+                                  &nread, NULL, 0, minmapsize,
+                                  info[ind->v].name, info[ind->v].unit,
+                                  info[ind->v].comment);
+          p.out->disp_width=info[ind->v].disp_width;
+          p.out->status=ind->v+1;
         }
       break;
 
@@ -895,48 +1446,22 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
               "array) from a text file is possible, the `info' input has "
               "more than one element", __func__);
       ndim=2;
-      maxcolnum=dsize[1];
-      out=gal_data_alloc(NULL, info->type, ndim, dsize, NULL, 0, minmapsize,
-                         info->name, info->unit, info->comment);
+      p.out=gal_data_alloc(NULL, info->type, ndim, dsize, NULL, 0,
+                           minmapsize, info->name, info->unit,
+                           info->comment);
       break;
-
-
-    /* Not recognized. */
-    default:
-      error(EXIT_FAILURE, 0, "%s: format code %d not recognized",
-            __func__, format);
     }
 
-  /* Allocate the space to keep the pointers to each token in the
-     line. This is done here to avoid having to allocate/free this array
-     for each line in `txt_fill_columns'. Note that the column numbers are
-     counted from one (unlike indexes that are counted from zero), so we
-     need `maxcolnum+1' elements in the array of tokens.*/
-  errno=0;
-  tokens=malloc((maxcolnum+1)*sizeof *tokens);
-  if(tokens==NULL)
-    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `tokens'",
-          __func__, (maxcolnum+1)*sizeof *tokens);
+  /* Read the data columns. Each chunk writes its rows into its own part
+     of the output, so no locking is necessary. */
+  p.step=TXT_READ_FILL;
+  gal_threads_spin_off(txt_read_on_thread, &p, p.numchunks, numthreads);
 
-  /* Read the data columns. */
-  while( getline(&line, &linelen, fp) != -1 )
-    {
-      ++lineno;
-      if( gal_txt_line_stat(line) == GAL_TXT_LINESTAT_DATAROW )
-        txt_fill(line, tokens, maxcolnum, info, out, rowind++,
-                 filename, lineno);
-    }
-
-  /* Clean up and close the file. */
-  errno=0;
-  if(fclose(fp))
-    error(EXIT_FAILURE, errno, "%s: couldn't close file after reading ASCII "
-          "table information in %s", filename, __func__);
-  free(tokens);
-  free(line);
-
-  /* Return the array of column information. */
-  return out;
+  /* Clean up and return the output. */
+  free(p.flags);
+  free(p.cstart);
+  txt_file_unmap(p.file, size, ismapped);
+  return p.out;
 }
 
 
@@ -945,10 +1470,11 @@ gal_txt_read(char *filename, size_t *dsize, gal_data_t *info,
 
 gal_data_t *
 gal_txt_table_read(char *filename, size_t numrows, gal_data_t *colinfo,
-                   gal_list_sizet_t *indexll, size_t minmapsize)
+                   gal_list_sizet_t *indexll, size_t numthreads,
+                   size_t minmapsize, gal_table_rowsel_t *rowsel)
 {
-  return gal_txt_read(filename, &numrows, colinfo, indexll, minmapsize,
-                      TXT_FORMAT_TABLE);
+  return gal_txt_read(filename, &numrows, colinfo, indexll, numthreads,
+                      minmapsize, TXT_FORMAT_TABLE, rowsel);
 }
 
 
@@ -966,8 +1492,8 @@ gal_txt_image_read(char *filename, size_t minmapsize)
   imginfo=gal_txt_image_info(filename, &numimg, dsize);
 
   /* Read the table. */
-  img=gal_txt_read(filename, dsize, imginfo, indexll, minmapsize,
-                   TXT_FORMAT_IMAGE);
+  img=gal_txt_read(filename, dsize, imginfo, indexll, 1, minmapsize,
+                   TXT_FORMAT_IMAGE, NULL);
 
   /* Clean up and return. */
   gal_data_free(imginfo);
@@ -1099,35 +1625,51 @@ make_fmts_for_printf(gal_data_t *datall, int leftadjust, size_t *len)
 
 
 
-static void
-txt_print_value(FILE *fp, void *array, int type, size_t ind, char *fmt)
+/* Print the value of element `ind' in `array' into `str' (with `size'
+   bytes available) with the `printf' format `fmt'. Like `snprintf', the
+   number of characters that the full value needs is returned. */
+static int
+txt_sprint_value(char *str, size_t size, void *array, int type, size_t ind,
+                 char *fmt)
 {
   switch(type)
     {
       /* Numerical types. */
-    case GAL_TYPE_UINT8:   fprintf(fp, fmt, ((uint8_t *) array)[ind]); break;
-    case GAL_TYPE_INT8:    fprintf(fp, fmt, ((int8_t *)  array)[ind]); break;
-    case GAL_TYPE_UINT16:  fprintf(fp, fmt, ((uint16_t *)array)[ind]); break;
-    case GAL_TYPE_INT16:   fprintf(fp, fmt, ((int16_t *) array)[ind]); break;
-    case GAL_TYPE_UINT32:  fprintf(fp, fmt, ((uint32_t *)array)[ind]); break;
-    case GAL_TYPE_INT32:   fprintf(fp, fmt, ((int32_t *) array)[ind]); break;
-    case GAL_TYPE_UINT64:  fprintf(fp, fmt, ((uint64_t *)array)[ind]); break;
-    case GAL_TYPE_INT64:   fprintf(fp, fmt, ((int64_t *) array)[ind]); break;
-    case GAL_TYPE_FLOAT32: fprintf(fp, fmt, ((float *)   array)[ind]); break;
-    case GAL_TYPE_FLOAT64: fprintf(fp, fmt, ((double *)  array)[ind]); break;
+    case GAL_TYPE_UINT8:   return snprintf(str, size, fmt,
+                                           ((uint8_t *) array)[ind]);
+    case GAL_TYPE_INT8:    return snprintf(str, size, fmt,
+                                           ((int8_t *)  array)[ind]);
+    case GAL_TYPE_UINT16:  return snprintf(str, size, fmt,
+                                           ((uint16_t *)array)[ind]);
+    case GAL_TYPE_INT16:   return snprintf(str, size, fmt,
+                                           ((int16_t *) array)[ind]);
+    case GAL_TYPE_UINT32:  return snprintf(str, size, fmt,
+                                           ((uint32_t *)array)[ind]);
+    case GAL_TYPE_INT32:   return snprintf(str, size, fmt,
+                                           ((int32_t *) array)[ind]);
+    case GAL_TYPE_UINT64:  return snprintf(str, size, fmt,
+                                           ((uint64_t *)array)[ind]);
+    case GAL_TYPE_INT64:   return snprintf(str, size, fmt,
+                                           ((int64_t *) array)[ind]);
+    case GAL_TYPE_FLOAT32: return snprintf(str, size, fmt,
+                                           ((float *)   array)[ind]);
+    case GAL_TYPE_FLOAT64: return snprintf(str, size, fmt,
+                                           ((double *)  array)[ind]);
 
       /* Special consideration for strings. */
     case GAL_TYPE_STRING:
       if( !strcmp( ((char **)array)[ind], GAL_BLANK_STRING ) )
-        fprintf(fp, fmt, GAL_BLANK_STRING);
+        return snprintf(str, size, fmt, GAL_BLANK_STRING);
       else
-        fprintf(fp, fmt, ((char **)array)[ind]);
-      break;
+        return snprintf(str, size, fmt, ((char **)array)[ind]);
 
     default:
       error(EXIT_FAILURE, 0, "%s: type code %d not recognized",
             __func__, type);
     }
+
+  /* Control should not reach here. */
+  return 0;
 }
 
 
@@ -1227,13 +1769,312 @@ txt_open_file_write_info(gal_data_t *datall, char **fmts,
 
 
 
+/* To write a large table, the rows are broken into chunks of
+   `chunkrows' rows (roughly `TXT_WRITE_CHUNK' bytes). Each chunk is
+   formatted into its own buffer on one thread and the buffers are then
+   written into the file in order, with one `fwrite' each. To keep the
+   used memory limited, this is done on `numthreads' chunks at a time.
+
+   Each column is written in one of these ways: decimal integers and
+   strings (with no precision) are directly written into the buffer, for
+   all others (for example floating points) `snprintf' is used. In both
+   cases, the result is identical to `printf' with the column's format.*/
+#define TXT_WRITE_CHUNK 1048576
+enum txt_write_kinds
+{
+  TXT_WRITE_PRINTF,
+  TXT_WRITE_INT,
+  TXT_WRITE_UINT,
+  TXT_WRITE_STRING,
+};
+
+struct txt_write_params
+{
+  gal_data_t      **cols;  /* Pointer to each column.                    */
+  char            **fmts;  /* `printf' format of each column.            */
+  int             *kinds;  /* How to write each column.                  */
+  size_t         numcols;  /* Number of columns.                         */
+  size_t          ncells;  /* Number of values in each row.              */
+  size_t         numrows;  /* Total number of rows.                      */
+  size_t       chunkrows;  /* Number of rows in each chunk.              */
+  size_t      firstchunk;  /* Index of the first chunk in this batch.    */
+  char            **bufs;  /* Buffer of each chunk in the batch.         */
+  size_t        *buflens;  /* Used length of each buffer.                */
+  size_t       *bufsizes;  /* Allocated size of each buffer.             */
+};
+
+
+
+
+
+/* Make sure there is space for `n' more characters in buffer `b'. */
+static void
+txt_write_buf_check(struct txt_write_params *p, size_t b, size_t n)
+{
+  if(p->buflens[b]+n > p->bufsizes[b])
+    {
+      p->bufsizes[b] = 2*(p->buflens[b]+n);
+      errno=0;
+      p->bufs[b]=realloc(p->bufs[b], p->bufsizes[b]);
+      if(p->bufs[b]==NULL)
+        error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for buffer",
+              __func__, p->bufsizes[b]);
+    }
+}
+
+
+
+
+
+/* Write the decimal digits of `v' into `str' (which must have space for
+   20 characters) and return the number of characters written. */
+static size_t
+txt_write_digits(char *str, uint64_t v)
+{
+  size_t n=0, i;
+  char tmp[20];
+
+  do { tmp[n++] = '0' + v%10; v/=10; } while(v);
+  for(i=0;i<n;++i) str[i]=tmp[n-1-i];
+  return n;
+}
+
+
+
+
+
+/* Write one value into buffer `b'. All formats of `gal_txt_write' are
+   left-adjusted and finish with a space, so for the directly written
+   types, the value is followed by spaces until the width and then one
+   extra space. */
+static void
+txt_write_value(struct txt_write_params *p, size_t b, gal_data_t *col,
+                char *fmt, int kind, size_t ind)
+{
+  int n;
+  char *str;
+  int64_t v;
+  size_t len, width=col->disp_width;
+
+  switch(kind)
+    {
+    case TXT_WRITE_INT:
+    case TXT_WRITE_UINT:
+      txt_write_buf_check(p, b, (width>21 ? width : 21)+1);
+      str=p->bufs[b]+p->buflens[b];
+      len=0;
+      if(kind==TXT_WRITE_UINT)
+        switch(col->type)
+          {
+          case GAL_TYPE_UINT8:
+            len=txt_write_digits(str, ((uint8_t  *)col->array)[ind]); break;
+          case GAL_TYPE_UINT16:
+            len=txt_write_digits(str, ((uint16_t *)col->array)[ind]); break;
+          case GAL_TYPE_UINT32:
+            len=txt_write_digits(str, ((uint32_t *)col->array)[ind]); break;
+          case GAL_TYPE_UINT64:
+            len=txt_write_digits(str, ((uint64_t *)col->array)[ind]); break;
+          }
+      else
+        {
+          switch(col->type)
+            {
+            case GAL_TYPE_INT8:  v=((int8_t  *)col->array)[ind]; break;
+            case GAL_TYPE_INT16: v=((int16_t *)col->array)[ind]; break;
+            case GAL_TYPE_INT32: v=((int32_t *)col->array)[ind]; break;
+            default:             v=((int64_t *)col->array)[ind];
+            }
+          if(v<0) str[len++]='-';
+          len+=txt_write_digits(str+len, v<0 ? -(uint64_t)v : (uint64_t)v);
+        }
+      break;
+
+    case TXT_WRITE_STRING:
+      str=((char **)col->array)[ind];
+      len=strlen(str);
+      txt_write_buf_check(p, b, (width>len ? width : len)+1);
+      memcpy(p->bufs[b]+p->buflens[b], str, len);
+      break;
+
+    default:
+      n=txt_sprint_value(p->bufs[b]+p->buflens[b],
+                         p->bufsizes[b]-p->buflens[b], col->array,
+                         col->type, ind, fmt);
+      if( p->buflens[b]+n >= p->bufsizes[b] )
+        {
+          txt_write_buf_check(p, b, n+1);
+          txt_sprint_value(p->bufs[b]+p->buflens[b],
+                           p->bufsizes[b]-p->buflens[b], col->array,
+                           col->type, ind, fmt);
+        }
+      p->buflens[b]+=n;
+      return;
+    }
+
+  /* Pad the directly written values. */
+  str=p->bufs[b]+p->buflens[b];
+  while(len<width) str[len++]=' ';
+  str[len++]=' ';
+  p->buflens[b]+=len;
+}
+
+
+
+
+
+static void *
+txt_write_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct txt_write_params *p=(struct txt_write_params *)tprm->params;
+
+  gal_data_t *col;
+  size_t b, i, j, c, r, rend;
+
+  /* Go over all the chunks that were assigned to this thread. */
+  for(i=0; tprm->indexs[i]!=GAL_BLANK_SIZE_T; ++i)
+    {
+      /* Set the range of rows in this chunk. */
+      b=tprm->indexs[i];
+      p->buflens[b]=0;
+      r=(p->firstchunk+b)*p->chunkrows;
+      rend = r+p->chunkrows<p->numrows ? r+p->chunkrows : p->numrows;
+
+      /* Format the rows. For a 2D array, there is only one column, but
+         each row has `ncells' values. */
+      for(; r<rend; ++r)
+        {
+          if(p->numcols==1 && p->cols[0]->ndim==2)
+            for(j=0;j<p->ncells;++j)
+              txt_write_value(p, b, p->cols[0], p->fmts[0], p->kinds[0],
+                              r*p->ncells+j);
+          else
+            for(c=0;c<p->numcols;++c)
+              {
+                col=p->cols[c];
+                txt_write_value(p, b, col, p->fmts[c], p->kinds[c], r);
+              }
+          txt_write_buf_check(p, b, 1);
+          p->bufs[b][ p->buflens[b]++ ]='\n';
+        }
+    }
+
+  /* Wait until all other threads finish. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Write the rows of the table into `fp'. */
+static void
+txt_write_rows(gal_data_t *input, char **fmts, size_t num, FILE *fp,
+               size_t numthreads, char *filename)
+{
+  char *f;
+  gal_data_t *data;
+  size_t i, j, rowlen=1, numchunks, nbatch;
+  struct txt_write_params p={0};
+
+  /* If there are no rows, there is nothing to write. */
+  p.numrows = input->ndim==2 ? input->dsize[0] : input->size;
+  if(p.numrows==0) return;
+
+  /* Set the basic information of each column. */
+  p.numcols=num;
+  p.ncells = input->ndim==2 ? input->dsize[1] : num;
+  if(numthreads==0) numthreads=1;
+  errno=0;
+  p.cols=malloc(num*sizeof *p.cols);
+  p.fmts=malloc(num*sizeof *p.fmts);
+  p.kinds=malloc(num*sizeof *p.kinds);
+  if(p.cols==NULL || p.fmts==NULL || p.kinds==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating space for %zu columns",
+          __func__, num);
+  for(data=input, i=0; data!=NULL; data=data->next, ++i)
+    {
+      p.cols[i]=data;
+      p.fmts[i]=fmts[i*FMTS_COLS];
+
+      /* The format's conversion character is just before the final
+         space. */
+      f=p.fmts[i]+strlen(p.fmts[i])-2;
+      if(data->disp_precision>0 && data->type!=GAL_TYPE_STRING)
+        p.kinds[i]=TXT_WRITE_PRINTF;
+      else
+        switch(data->type)
+          {
+          case GAL_TYPE_UINT8:  case GAL_TYPE_UINT16:
+          case GAL_TYPE_UINT32: case GAL_TYPE_UINT64:
+            p.kinds[i] = *f=='u' ? TXT_WRITE_UINT : TXT_WRITE_PRINTF;
+            break;
+          case GAL_TYPE_INT8:   case GAL_TYPE_INT16:
+          case GAL_TYPE_INT32:  case GAL_TYPE_INT64:
+            p.kinds[i] = *f=='d' ? TXT_WRITE_INT : TXT_WRITE_PRINTF;
+            break;
+          case GAL_TYPE_STRING:
+            p.kinds[i] = ( *f=='s' && strchr(p.fmts[i], '.')==NULL
+                           ? TXT_WRITE_STRING : TXT_WRITE_PRINTF );
+            break;
+          default:
+            p.kinds[i]=TXT_WRITE_PRINTF;
+          }
+
+      /* Estimate of the length of a row. */
+      rowlen += ( data->disp_width+1 ) * ( input->ndim==2 ? p.ncells : 1 );
+    }
+
+  /* Set the number of rows in each chunk and allocate the buffers. */
+  p.chunkrows = TXT_WRITE_CHUNK/rowlen ? TXT_WRITE_CHUNK/rowlen : 1;
+  numchunks = p.numrows/p.chunkrows + (p.numrows%p.chunkrows ? 1 : 0);
+  nbatch = numchunks<numthreads ? numchunks : numthreads;
+  errno=0;
+  p.bufs=calloc(nbatch, sizeof *p.bufs);
+  if(p.bufs==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `p.bufs'",
+          __func__, nbatch*sizeof *p.bufs);
+  p.buflens=gal_data_calloc_array(GAL_TYPE_SIZE_T, nbatch);
+  p.bufsizes=gal_data_calloc_array(GAL_TYPE_SIZE_T, nbatch);
+
+  /* Format each batch of chunks and write them in order. */
+  for(p.firstchunk=0; p.firstchunk<numchunks; p.firstchunk+=nbatch)
+    {
+      j = ( p.firstchunk+nbatch<=numchunks
+            ? nbatch : numchunks-p.firstchunk );
+      gal_threads_spin_off(txt_write_on_thread, &p, j, numthreads);
+      for(i=0;i<j;++i)
+        {
+          errno=0;
+          if( fwrite(p.bufs[i], 1, p.buflens[i], fp) != p.buflens[i] )
+            error(EXIT_FAILURE, errno, "%s: couldn't write the table rows "
+                  "in %s", filename ? filename : "standard output",
+                  __func__);
+        }
+    }
+
+  /* Clean up. */
+  for(i=0;i<nbatch;++i) free(p.bufs[i]);
+  free(p.bufsizes);
+  free(p.buflens);
+  free(p.kinds);
+  free(p.bufs);
+  free(p.fmts);
+  free(p.cols);
+}
+
+
+
+
+
 void
 gal_txt_write(gal_data_t *input, gal_list_str_t *comment, char *filename,
-              int dontdelete)
+              size_t numthreads, int dontdelete)
 {
   FILE *fp;
   char **fmts;
-  size_t i, j, num=0, fmtlen;
+  size_t i, num=0, fmtlen;
   gal_data_t *data, *next2d=NULL;
 
 
@@ -1284,35 +2125,7 @@ gal_txt_write(gal_data_t *input, gal_list_str_t *comment, char *filename,
 
 
   /* Print the dataset */
-  switch(input->ndim)
-    {
-    case 1:
-      for(i=0;i<input->size;++i)                        /* Row.    */
-        {
-          j=0;
-          for(data=input;data!=NULL;data=data->next)    /* Column. */
-            txt_print_value(fp, data->array, data->type, i,
-                            fmts[j++ * FMTS_COLS]);
-          fprintf(fp, "\n");
-        }
-      break;
-
-
-    case 2:
-      for(i=0;i<input->dsize[0];++i)
-        {
-          for(j=0;j<input->dsize[1];++j)
-            txt_print_value(fp, input->array, input->type,
-                            i*input->dsize[1]+j, fmts[0]);
-          fprintf(fp, "\n");
-        }
-      break;
-
-
-    default:
-      error(EXIT_FAILURE, 0, "%s: a bug! input->ndim=%zu is not recognized",
-            __func__, input->ndim);
-    }
+  txt_write_rows(input, fmts, num, fp, numthreads, filename);
 
 
 
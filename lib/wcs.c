@@ -36,6 +36,7 @@ along with Gnuastro. If not, see <http://www.gnu.org/licenses/>.
 #include <gnuastro/wcs.h>
 #include <gnuastro/tile.h>
 #include <gnuastro/fits.h>
+#include <gnuastro/threads.h>
 #include <gnuastro/dimension.h>
 
 
@@ -494,63 +495,167 @@ gal_wcs_pixel_area_arcsec2(struct wcsprm *wcs)
 /**************************************************************/
 /**********            Array conversion            ************/
 /**************************************************************/
-/* Convert an array of world coordinates to image coordinates. Note that in
-   Gnuastro, each column is treated independently, so the inputs are
-   separate. If `*x==NULL', or `*y==NULL', then space will be allocated for
-   them, otherwise, it is assumed that space has already been
-   allocated. Note that they must each be a 1 dimensional array.
-
-   You can do the conversion in place: just pass the same array as you give
-   to RA and Dec to X and Y. */
-void
-gal_wcs_world_to_img(struct wcsprm *wcs, double *ra, double *dec,
-                     double **x, double **y, size_t size)
+/* WCSLIB's conversion functions need the two coordinates of each point
+   to be contiguous in memory (with many other intermediate arrays), but
+   in Gnuastro each coordinate is a separate array (for example columns in
+   a table). So the conversion is done in blocks of this many points: only
+   one block of the intermediate arrays is needed on each thread and they
+   stay in the CPU cache. */
+#define WCS_CONVERT_BLOCK 4096
+
+struct wcs_convert_params
 {
-  size_t i;
-  int status, *stat, ncoord=size, nelem=2;
-  double *phi, *theta, *world, *pixcrd, *imgcrd;
-
-  /* Allocate all the necessary arrays. */
-  phi    = gal_data_malloc_array( GAL_TYPE_FLOAT64, size   );
-  stat   = gal_data_calloc_array( GAL_TYPE_INT32,   size   );
-  theta  = gal_data_malloc_array( GAL_TYPE_FLOAT64, size   );
-  world  = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-  imgcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-  pixcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-
-  /* Write the values into the allocated contiguous array. */
-  for(i=0;i<size;++i) { world[i*2]=ra[i]; world[i*2+1]=dec[i]; }
-
-  /* Use WCSLIB's `wcss2p'. */
-  status=wcss2p(wcs, ncoord, nelem, world, phi, theta, imgcrd, pixcrd, stat);
-  if(status)
-    error(EXIT_FAILURE, 0, "%s: wcss2p ERROR %d: %s", __func__, status,
-          wcs_errmsg[status]);
+  struct wcsprm    *wcs;    /* The WCS structure to use.               */
+  double           *in1;    /* First input coordinate.                 */
+  double           *in2;    /* Second input coordinate.                */
+  double          *out1;    /* First output coordinate.                */
+  double          *out2;    /* Second output coordinate.               */
+  size_t           size;    /* Number of points.                       */
+  size_t     numthreads;    /* Number of threads to use.               */
+  int           toworld;    /* ==1: image to world. ==0: world to image.*/
+};
 
-  /* For a sanity check:
-  printf("\n\ngal_wcs_world_to_img sanity check:\n");
-  for(i=0;i<size;++i)
-    printf("world (%f, %f) --> pix (%f, %f), [stat: %d]\n",
-           world[i*2], world[i*2+1], pixcrd[i*2], pixcrd[i*2+1], stat[i]);
-  */
 
-  /* Allocate the output arrays if they were not already allocated. */
-  if(*x==NULL) *x=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
-  if(*y==NULL) *y=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
 
-  /* Put the values into the output arrays. */
-  for(i=0;i<size;++i)
+
+
+static void *
+wcs_convert_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct wcs_convert_params *prm=(struct wcs_convert_params *)tprm->params;
+
+  struct wcsprm *wcs;
+  size_t i, j, b, start, num;
+  int *stat, status, nwcs=1, nelem=2;
+  double *phi, *theta, *world, *imgcrd, *pixcrd, *input, *output;
+  double *in1=prm->in1, *in2=prm->in2, *out1=prm->out1, *out2=prm->out2;
+
+  /* WCSLIB's conversion functions may modify the `wcsprm' structure (for
+     example through `wcsset'), so when there are multiple threads, each
+     uses its own copy. */
+  wcs = prm->numthreads==1 ? prm->wcs : gal_wcs_copy(prm->wcs);
+
+  /* Allocate the intermediate arrays for one block. */
+  stat   = gal_data_malloc_array( GAL_TYPE_INT32,   WCS_CONVERT_BLOCK   );
+  phi    = gal_data_malloc_array( GAL_TYPE_FLOAT64, WCS_CONVERT_BLOCK   );
+  theta  = gal_data_malloc_array( GAL_TYPE_FLOAT64, WCS_CONVERT_BLOCK   );
+  world  = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*WCS_CONVERT_BLOCK );
+  imgcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*WCS_CONVERT_BLOCK );
+  pixcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*WCS_CONVERT_BLOCK );
+
+  /* Set the input and output of WCSLIB's functions. */
+  input  = prm->toworld ? pixcrd : world;
+  output = prm->toworld ? world  : pixcrd;
+
+  /* Go over all the blocks assigned to this thread. */
+  for(b=0; tprm->indexs[b] != GAL_BLANK_SIZE_T; ++b)
     {
-      (*x)[i] = stat[i] ? NAN : pixcrd[i*2];
-      (*y)[i] = stat[i] ? NAN : pixcrd[i*2+1];
+      /* Set the range of this block. */
+      start = tprm->indexs[b] * WCS_CONVERT_BLOCK;
+      num = ( start+WCS_CONVERT_BLOCK > prm->size
+              ? prm->size-start : WCS_CONVERT_BLOCK );
+
+      /* Write the values into the contiguous array. */
+      for(i=0;i<num;++i)
+        {
+          j=start+i;
+          input[i*2]=in1[j];
+          input[i*2+1]=in2[j];
+          stat[i]=0;
+        }
+
+      /* Do the conversion. */
+      if(prm->toworld)
+        {
+          status=wcsp2s(wcs, num, nelem, pixcrd, imgcrd, phi, theta,
+                        world, stat);
+          if(status)
+            error(EXIT_FAILURE, 0, "gal_wcs_img_to_world: wcsp2s ERROR "
+                  "%d: %s", status, wcs_errmsg[status]);
+        }
+      else
+        {
+          status=wcss2p(wcs, num, nelem, world, phi, theta, imgcrd,
+                        pixcrd, stat);
+          if(status)
+            error(EXIT_FAILURE, 0, "gal_wcs_world_to_img: wcss2p ERROR "
+                  "%d: %s", status, wcs_errmsg[status]);
+        }
+
+      /* Put the values into the output arrays. */
+      for(i=0;i<num;++i)
+        {
+          j=start+i;
+          out1[j] = stat[i] ? NAN : output[i*2];
+          out2[j] = stat[i] ? NAN : output[i*2+1];
+        }
     }
 
-  /* Clean up. */
+  /* Clean up, wait for all the other threads to finish and return. */
+  if(wcs!=prm->wcs) wcsvfree(&nwcs, &wcs);
   free(phi);
   free(stat);
   free(theta);
   free(world);
+  free(imgcrd);
   free(pixcrd);
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+static void
+wcs_convert(struct wcsprm *wcs, double *in1, double *in2, double **out1,
+            double **out2, size_t size, size_t numthreads, int toworld)
+{
+  struct wcs_convert_params prm;
+  size_t numblocks=(size+WCS_CONVERT_BLOCK-1)/WCS_CONVERT_BLOCK;
+
+  /* Allocate the output arrays if they were not already allocated. */
+  if(*out1==NULL) *out1=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
+  if(*out2==NULL) *out2=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
+
+  /* Prepare the parameters. Note that there is no need for more threads
+     than blocks. */
+  prm.wcs=wcs;
+  prm.in1=in1;
+  prm.in2=in2;
+  prm.size=size;
+  prm.out1=*out1;
+  prm.out2=*out2;
+  prm.toworld=toworld;
+  prm.numthreads = numthreads<numblocks ? numthreads : numblocks;
+
+  /* Do the conversion. */
+  gal_threads_spin_off(wcs_convert_on_thread, &prm, numblocks,
+                       prm.numthreads);
+}
+
+
+
+
+
+/* Convert an array of world coordinates to image coordinates. Note that in
+   Gnuastro, each column is treated independently, so the inputs are
+   separate. If `*x==NULL', or `*y==NULL', then space will be allocated for
+   them, otherwise, it is assumed that space has already been
+   allocated. Note that they must each be a 1 dimensional array.
+
+   You can do the conversion in place: just pass the same array as you give
+   to RA and Dec to X and Y.
+
+   The points are converted in blocks that are distributed between
+   `numthreads' threads (each thread uses a copy of `wcs'). */
+void
+gal_wcs_world_to_img(struct wcsprm *wcs, double *ra, double *dec,
+                     double **x, double **y, size_t size,
+                     size_t numthreads)
+{
+  wcs_convert(wcs, ra, dec, x, y, size, numthreads, 0);
 }
 
 
@@ -561,51 +666,452 @@ gal_wcs_world_to_img(struct wcsprm *wcs, double *ra, double *dec,
    world coordinates. */
 void
 gal_wcs_img_to_world(struct wcsprm *wcs, double *x, double *y,
-                     double **ra, double **dec, size_t size)
+                     double **ra, double **dec, size_t size,
+                     size_t numthreads)
 {
-  size_t i;
-  int status, *stat, ncoord=size, nelem=2;
-  double *phi, *theta, *world, *pixcrd, *imgcrd;
-
-  /* Allocate all the necessary arrays. */
-  phi    = gal_data_malloc_array( GAL_TYPE_FLOAT64, size   );
-  stat   = gal_data_calloc_array( GAL_TYPE_INT32,   size   );
-  theta  = gal_data_malloc_array( GAL_TYPE_FLOAT64, size   );
-  world  = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-  imgcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-  pixcrd = gal_data_malloc_array( GAL_TYPE_FLOAT64, 2*size );
-
-  /* Write the values into the allocated contiguous array. */
-  for(i=0;i<size;++i) { pixcrd[i*2]=x[i]; pixcrd[i*2+1]=y[i]; }
-
-  /* Use WCSLIB's wcsp2s for the conversion. */
-  status=wcsp2s(wcs, ncoord, nelem, pixcrd, imgcrd, phi, theta, world, stat);
-  if(status)
-    error(EXIT_FAILURE, 0, "%s: wcsp2s ERROR %d: %s", __func__, status,
+  wcs_convert(wcs, x, y, ra, dec, size, numthreads, 1);
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**************************************************************/
+/**********      Fast (approximate) conversion     ************/
+/**************************************************************/
+/* Evaluating the full WCS (in particular with distortions) for every
+   point can be slow. When many points within a known region are to be
+   converted, we can sample the exact conversion on a regular grid of
+   nodes and use bicubic (Catmull-Rom) interpolation between them. In
+   every cell of the grid, the interpolation is checked against the exact
+   conversion and the grid is made finer until twice the error in all the
+   cells is smaller than the requested tolerance. If a finer grid would be
+   too large, the cells that still don't reach the tolerance are flagged
+   and the points within them are converted exactly, so the tolerance is
+   always the maximum error.
+
+   The grid has one extra node on each side of the requested range, so
+   the four nodes necessary for the cubic interpolation are available
+   along each axis for any point within the range. */
+#define WCS_FAST_MAXNODES 1048576
+
+struct wcs_fast_params
+{
+  gal_wcs_fast_t  *fast;    /* The fast conversion structure.         */
+  double           *in1;    /* First input coordinate.                */
+  double           *in2;    /* Second input coordinate.               */
+  double          *out1;    /* First output coordinate.               */
+  double          *out2;    /* Second output coordinate.              */
+  uint8_t       *outside;   /* Flag for points outside the grid.      */
+  size_t           size;    /* Number of points.                      */
+};
+
+
+
+
+
+/* Interpolate the value of one point. If the point is outside the range
+   of the grid (or in a cell that must be converted exactly), return 0,
+   otherwise, return 1. */
+static int
+wcs_fast_interpolate(gal_wcs_fast_t *fast, double in1, double in2,
+                     double *out1, double *out2)
+{
+  long k0, k1;
+  size_t i, j, n0=fast->dsize[1], ind;
+  double t0, t1, f, wx[4], wy[4], s1, s2, r1, r2;
+
+  /* When the input is in world coordinates, bring the RA within 180
+     degrees of the reference. */
+  if(fast->toworld==0)
+    {
+      while(in1 <  fast->ref-180.0) in1+=360.0;
+      while(in1 >= fast->ref+180.0) in1-=360.0;
+    }
+
+  /* Find the cell of this point. */
+  t0=(in1-fast->start[0])/fast->step;
+  t1=(in2-fast->start[1])/fast->step;
+  if( !(t0>=1.0 && t1>=1.0) ) return 0;     /* Also catches NaN. */
+  k0=t0;
+  k1=t1;
+  if(k0>(long)fast->dsize[1]-3)
+    {
+      if(t0>fast->dsize[1]-2) return 0;
+      k0=fast->dsize[1]-3;
+    }
+  if(k1>(long)fast->dsize[0]-3)
+    {
+      if(t1>fast->dsize[0]-2) return 0;
+      k1=fast->dsize[0]-3;
+    }
+
+  /* The interpolation isn't accurate enough in this cell. */
+  if( fast->exact && fast->exact[ (k1-1)*(fast->dsize[1]-3) + k0-1 ] )
+    return 0;
+
+  /* Catmull-Rom weights along each axis. */
+  f=t0-k0;
+  wx[0] = f*(-0.5+f*(1.0-0.5*f));
+  wx[1] = 1.0+f*f*(-2.5+1.5*f);
+  wx[2] = f*(0.5+f*(2.0-1.5*f));
+  wx[3] = f*f*(-0.5+0.5*f);
+  f=t1-k1;
+  wy[0] = f*(-0.5+f*(1.0-0.5*f));
+  wy[1] = 1.0+f*f*(-2.5+1.5*f);
+  wy[2] = f*(0.5+f*(2.0-1.5*f));
+  wy[3] = f*f*(-0.5+0.5*f);
+
+  /* Do the interpolation. */
+  r1=r2=0.0;
+  for(j=0;j<4;++j)
+    {
+      s1=s2=0.0;
+      ind=(k1-1+j)*n0+k0-1;
+      for(i=0;i<4;++i)
+        {
+          s1 += wx[i] * fast->c1[ind+i];
+          s2 += wx[i] * fast->c2[ind+i];
+        }
+      r1 += wy[j]*s1;
+      r2 += wy[j]*s2;
+    }
+
+  /* When the output is in world coordinates, put the RA in the 0 to 360
+     range. */
+  if(fast->toworld)
+    {
+      if(r1<0.0)         r1+=360.0;
+      else if(r1>=360.0) r1-=360.0;
+    }
+
+  /* Write the output. */
+  *out1=r1;
+  *out2=r2;
+  return 1;
+}
+
+
+
+
+
+static void *
+wcs_fast_on_thread(void *in_prm)
+{
+  struct gal_threads_params *tprm=(struct gal_threads_params *)in_prm;
+  struct wcs_fast_params *prm=(struct wcs_fast_params *)tprm->params;
+
+  size_t i, b, start, end;
+
+  /* Go over all the blocks assigned to this thread. Note that the output
+     of the points that are outside the grid is not touched, so when the
+     conversion is done in place, their input is still available. */
+  for(b=0; tprm->indexs[b] != GAL_BLANK_SIZE_T; ++b)
+    {
+      start = tprm->indexs[b] * WCS_CONVERT_BLOCK;
+      end = ( start+WCS_CONVERT_BLOCK > prm->size
+              ? prm->size : start+WCS_CONVERT_BLOCK );
+      for(i=start;i<end;++i)
+        prm->outside[i] = !wcs_fast_interpolate(prm->fast, prm->in1[i],
+                                                prm->in2[i], &prm->out1[i],
+                                                &prm->out2[i]);
+    }
+
+  /* Wait for all the other threads to finish and return. */
+  if(tprm->b) pthread_barrier_wait(tprm->b);
+  return NULL;
+}
+
+
+
+
+
+/* Check the interpolation in each cell of the grid against the exact
+   conversion and flag the cells where twice the error (in units of
+   pixels) is larger than `tolerance' (in `fast->exact'). The
+   interpolation is exact on the nodes, so the error is checked on nine
+   points in each cell: at one quarter, half and three quarters of the
+   cell width along each axis (covering the middle of the cell and of its
+   sides, where it is largest). The maximum error over the cells that
+   aren't flagged is put in `fast->maxerr' and the number of flagged cells
+   is returned. */
+static size_t
+wcs_fast_check_cells(gal_wcs_fast_t *fast, size_t ncell0, size_t ncell1,
+                     double pixscale, double tolerance, size_t numthreads)
+{
+  uint8_t *exact;
+  size_t i, j, k, c, cell, numexact=0, num=9*ncell0*ncell1;
+  double *e1=NULL, *e2=NULL, a1, a2, err, cellerr;
+  double *in1=gal_data_malloc_array(GAL_TYPE_FLOAT64, num);
+  double *in2=gal_data_malloc_array(GAL_TYPE_FLOAT64, num);
+
+  /* Set the check points (the nine points of each cell are
+     contiguous). */
+  c=0;
+  for(j=0;j<ncell1;++j)
+    for(i=0;i<ncell0;++i)
+      for(k=0;k<9;++k)
+        {
+          in1[c]   = fast->start[0] + (i + 1.25 + (k%3)*0.25) * fast->step;
+          in2[c++] = fast->start[1] + (j + 1.25 + (k/3)*0.25) * fast->step;
+        }
+
+  /* Do the exact conversion. */
+  wcs_convert(fast->wcs, in1, in2, &e1, &e2, num, numthreads,
+              fast->toworld);
+
+  /* Compare the exact and interpolated values in each cell. Note that
+     the interpolation must be done before the cells are flagged. */
+  free(fast->exact);
+  fast->exact=NULL;
+  exact=gal_data_calloc_array(GAL_TYPE_UINT8, ncell0*ncell1);
+  fast->maxerr=0.0;
+  for(cell=0;cell<ncell0*ncell1;++cell)
+    {
+      cellerr=0.0;
+      for(c=9*cell;c<9*cell+9;++c)
+        {
+          if( isnan(e1[c]) || isnan(e2[c])
+              || !wcs_fast_interpolate(fast, in1[c], in2[c], &a1, &a2) )
+            { cellerr=NAN; break; }
+          err = ( fast->toworld
+                  ? ( gal_wcs_angular_distance_deg(e1[c], e2[c], a1, a2)
+                      / pixscale )
+                  : sqrt( (e1[c]-a1)*(e1[c]-a1)
+                          + (e2[c]-a2)*(e2[c]-a2) ) );
+          if( isnan(err) ) { cellerr=NAN; break; }
+          if(err>cellerr) cellerr=err;
+        }
+
+      /* Flag the cell, or use its error. */
+      if( isnan(cellerr) || 2*cellerr>tolerance )
+        { exact[cell]=1; ++numexact; }
+      else if(cellerr>fast->maxerr)
+        fast->maxerr=cellerr;
+    }
+  fast->exact=exact;
+
+  /* Clean up and return. */
+  free(e1);
+  free(e2);
+  free(in1);
+  free(in2);
+  return numexact;
+}
+
+
+
+
+
+/* Make a fast conversion structure for the coordinates within `range'
+   (minimum and maximum of the first input coordinate, then minimum and
+   maximum of the second). When `toworld==1', the inputs are image
+   coordinates, otherwise they are world coordinates. `tolerance' is the
+   maximum acceptable error in units of pixels. If no cell of a
+   reasonably sized grid reaches the tolerance, or some nodes can't be
+   converted (for example close to a pole), this function will return
+   NULL, so the caller can use the exact conversion. */
+gal_wcs_fast_t *
+gal_wcs_fast_make(struct wcsprm *wcs, double *range, int toworld,
+                  double tolerance, size_t numthreads)
+{
+  int status;
+  gal_wcs_fast_t *fast;
+  double *in1, *in2, extent, pixscale, *ps;
+  size_t i, j, c, n0, n1, ncell0, ncell1, numexact, ncell=4;
+
+  /* Sanity check. */
+  if(wcs==NULL) return NULL;
+  if( !(range[1]>=range[0] && range[3]>=range[2]) )
+    error(EXIT_FAILURE, 0, "%s: the range (%g to %g and %g to %g) is not "
+          "acceptable", __func__, range[0], range[1], range[2], range[3]);
+
+  /* Allocate the structure and set the basic values. */
+  errno=0;
+  fast=malloc(sizeof *fast);
+  if(fast==NULL)
+    error(EXIT_FAILURE, errno, "%s: allocating %zu bytes for `fast'",
+          __func__, sizeof *fast);
+  fast->exact=NULL;
+  fast->c1=fast->c2=NULL;
+  fast->toworld=toworld;
+  fast->wcs=gal_wcs_copy(wcs);
+  fast->ref=(range[0]+range[1])/2;
+
+  /* Initialize the internal structures of the WCS here, so it can later
+     be used by many threads for the points outside the grid. */
+  if( (status=wcsset(fast->wcs)) )
+    error(EXIT_FAILURE, 0, "%s: wcsset ERROR %d: %s", __func__, status,
           wcs_errmsg[status]);
 
-  /* For a sanity check:
-  printf("\n\ngal_wcs_img_to_world sanity check:\n");
-  for(i=0;i<size;++i)
-    printf("img (%f, %f) --> world (%f, %f), [stat: %d]\n",
-           pixcrd[i*2], pixcrd[i*2+1], world[i*2], world[i*2+1], stat[i]);
-  */
+  /* The pixel scale (to measure the error of world coordinates). */
+  ps=gal_wcs_pixel_scale_deg(wcs);
+  pixscale=sqrt(ps[0]*ps[1]);
+  free(ps);
+
+  /* Make the grid finer until the tolerance is reached. */
+  extent = range[1]-range[0] > range[3]-range[2]
+    ? range[1]-range[0] : range[3]-range[2];
+  if(extent==0.0) extent=1.0;
+  while(1)
+    {
+      /* Set the grid. */
+      fast->step=extent/ncell;
+      ncell0 = ceil( (range[1]-range[0])/fast->step );
+      ncell1 = ceil( (range[3]-range[2])/fast->step );
+      if(ncell0==0) ncell0=1;
+      if(ncell1==0) ncell1=1;
+      n0=ncell0+3;
+      n1=ncell1+3;
+      if(n0*n1>WCS_FAST_MAXNODES) { gal_wcs_fast_free(fast); return NULL; }
+      fast->dsize[0]=n1;
+      fast->dsize[1]=n0;
+      fast->start[0]=range[0]-fast->step;
+      fast->start[1]=range[2]-fast->step;
+
+      /* Set the coordinates of the nodes and convert them. */
+      in1=gal_data_malloc_array(GAL_TYPE_FLOAT64, n0*n1);
+      in2=gal_data_malloc_array(GAL_TYPE_FLOAT64, n0*n1);
+      for(j=0;j<n1;++j)
+        for(i=0;i<n0;++i)
+          {
+            in1[j*n0+i] = fast->start[0] + i*fast->step;
+            in2[j*n0+i] = fast->start[1] + j*fast->step;
+          }
+      free(fast->c1);
+      free(fast->c2);
+      fast->c1=fast->c2=NULL;
+      wcs_convert(fast->wcs, in1, in2, &fast->c1, &fast->c2, n0*n1,
+                  numthreads, toworld);
+      free(in1);
+      free(in2);
+
+      /* The nodes that couldn't be converted can't be interpolated. */
+      for(c=0;c<n0*n1;++c)
+        if( isnan(fast->c1[c]) || isnan(fast->c2[c]) )
+          { gal_wcs_fast_free(fast); return NULL; }
+
+      /* When the output is RA, it must be continuous over the grid: bring
+         all the values within 180 degrees of the central node. */
+      if(toworld)
+        {
+          fast->ref=fast->c1[ (n1/2)*n0 + n0/2 ];
+          for(c=0;c<n0*n1;++c)
+            {
+              if(fast->c1[c] <  fast->ref-180.0) fast->c1[c]+=360.0;
+              if(fast->c1[c] >= fast->ref+180.0) fast->c1[c]-=360.0;
+            }
+        }
+
+      /* Check the error in all the cells. */
+      numexact=wcs_fast_check_cells(fast, ncell0, ncell1, pixscale,
+                                    tolerance, numthreads);
+      if(numexact==0) break;
+
+      /* If a finer grid (with at most twice the number of cells along
+         each axis) would be too large, keep this grid: the flagged cells
+         will be converted exactly. */
+      if( (2*ncell0+3)*(2*ncell1+3) > WCS_FAST_MAXNODES )
+        {
+          if(numexact==ncell0*ncell1)
+            { gal_wcs_fast_free(fast); return NULL; }
+          break;
+        }
+      ncell*=2;
+    }
+
+  /* Return the structure. */
+  return fast;
+}
 
-  /* Allocate the output arrays if they were not already allocated. */
-  if(*ra==NULL)  *ra  = gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
-  if(*dec==NULL) *dec = gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
 
-  /* Put the values into the output arrays. */
-  for(i=0;i<size;++i)
+
+
+
+/* Convert the coordinates with the fast conversion structure. The inputs
+   and outputs are similar to `gal_wcs_img_to_world' (when the structure
+   was made with `toworld==1'), or `gal_wcs_world_to_img'. The points that
+   are outside the range of the grid (or in its flagged cells) will be
+   converted exactly. */
+void
+gal_wcs_fast_convert(gal_wcs_fast_t *fast, double *in1, double *in2,
+                     double **out1, double **out2, size_t size,
+                     size_t numthreads)
+{
+  size_t i, c, numout, numblocks;
+  struct wcs_fast_params prm;
+  double *t1, *t2, *o1=NULL, *o2=NULL;
+
+  /* Allocate the output arrays if they were not already allocated. */
+  if(*out1==NULL) *out1=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
+  if(*out2==NULL) *out2=gal_data_malloc_array(GAL_TYPE_FLOAT64, size);
+
+  /* Do the interpolation on the requested number of threads. */
+  prm.in1=in1;
+  prm.in2=in2;
+  prm.fast=fast;
+  prm.size=size;
+  prm.out1=*out1;
+  prm.out2=*out2;
+  prm.outside=gal_data_malloc_array(GAL_TYPE_UINT8, size);
+  numblocks=(size+WCS_CONVERT_BLOCK-1)/WCS_CONVERT_BLOCK;
+  gal_threads_spin_off(wcs_fast_on_thread, &prm, numblocks,
+                       numthreads<numblocks ? numthreads : numblocks);
+
+  /* Count the points that were outside the grid. */
+  numout=0;
+  for(i=0;i<size;++i) numout+=prm.outside[i];
+
+  /* Convert them exactly. */
+  if(numout)
     {
-      (*ra)[i]  = stat[i] ? NAN : world[i*2];
-      (*dec)[i] = stat[i] ? NAN : world[i*2+1];
+      t1=gal_data_malloc_array(GAL_TYPE_FLOAT64, numout);
+      t2=gal_data_malloc_array(GAL_TYPE_FLOAT64, numout);
+      c=0;
+      for(i=0;i<size;++i)
+        if(prm.outside[i]) { t1[c]=in1[i]; t2[c++]=in2[i]; }
+      wcs_convert(fast->wcs, t1, t2, &o1, &o2, numout, numthreads,
+                  fast->toworld);
+      c=0;
+      for(i=0;i<size;++i)
+        if(prm.outside[i]) { (*out1)[i]=o1[c]; (*out2)[i]=o2[c++]; }
+      free(o1);
+      free(o2);
+      free(t1);
+      free(t2);
     }
 
   /* Clean up. */
-  free(phi);
-  free(stat);
-  free(theta);
-  free(world);
-  free(pixcrd);
+  free(prm.outside);
+}
+
+
+
+
+
+void
+gal_wcs_fast_free(gal_wcs_fast_t *fast)
+{
+  int nwcs=1;
+  if(fast==NULL) return;
+  if(fast->wcs) wcsvfree(&nwcs, &fast->wcs);
+  free(fast->exact);
+  free(fast->c1);
+  free(fast->c2);
+  free(fast);
 }
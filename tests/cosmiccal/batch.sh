@@ -0,0 +1,67 @@
+# Calculations over the redshifts of a table.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=cosmiccal
+execname=../bin/$prog/ast$prog
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+if [ ! -f $execname ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# Each row of the output should be equal to the value calculated for a
+# single redshift (which is printed with 6 decimals).
+set -e
+redshifts="0.01 0.5 2.5 10"
+for z in $redshifts; do echo $z; done > batch-z.txt
+$execname batch-z.txt --column=1 --onlyabsmagconv --output=batch.txt
+
+test $(grep -v '^#' batch.txt | wc -l) = 4
+grep -v '^#' batch.txt | while read value; do
+    z=${redshifts%% *}; redshifts=${redshifts#* }
+    single=$($execname --redshift=$z --onlyabsmagconv)
+    awk -v a=$value -v b=$single \
+        'BEGIN{d=a-b; if(d<0) d=-d; if(d>1e-5) exit 1}'
+done
+
+# The redshift can't be given with a table.
+if $execname batch-z.txt --column=1 --redshift=1 > /dev/null 2>&1; then
+    echo "--redshift was accepted with an input table"; exit 1
+fi
@@ -0,0 +1,81 @@
+# Crop a concave polygon from an image.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=crop
+img=mkprofcat1.fits
+execname=../bin/$prog/ast$prog
+arith=../bin/arithmetic/astarithmetic
+stats=../bin/statistics/aststatistics
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $img ] || [ ! -f $arith ] \
+   || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The crop box starts at pixel (121,50) of the input, so the output pixel
+# (X,Y) is input pixel (X+120,Y+49). Pixels 390:410,270:290 of the input
+# are inside the concave notch (right of the (300.5,280.3) vertex), so they
+# must all be blank. Pixels 240:260,240:260 of the input are inside the
+# polygon body, so none of them may be blank (zero is not blank here).
+set -e
+$execname $img --mode=img --zeroisnotblank \
+          --output=imgpolygonconcave.fits \
+          --polygon=209,50:436.76,151:300.5,280.3:475.64,438.2:121.4,289.88
+
+$execname imgpolygonconcave.fits --section=270:290,221:241 \
+          --output=imgpolygonconcave-notch.fits
+$arith imgpolygonconcave-notch.fits isblank -h1 --quiet \
+       --output=imgpolygonconcave-notchblank.fits
+if ! $stats imgpolygonconcave-notchblank.fits --minimum \
+        | awk '{exit !($1==1)}'; then
+    echo "some pixels in the concave notch are not blank"; exit 1
+fi
+
+$execname imgpolygonconcave.fits --section=120:140,191:211 \
+          --output=imgpolygonconcave-body.fits
+$arith imgpolygonconcave-body.fits isblank -h1 --quiet \
+       --output=imgpolygonconcave-bodyblank.fits
+if ! $stats imgpolygonconcave-bodyblank.fits --maximum \
+        | awk '{exit !($1==0)}'; then
+    echo "some pixels in the polygon body are blank"; exit 1
+fi
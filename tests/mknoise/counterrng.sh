@@ -0,0 +1,64 @@
+# Add noise with the counter-based random number generator.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mknoise
+img=convolve_spatial.fits
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $img ] || [ ! -f $arith ] \
+   || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# With the counter-based random number generator, the noise only depends
+# on the seed and the pixel, so two runs with the same seed (and a
+# different number of threads) should give identical outputs.
+set -e
+export GSL_RNG_SEED=1
+$execname --envseed --counterrng $img --numthreads=1 \
+          --output=counterrng.fits
+$execname --envseed --counterrng $img --numthreads=4 \
+          --output=counterrng-2.fits
+samepixels counterrng.fits counterrng-2.fits
@@ -0,0 +1,62 @@
+# Add noise to an image that is read a few rows at a time.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mknoise
+img=convolve_spatial.fits
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $img ] || [ ! -f $arith ] \
+   || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# Adding noise to a few rows of the input at a time should give the same
+# output as adding noise to the whole image (with the same seed).
+set -e
+export GSL_RNG_SEED=1
+export GSL_RNG_TYPE=ranlxs2
+$execname --envseed $img --streamrows=7 --output=streamrows.fits
+$execname --envseed $img --output=streamrows-whole.fits
+samepixels streamrows.fits streamrows-whole.fits
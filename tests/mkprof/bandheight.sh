@@ -0,0 +1,60 @@
+# Build the merged image in bands of a few rows and compare it with the
+# merged image built at once.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mkprof
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+cat=$topsrc/tests/$prog/mkprofcat1.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+if [ ! -f $execname ] || [ ! -f $arith ] || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The shifts make the last rows of the profiles at the bottom of the image
+# go beyond the last band. With `--envseed', the random points of both
+# runs are the same, so the two images should be identical.
+set -e
+export GSL_RNG_SEED=1
+opts="--naxis1=100 --naxis2=100 --xshift=3 --yshift=3 --envseed"
+$execname $cat $opts --output=bandheight.fits --bandheight=7
+$execname $cat $opts --output=bandheight-whole.fits
+samepixels bandheight.fits bandheight-whole.fits
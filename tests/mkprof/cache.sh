@@ -0,0 +1,65 @@
+# Build two profiles with the same parameters (the second is copied from
+# the cache of built profiles).
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mkprof
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+cat=$topsrc/tests/$prog/cache.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+if [ ! -f $execname ] || [ ! -f $arith ] || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The two rows only differ in the integer part of their position and in
+# their ID, so with `--envseed' the second profile is taken from the cache
+# (which is reported on the standard output). With one thread, the first
+# profile is complete before the second is built, so only the second
+# should come from the cache. The two individual profiles should also be
+# identical.
+set -e
+export GSL_RNG_SEED=1
+$execname $cat --naxis1=100 --naxis2=100 --envseed --individual \
+          --numthreads=1 > cache-report.txt
+cat cache-report.txt
+test $(grep -c "from the profile cache" cache-report.txt) = 1
+grep "row 1 complete (from the profile cache)" cache-report.txt > /dev/null
+samepixels 0_cache.fits 1_cache.fits
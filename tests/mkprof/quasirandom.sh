@@ -0,0 +1,58 @@
+# Build the central pixels of the profiles with quasi-random points: two
+# runs (without a fixed random seed) should give the same image.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=mkprof
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+cat=$topsrc/tests/$prog/mkprofcat1.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+if [ ! -f $execname ] || [ ! -f $arith ] || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# Unlike pseudo-random points, the quasi-random points don't depend on the
+# random seed (which is different in each run without `--envseed').
+set -e
+opts="--naxis1=100 --naxis2=100 --quasirandom"
+$execname $cat $opts --output=quasirandom.fits
+$execname $cat $opts --output=quasirandom-2.fits
+samepixels quasirandom.fits quasirandom-2.fits
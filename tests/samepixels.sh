@@ -0,0 +1,46 @@
+# This is not a test of any of the programs, it defines the `samepixels'
+# shell function for the tests that need to check if two images are
+# identical. It is sourced by those tests (after `prog' and `execname'
+# are set) and is part of the GNU Astronomy Utilities (Gnuastro).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Programs used for the comparison (in the build tree). The tests that
+# source this file should skip if they don't exist.
+arith=../bin/arithmetic/astarithmetic
+stats=../bin/statistics/aststatistics
+
+
+
+
+
+# Compare the first extension of the two images given as arguments and
+# return 0 only if they have the same pixels. Statistics ignores blank
+# pixels, so first the blank pixels must be in the same positions (the
+# two `isblank' images must be identical). Then the difference of the
+# two images must be zero on all the non-blank pixels.
+samepixels ()
+{
+  base=$(basename $1 .fits)
+
+  $arith $1 isblank $2 isblank ne -h1 -h1 --output=$base-blankdiff.fits \
+         --quiet || return 1
+  $stats $base-blankdiff.fits --maximum | awk '{exit !($1==0)}' \
+      || { echo "$1 and $2: blank pixels differ"; return 1; }
+
+  $arith $1 $2 - -h1 -h1 --output=$base-diff.fits --quiet || return 1
+  $stats $base-diff.fits --minimum --maximum \
+      | awk '{exit !($1==0 && $2==0)}' \
+      || { echo "$1 and $2: pixel values differ"; return 1; }
+}
@@ -0,0 +1,63 @@
+# Write a cache of a plain text table and read the table from it.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+execname=../bin/$prog/ast$prog
+txt=$topsrc/tests/$prog/table.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $txt ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The cache is written next to the table, so a copy of the table (in the
+# build directory) is used. After the cache is written, the table is read
+# from it, so the printed table should not change.
+set -e
+cp $txt cache-table.txt
+chmod u+w cache-table.txt
+rm -f cache-table.txt.gtc
+$execname cache-table.txt > cache-parsed.txt
+$execname cache-table.txt --cache
+test -f cache-table.txt.gtc
+$execname cache-table.txt > cache-read.txt
+cmp cache-parsed.txt cache-read.txt
@@ -0,0 +1,82 @@
+# Only read selected rows from a binary table
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=table
+execname=../bin/$prog/ast$prog
+table=binary-table.fits
+txt=$topsrc/tests/$prog/table.txt
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $table ] || [ ! -f $txt ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# The test table has 12 rows, the `INT32' column of row `i' is `-i' and
+# the `FLOAT32' column is blank in rows 5, 6 and 9. So each selection
+# below has a known number of surviving rows. Without `--output', the
+# rows are printed on the standard output (one line per row).
+set -e
+check ()
+{
+  expected=$1; shift
+  found=$($execname "$@" | wc -l)
+  if [ $found != $expected ]; then
+      echo "$*: $found rows, expected $expected"; exit 1
+  fi
+}
+for in in "$table -h1" "$txt"; do
+    check 8 $in --rowrange=2,9
+    check 6 $in --range=INT32,-8,-3
+    check 3 $in --rowrange=2,9 --range=INT32,-8,-3 --range=FLOAT32,0,1e4
+
+    # Blank values are never in a range.
+    check 9 $in --range=FLOAT32,-1e10,1e10
+
+    # An empty selection is an error.
+    if $execname $in --range=INT32,1,5 > /dev/null 2>&1; then
+        echo "$in: empty selection didn't fail"; exit 1
+    fi
+done
+
+# The selected rows in a file.
+$execname $table --output=select-rows.txt -h1 --rowrange=2,9 \
+          --range=INT32,-8,-3 --range=FLOAT32,0,1e4
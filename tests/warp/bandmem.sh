@@ -0,0 +1,63 @@
+# Apply a general homographic transformation to an image in bands.
+#
+# See the Tests subsection of the manual for a complete explanation
+# (in the Installing gnuastro section).
+#
+# Original author:
+#     agent <agent@local>
+# Contributing author(s):
+#
+# Copying and distribution of this file, with or without modification,
+# are permitted in any medium without royalty provided the copyright
+# notice and this notice are preserved.  This file is offered as-is,
+# without any warranty.
+
+
+
+
+
+# Preliminaries
+# =============
+#
+# Set the variabels (The executable is in the build tree). Do the
+# basic checks to see if the executable is made or if the defaults
+# file exists (basicchecks.sh is in the source tree).
+prog=warp
+img=convolve_spatial.fits
+execname=../bin/$prog/ast$prog
+. $topsrc/tests/samepixels.sh
+
+
+
+
+
+# Skip?
+# =====
+#
+# If the dependencies of the test don't exist, then skip it. There are two
+# types of dependencies:
+#
+#   - The executable was not made (for example due to a configure option),
+#
+#   - The input data was not made (for example the test that created the
+#     data file failed).
+if [ ! -f $execname ] || [ ! -f $img ] || [ ! -f $arith ] \
+   || [ ! -f $stats ]; then exit 77; fi
+
+
+
+
+
+# Actual test script
+# ==================
+#
+# Warping in bands (with a small memory budget) should give the same
+# result as warping the whole image at once.
+set -e
+matrix="0.707106781,-0.707106781,0,  0.707106781, 0.707106781,0,"
+matrix="$matrix  0.001,0.002,1"
+$execname $img --output=bandmem.fits --bandmem=300000 \
+          --matrix="$matrix" --coveredfrac=0.5
+$execname $img --output=bandmem-whole.fits \
+          --matrix="$matrix" --coveredfrac=0.5
+samepixels bandmem.fits bandmem-whole.fits